@@ -10,6 +10,8 @@ namespace tiles {
 
 using bq_node_t = uint32_t;
 
+constexpr auto const kBQMaxBitmapZoomLevel = 12U;  // 2^24 bits = 2 MiB
+
 struct bq_tree {
   bq_tree();
   explicit bq_tree(std::string_view);
@@ -18,6 +20,10 @@ struct bq_tree {
   bool contains(geo::tile const& q) const;
   std::vector<geo::tile> all_leafs(geo::tile const& q) const;
 
+  // dense bitmap on the level of the deepest TRUE leaf (if <= max_z)
+  // afterwards queries on or below this level are a single bit test
+  void materialize_bitmap(uint32_t max_z = kBQMaxBitmapZoomLevel);
+
   std::string_view string_view() const;
   void dump() const;
 
@@ -27,8 +33,14 @@ private:
   std::pair<std::optional<bool>, bq_node_t> find_parent_leaf(
       geo::tile const& q) const;
 
+  // the value from the bitmap (if materialized and q.z_ >= bitmap_z_)
+  std::optional<bool> find_in_bitmap(geo::tile const& q) const;
+
 public:
   std::vector<bq_node_t> nodes_;
+
+  std::optional<uint32_t> bitmap_z_;
+  std::vector<uint64_t> bitmap_;  // row major: (y << bitmap_z_) | x
 };
 
 bq_tree make_bq_tree(std::vector<geo::tile> const&);
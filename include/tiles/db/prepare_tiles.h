@@ -1,12 +1,19 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <string>
 
 namespace tiles {
 
 struct tile_db_handle;
 struct pack_handle;
 
-void prepare_tiles(tile_db_handle&, pack_handle&, uint32_t max_zoomlevel);
+// point_grid: see set_point_grid, max_tile_bytes: 0 = unlimited,
+// priority_key: see render_ctx::tb_priority_key_
+void prepare_tiles(tile_db_handle&, pack_handle&, uint32_t max_zoomlevel,
+                   std::string const& point_grid = "",
+                   size_t max_tile_bytes = 0,
+                   std::string const& priority_key = "priority");
 
 }  // namespace tiles
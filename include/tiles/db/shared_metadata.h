@@ -1,14 +1,21 @@
 #pragma once
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "protozero/pbf_reader.hpp"
 #include "protozero/pbf_writer.hpp"
+#include "protozero/varint.hpp"
 
-#include "utl/concat.h"
-#include "utl/equal_ranges_linear.h"
-#include "utl/erase_if.h"
 #include "utl/to_vec.h"
 #include "utl/verify.h"
 
@@ -19,76 +26,185 @@
 
 namespace tiles {
 
-struct shared_metadata_builder {
-  static constexpr auto kFlushThreshold = 1e7;
+struct metadata_hash {
+  size_t operator()(metadata const& m) const {
+    auto const h = std::hash<std::string>{}(m.key_);
+    return h ^ (std::hash<std::string>{}(m.value_) + 0x9e3779b9 + (h << 6U) +
+                (h >> 2U));
+  }
+};
 
-  void update(std::vector<metadata> const& data) {
-    queue_.enqueue_bulk(data);
+using metadata_count_map = std::unordered_map<metadata, uint64_t, metadata_hash>;
+
+// counts are aggregated by a background thread: producers hand over
+// (thread local) count maps, the merge never happens on a producer thread
+//
+// the aggregated counts are a bounded heavy hitter sketch (batched
+// space-saving): if more than 2 * capacity pairs are tracked, all but the
+// capacity most frequent ones are evicted. pairs (re-)entering afterwards
+// start at the eviction threshold (overestimate, tracked as error_).
+//
+// if the aggregator fails, further counts are dropped and the exception is
+// rethrown by finish() (the destructor only joins)
+struct shared_metadata_builder {
+  static constexpr auto kMaxQueuedMaps = 16ULL;  // back pressure
+  static constexpr auto kSketchFactor = 4ULL;  // capacity / dictionary size
+
+  struct sketch_entry {
+    uint64_t count_{0}, error_{0};
+  };
+
+  explicit shared_metadata_builder(size_t const dict_size = 1'000'000ULL)
+      : dict_size_{dict_size},
+        capacity_{std::max(dict_size, size_t{1}) * kSketchFactor},
+        aggregator_{[this] { aggregate(); }} {}
+  ~shared_metadata_builder() { stop(); }
+
+  shared_metadata_builder(shared_metadata_builder const&) = delete;
+  shared_metadata_builder(shared_metadata_builder&&) = delete;
+  shared_metadata_builder& operator=(shared_metadata_builder const&) = delete;
+  shared_metadata_builder& operator=(shared_metadata_builder&&) = delete;
+
+  void enqueue(metadata_count_map&& counts) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    cv_.wait(lock, [&] {
+      return queue_.size() < kMaxQueuedMaps || aggregator_exception_;
+    });
+    if (aggregator_exception_) {
+      return;  // rethrown by finish()
+    }
+    queue_.emplace_back(std::move(counts));
+    cv_.notify_all();
+  }
 
-    // TODO(root): flush in other thread
-    if (should_flush()) {
-      flush();
+  void aggregate() {
+    try {
+      aggregate_queue();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock{mutex_};
+      aggregator_exception_ = std::current_exception();
+      queue_.clear();
+      cv_.notify_all();
     }
   }
 
-  bool should_flush() { return queue_.pending_ > kFlushThreshold; }
+  void aggregate_queue() {
+    while (true) {
+      metadata_count_map counts;
+      {
+        std::unique_lock<std::mutex> lock{mutex_};
+        cv_.wait(lock, [&] { return !queue_.empty() || finished_; });
+        if (queue_.empty()) {
+          return;
+        }
+        counts = std::move(queue_.front());
+        queue_.pop_front();
+        cv_.notify_all();
+      }
+
+      for (auto it = begin(counts); it != end(counts);) {
+        auto const count = it->second;
+        stat_total_ += count;
+
+        // try_emplace with a moved key: no copies of the strings
+        auto node = counts.extract(it++);
+        auto const [pos, inserted] =
+            counts_.try_emplace(std::move(node.key()), sketch_entry{});
+        if (inserted) {
+          pos->second = sketch_entry{threshold_ + count, threshold_};
+        } else {
+          pos->second.count_ += count;
+        }
+      }
+
+      if (counts_.size() > 2 * capacity_) {
+        prune();
+      }
+    }
+  }
 
-  bool flush(bool force = false) {
-    if (!should_flush() && !force) {
-      return false;
+  void prune() {
+    std::vector<uint64_t> counts;
+    counts.reserve(counts_.size());
+    for (auto const& [meta, entry] : counts_) {
+      counts.push_back(entry.count_);
     }
 
-    std::vector<metadata> buf(kFlushThreshold);
-    queue_.dequeue_bulk(buf);
-    queue_.finish_bulk(buf.size());  // directly (shutdown determined globally)
-    if (buf.empty()) {
-      return false;
+    auto const nth = begin(counts) + (counts.size() - capacity_);
+    std::nth_element(begin(counts), nth, end(counts));
+    threshold_ = std::max(threshold_, *nth);
+
+    for (auto it = begin(counts_); it != end(counts_);) {
+      if (it->second.count_ <= threshold_) {
+        it = counts_.erase(it);
+        ++stat_evicted_;
+      } else {
+        ++it;
+      }
     }
+  }
 
-    std::vector<std::pair<metadata, uint64_t>> buf_counts;
-    std::sort(begin(buf), end(buf));
-    utl::equal_ranges_linear(buf, [&](auto lb, auto ub) {
-      buf_counts.emplace_back(*lb, std::distance(lb, ub));
-    });
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      finished_ = true;
+    }
+    cv_.notify_all();
+    if (aggregator_.joinable()) {
+      aggregator_.join();
+    }
+  }
 
-    std::lock_guard<std::mutex> lock{mutex_};
-    auto old_size = counts_.size();
-    utl::concat(counts_, buf_counts);
-    std::inplace_merge(
-        begin(counts_), begin(counts_) + old_size, end(counts_),
-        [](auto const& a, auto const& b) { return a.first < b.first; });
-
-    utl::equal_ranges_linear(
-        counts_,
-        [](auto const& a, auto const& b) { return a.first == b.first; },
-        [&](auto lb, auto ub) {
-          if (std::distance(lb, ub) == 1) {
-            return;
-          }
-          utl::verify(std::distance(lb, ub) == 2,
-                      "shared_metadata_builder: unexpected element count");
-          lb->second += std::next(lb)->second;
-          std::next(lb)->second = 0;
-        });
-    utl::erase_if(counts_, [](auto const& pair) { return pair.second == 0; });
-
-    return true;
+  void finish() {
+    stop();
+    if (aggregator_exception_) {
+      std::rethrow_exception(aggregator_exception_);
+    }
   }
 
   void store(tile_db_handle& db_handle, lmdb::txn& txn) {
-    while (flush(true)) {
+    finish();
+
+    // guaranteed (lower bound) count > 1 : worth coding
+    std::vector<std::pair<metadata, uint64_t>> counts;
+    for (auto& [meta, entry] : counts_) {
+      if (entry.count_ - entry.error_ > 1) {
+        counts.emplace_back(meta, entry.count_);
+      }
     }
+    counts_.clear();
 
-    utl::erase_if(counts_, [](auto const& pair) { return pair.second == 1; });
-    std::sort(begin(counts_), end(counts_),
-              [](auto const& a, auto const& b) { return a.second > b.second; });
+    std::sort(begin(counts), end(counts), [](auto const& a, auto const& b) {
+      return std::tie(b.second, a.first) < std::tie(a.second, b.first);
+    });
+    if (counts.size() > dict_size_) {
+      counts.resize(dict_size_);
+    }
 
-    t_log("have {} key/value pairs in shared metadata",
-          printable_num(counts_.size()));
+    // inline: key + value with tag and length each, coded: varint id
+    uint64_t coded_occurences = 0;
+    uint64_t saved_bytes = 0;
+    for (auto i = 0ULL; i < counts.size(); ++i) {
+      auto const& [meta, count] = counts[i];
+      auto const inline_size = meta.key_.size() + meta.value_.size() + 4;
+      auto const coded_size =
+          static_cast<size_t>(protozero::length_of_varint(i));
+      coded_occurences += count;
+      saved_bytes += count * (inline_size - std::min(inline_size, coded_size));
+    }
+
+    t_log("have {} key/value pairs in shared metadata (limit {})",
+          printable_num(counts.size()), printable_num(dict_size_));
+    t_log("shared metadata: {} of {} pairs coded, est. savings {}",
+          printable_num(coded_occurences), printable_num(stat_total_),
+          printable_bytes(saved_bytes));
+    t_log("shared metadata: sketch capacity {}, evicted {}, threshold {}",
+          printable_num(capacity_), printable_num(stat_evicted_),
+          printable_num(threshold_));
 
     std::string buf;
     protozero::pbf_writer writer{buf};
-    for (auto const& meta : counts_) {
+    for (auto const& meta : counts) {
       writer.add_string(1, meta.first.key_);
       writer.add_string(1, meta.first.value_);
     }
@@ -97,10 +213,53 @@ struct shared_metadata_builder {
     txn.put(meta_dbi, kMetaKeyFeatureMetaCoding, buf);
   }
 
-  queue_wrapper<metadata> queue_;
-
   std::mutex mutex_;
-  std::vector<std::pair<metadata, uint64_t>> counts_;
+  std::condition_variable cv_;
+  bool finished_{false};
+  std::exception_ptr aggregator_exception_;
+  std::deque<metadata_count_map> queue_;
+
+  size_t dict_size_, capacity_;
+
+  // owned by the aggregator thread
+  std::unordered_map<metadata, sketch_entry, metadata_hash> counts_;
+  uint64_t threshold_{0};
+  uint64_t stat_total_{0}, stat_evicted_{0};
+
+  std::thread aggregator_;  // last: starts after all members are initialized
+};
+
+// one per producer thread: hands its counts over in batches
+struct local_metadata_counter {
+  static constexpr auto kFlushThreshold = 100'000ULL;  // distinct pairs
+
+  explicit local_metadata_counter(shared_metadata_builder& builder)
+      : builder_{builder} {}
+  ~local_metadata_counter() { flush(); }
+
+  local_metadata_counter(local_metadata_counter const&) = delete;
+  local_metadata_counter(local_metadata_counter&&) = delete;
+  local_metadata_counter& operator=(local_metadata_counter const&) = delete;
+  local_metadata_counter& operator=(local_metadata_counter&&) = delete;
+
+  void update(std::vector<metadata> const& data) {
+    for (auto const& m : data) {
+      ++counts_[m];
+    }
+    if (counts_.size() > kFlushThreshold) {
+      flush();
+    }
+  }
+
+  void flush() {
+    if (!counts_.empty()) {
+      builder_.enqueue(std::move(counts_));
+      counts_ = metadata_count_map{};
+    }
+  }
+
+  shared_metadata_builder& builder_;
+  metadata_count_map counts_;
 };
 
 struct shared_metadata_decoder {
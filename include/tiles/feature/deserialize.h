@@ -30,6 +30,7 @@ inline std::optional<feature> deserialize_feature(
   std::vector<metadata> meta;
 
   std::vector<std::string_view> simplify_masks;
+  auto mask_type = simplify_mask_type::zoom_levels;
   fixed_geometry geometry;
 
   namespace pz = protozero;
@@ -97,6 +98,10 @@ inline std::optional<feature> deserialize_feature(
         break;
 
       case tags::feature::repeated_string_simplify_masks:
+        simplify_masks.emplace_back(msg.get_view());
+        mask_type = simplify_mask_type::geo;
+        break;
+      case tags::feature::repeated_string_simplify_levels:
         simplify_masks.emplace_back(msg.get_view());
         break;
       case tags::feature::required_fixed_geometry_geometry: {
@@ -106,7 +111,7 @@ inline std::optional<feature> deserialize_feature(
         if (zoom_level_hint != kInvalidZoomLevel &&
             !simplify_masks_tmp.empty()) {
           geometry = deserialize(msg.get_view(), std::move(simplify_masks_tmp),
-                                 zoom_level_hint);
+                                 zoom_level_hint, mask_type);
           if (mpark::holds_alternative<fixed_null>(geometry)) {
             return std::nullopt;  // killed by mask
           }
@@ -38,8 +38,10 @@ enum class feature : protozero::pbf_tag_type {
   repeated_string_keys = 4,
   repeated_string_values = 5,
 
-  repeated_string_simplify_masks = 6,
-  required_fixed_geometry_geometry = 7
+  repeated_string_simplify_masks = 6,  // geo bitmasks (older imports)
+  required_fixed_geometry_geometry = 7,
+
+  repeated_string_simplify_levels = 8  // see make_simplify_mask.h
 };
 
 }  // namespace tags
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <tuple>
 
 #include "tiles/bin_utils.h"
@@ -22,15 +23,9 @@ inline std::string encode_bool(bool v) {
   return buf;
 }
 
-inline std::string encode_string(std::string const& v) {
-  std::string buf;
-  append(buf, metadata_value_t::string);
-  buf.append(v);
-  return buf;
-}
-
 inline std::string encode_string(std::string_view v) {
   std::string buf;
+  buf.reserve(sizeof(metadata_value_t) + v.size());
   append(buf, metadata_value_t::string);
   buf.append(v);
   return buf;
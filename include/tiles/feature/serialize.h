@@ -75,7 +75,7 @@ inline std::string serialize_feature(
 
   if (!fast) {
     for (auto const& mask : make_simplify_mask(f.geometry_)) {
-      pb.add_string(tags::feature::repeated_string_simplify_masks, mask);
+      pb.add_string(tags::feature::repeated_string_simplify_levels, mask);
     }
   }
 
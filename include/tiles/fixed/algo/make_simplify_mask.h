@@ -1,11 +1,25 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "utl/to_vec.h"
 
-#include "geo/simplify_mask.h"
+#include "tiles/fixed/fixed_geometry.h"
 
 namespace tiles {
 
+// per vertex: the lowest zoom level at which it is kept (one byte each)
+// Douglas-Peucker with tolerance 1 << (kMaxZoomLevel - z) on every level,
+// computed in a single iterative pass (importance of a vertex is the min
+// of its own and its parent's split distance). all vertices are kept at z20.
+std::string make_simplify_mask(fixed_xy const* points, size_t size);
+
+template <typename Container>
+std::string make_simplify_mask_for(Container const& c) {
+  return c.empty() ? std::string{} : make_simplify_mask(&c.front(), c.size());
+}
+
 inline std::vector<std::string> make_simplify_mask(fixed_null const&) {
   return {};
 }
@@ -14,20 +28,16 @@ inline std::vector<std::string> make_simplify_mask(fixed_point const&) {
 }
 
 inline std::vector<std::string> make_simplify_mask(fixed_polyline const& geo) {
-  return utl::to_vec(geo, [](auto const& line) {
-    return geo::serialize_simplify_mask(geo::make_simplify_mask(line));
-  });
+  return utl::to_vec(
+      geo, [](auto const& line) { return make_simplify_mask_for(line); });
 }
 
 inline std::vector<std::string> make_simplify_mask(fixed_polygon const& geo) {
   std::vector<std::string> masks;
   for (auto const& polygon : geo) {
-    masks.emplace_back(
-        geo::serialize_simplify_mask(geo::make_simplify_mask(polygon.outer())));
-
+    masks.emplace_back(make_simplify_mask_for(polygon.outer()));
     for (auto const& inner : polygon.inners()) {
-      masks.emplace_back(
-          geo::serialize_simplify_mask(geo::make_simplify_mask(inner)));
+      masks.emplace_back(make_simplify_mask_for(inner));
     }
   }
   return masks;
@@ -2,6 +2,8 @@
 
 #include "geo/simplify_mask.h"
 
+#include "utl/erase_if.h"
+
 #include "tiles/fixed/fixed_geometry.h"
 
 namespace tiles {
@@ -20,8 +22,26 @@ inline fixed_geometry simplify(fixed_polyline multi_polyline,
   return multi_polyline;
 }
 
-inline fixed_geometry simplify(fixed_polygon multi_polygon, uint32_t const) {
-  return multi_polygon;
+// rings are simplified independently: self intersections are possible,
+// but are resolved by the clipper based clip() at render time
+inline fixed_geometry simplify(fixed_polygon multi_polygon, uint32_t const z) {
+  for (auto& polygon : multi_polygon) {
+    geo::simplify(polygon.outer(), z);
+    for (auto& inner : polygon.inners()) {
+      geo::simplify(inner, z);
+    }
+  }
+
+  utl::erase_if(multi_polygon, [](auto& p) {
+    utl::erase_if(p.inners(), [](auto const& i) { return i.size() < 4; });
+    return p.outer().size() < 4;
+  });
+
+  if (multi_polygon.empty()) {
+    return fixed_null{};
+  } else {
+    return multi_polygon;
+  }
 }
 
 inline fixed_geometry simplify(fixed_geometry geometry, uint32_t const z) {
@@ -1,14 +1,20 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "tiles/fixed/fixed_geometry.h"
 
 namespace tiles {
 
+// geo: bitmasks from geo::make_simplify_mask (databases of older imports)
+// zoom_levels: see tiles/fixed/algo/make_simplify_mask.h
+enum class simplify_mask_type { geo, zoom_levels };
+
 fixed_geometry deserialize(std::string_view geo);
-fixed_geometry deserialize(std::string_view geo,
-                           std::vector<std::string_view> simplify_masks,
-                           uint32_t z);
+fixed_geometry deserialize(
+    std::string_view geo, std::vector<std::string_view> simplify_masks,
+    uint32_t z, simplify_mask_type = simplify_mask_type::zoom_levels);
 
 }  // namespace tiles
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <map>
+#include <string>
+#include <string_view>
+
 #include "geo/tile.h"
 #include "lmdb/lmdb.hpp"
 
@@ -35,9 +39,47 @@ struct render_ctx {
   bool tb_aggregate_lines_ = false;
   bool tb_aggregate_polygons_ = false;
   bool tb_drop_subpixel_polygons_ = true;
+  bool tb_drop_subpixel_lines_ = true;
   bool tb_print_stats_ = false;
+
+  // metadata key (integer or numeric value) ranking the features for point
+  // thinning and the byte budget, features without it have priority zero
+  std::string tb_priority_key_ = "priority";
+
+  // point thinning: layer name -> grid cell size (screen pixels), per cell
+  // only the point with the highest priority is kept
+  std::map<std::string, uint32_t> tb_point_grid_;
+
+  // byte budget per tile (0: unlimited): features with the lowest
+  // priority are dropped until the tile fits
+  size_t tb_max_tile_bytes_ = 0;
 };
 
+// spec: comma separated list of layer:cell_size (e.g. "poi:16,label:32")
+inline void set_point_grid(render_ctx& ctx, std::string const& spec) {
+  ctx.tb_point_grid_.clear();
+
+  std::string_view rest{spec};
+  while (!rest.empty()) {
+    auto const comma = rest.find(',');
+    auto const entry = rest.substr(0, comma);
+    rest = comma == std::string_view::npos ? std::string_view{}
+                                           : rest.substr(comma + 1);
+    if (entry.empty()) {
+      continue;
+    }
+
+    auto const colon = entry.find(':');
+    utl::verify(colon != std::string_view::npos && colon != 0 &&
+                    colon + 1 < entry.size(),
+                "point grid: invalid entry '{}'", entry);
+    auto const cell_size = std::stoul(std::string{entry.substr(colon + 1)});
+    utl::verify(cell_size > 0, "point grid: cell size must be positive");
+    ctx.tb_point_grid_[std::string{entry.substr(0, colon)}] =
+        static_cast<uint32_t>(cell_size);
+  }
+}
+
 inline render_ctx make_render_ctx(tile_db_handle& db_handle) {
   auto txn = db_handle.make_txn();
   auto meta_dbi = db_handle.meta_dbi(txn);
@@ -45,8 +87,11 @@ inline render_ctx make_render_ctx(tile_db_handle& db_handle) {
   auto opt_max_prep = txn.get(meta_dbi, kMetaKeyMaxPreparedZoomLevel);
   auto opt_seaside = txn.get(meta_dbi, kMetaKeyFullySeasideTree);
 
+  auto seaside_tiles = opt_seaside ? bq_tree{*opt_seaside} : bq_tree{};
+  seaside_tiles.materialize_bitmap();
+
   return {opt_max_prep ? std::stoi(std::string{*opt_max_prep}) : -1,
-          opt_seaside ? bq_tree{*opt_seaside} : bq_tree{},
+          std::move(seaside_tiles),
           get_layer_names(db_handle, txn),
           make_shared_metadata_decoder(db_handle, txn)};
 }
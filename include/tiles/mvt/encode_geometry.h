@@ -9,7 +9,11 @@
 
 namespace tiles {
 
-void encode_geometry(protozero::pbf_builder<tags::mvt::Feature>&,
-                     fixed_geometry const&, tile_spec const&);
+// input: shifted to tile coordinates (see shift.h)
+// repeated points are skipped, lines shorter than min_line_length and
+// degenerate rings are dropped. returns false if nothing was encoded.
+bool encode_geometry(protozero::pbf_builder<tags::mvt::Feature>&,
+                     fixed_geometry const&, tile_spec const&,
+                     fixed_coord_t min_line_length = 0);
 
 }  // namespace tiles
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "osmium/handler.hpp"
+#include "osmium/memory/buffer.hpp"
+#include "osmium/osm/node.hpp"
+#include "osmium/osm/types.hpp"
+
+#include "tiles/fixed/fixed_geometry.h"
+#include "tiles/osm/hybrid_node_idx.h"
+
+namespace tiles {
+
+// flat array directly indexed by (absolute) node id.
+// each slot holds the offset coordinates (see hybrid_node_idx) as 2x uint32
+// biased by one: an all zero slot marks a missing node.
+// file size is 8 byte * max node id (not sparse: osmium fills each grown
+// region with the empty value, every page is written)
+struct dense_node_idx {
+  dense_node_idx();
+  explicit dense_node_idx(int dat_fd);
+  ~dense_node_idx();
+
+  dense_node_idx(dense_node_idx const&) = delete;
+  dense_node_idx(dense_node_idx&&) noexcept = default;
+  dense_node_idx& operator=(dense_node_idx const&) = delete;
+  dense_node_idx& operator=(dense_node_idx&&) noexcept = default;
+
+  struct impl;
+  std::unique_ptr<impl> impl_;
+};
+
+std::optional<fixed_xy> get_coords(dense_node_idx const&,
+                                   osmium::object_id_type const&);
+
+void get_coords(
+    dense_node_idx const&,
+    std::vector<std::pair<osmium::object_id_type, osmium::Location*>>&);
+
+void update_locations(dense_node_idx const&, osmium::memory::Buffer&);
+
+struct dense_node_idx_builder : public osmium::handler::Handler {
+  explicit dense_node_idx_builder(dense_node_idx&);
+  ~dense_node_idx_builder();
+
+  dense_node_idx_builder(dense_node_idx_builder const&) = delete;
+  dense_node_idx_builder(dense_node_idx_builder&&) noexcept = default;
+  dense_node_idx_builder& operator=(dense_node_idx_builder const&) = delete;
+  dense_node_idx_builder& operator=(dense_node_idx_builder&&) noexcept =
+      default;
+
+  void node(osmium::Node const& n) const {
+    push(n.id(), hybrid_node_idx::to_fixed(n.location()));
+  }
+
+  void push(osmium::object_id_type, fixed_xy const&) const;
+  void finish() const;
+
+  void dump_stats() const;
+
+  struct impl;
+  std::unique_ptr<impl> impl_;
+};
+
+}  // namespace tiles
@@ -10,6 +10,7 @@ namespace tiles {
 struct feature_inserter_mt;
 struct layer_names_builder;
 struct shared_metadata_builder;
+struct local_metadata_counter;
 struct script_runner;
 
 void check_profile(std::string const& osm_profile);
@@ -34,7 +35,7 @@ private:
 
   feature_inserter_mt& inserter_;
   layer_names_builder& layer_names_builder_;
-  shared_metadata_builder& shared_metadata_builder_;
+  std::unique_ptr<local_metadata_counter> metadata_counter_;
 };
 
 }  // namespace tiles
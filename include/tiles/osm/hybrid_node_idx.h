@@ -18,6 +18,11 @@ struct hybrid_node_idx : public osmium::handler::Handler {
   static constexpr auto x_offset = 180 * osmium::detail::coordinate_precision;
   static constexpr auto y_offset = 90 * osmium::detail::coordinate_precision;
 
+  static fixed_xy to_fixed(osmium::Location const& l) {
+    return {static_cast<fixed_coord_t>(l.x()) + x_offset,
+            static_cast<fixed_coord_t>(l.y()) + y_offset};
+  }
+
   hybrid_node_idx();
   hybrid_node_idx(int idx_fd, int dat_fd);
   ~hybrid_node_idx();
@@ -43,6 +48,28 @@ void get_coords(
 
 void update_locations(hybrid_node_idx const&, osmium::memory::Buffer&);
 
+// independently encoded part of the index (e.g. the nodes of one pbf block)
+// chunks must be appended to the builder in (node id) order
+struct hybrid_node_idx_chunk : public osmium::handler::Handler {
+  hybrid_node_idx_chunk();
+  ~hybrid_node_idx_chunk();
+
+  hybrid_node_idx_chunk(hybrid_node_idx_chunk const&) = delete;
+  hybrid_node_idx_chunk(hybrid_node_idx_chunk&&) noexcept;
+  hybrid_node_idx_chunk& operator=(hybrid_node_idx_chunk const&) = delete;
+  hybrid_node_idx_chunk& operator=(hybrid_node_idx_chunk&&) noexcept;
+
+  void node(osmium::Node const& n) const {
+    push(n.id(), hybrid_node_idx::to_fixed(n.location()));
+  }
+
+  void push(osmium::object_id_type, fixed_xy const&) const;
+  void finish() const;
+
+  struct impl;
+  std::unique_ptr<impl> impl_;
+};
+
 struct hybrid_node_idx_builder : public osmium::handler::Handler {
   explicit hybrid_node_idx_builder(hybrid_node_idx&);
   hybrid_node_idx_builder(int idx_fd, int dat_fd);
@@ -55,13 +82,11 @@ struct hybrid_node_idx_builder : public osmium::handler::Handler {
       default;
 
   void node(osmium::Node const& n) const {
-    push(n.id(), {static_cast<fixed_coord_t>(n.location().x()) +
-                      hybrid_node_idx::x_offset,
-                  static_cast<fixed_coord_t>(n.location().y()) +
-                      hybrid_node_idx::y_offset});
+    push(n.id(), hybrid_node_idx::to_fixed(n.location()));
   }
 
   void push(osmium::object_id_type, fixed_xy const&) const;
+  void append(hybrid_node_idx_chunk const&) const;
   void finish() const;
 
   void dump_stats() const;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 namespace tiles {
@@ -7,8 +8,13 @@ namespace tiles {
 struct tile_db_handle;
 struct feature_inserter_mt;
 
+// hybrid: compressed spans of consecutive node ids (small, sorted lookups)
+// dense: flat array indexed by node id (large, constant time lookups)
+enum class node_idx_type { hybrid, dense };
+
 void load_osm(tile_db_handle&, feature_inserter_mt&,
               std::string const& osm_fname, std::string const& osm_profile,
-              std::string const& tmp_dname);
+              std::string const& tmp_dname, node_idx_type,
+              size_t metadata_dict_size);
 
 }  // namespace tiles
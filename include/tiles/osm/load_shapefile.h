@@ -1,11 +1,15 @@
 #pragma once
 
+#include <functional>
+#include <string>
 #include <vector>
 
 #include "tiles/fixed/fixed_geometry.h"
 
 namespace tiles {
 
+// polygons of a zipped .shp (optional .shx), parsed in parallel
+// consumer: called in record order, one call at a time
 void load_shapefile(std::string const& fname,
                     std::function<void(fixed_simple_polygon)> const& consumer);
 
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+
+#include "osmium/handler.hpp"
+#include "osmium/memory/buffer.hpp"
+
+namespace osmium {
+
+class Relation;
+class Way;
+
+}  // namespace osmium
+
+namespace tiles {
+
+// thread-safe replacement for osmium::area::MultipolygonManager
+// pass 1 (single thread):
+//   relation() collects multipolygon / boundary relations,
+//   prepare_for_lookup() builds a sorted way -> relation index
+// pass 2 (any thread, any order):
+//   way() assembles closed ways which are not relation members directly and
+//   stashes member ways per relation. the relation is assembled by the thread
+//   delivering its last missing member way. areas are appended to out.
+struct mp_manager_mt : public osmium::handler::Handler {
+  mp_manager_mt();
+  ~mp_manager_mt();
+
+  mp_manager_mt(mp_manager_mt const&) = delete;
+  mp_manager_mt(mp_manager_mt&&) = delete;
+  mp_manager_mt& operator=(mp_manager_mt const&) = delete;
+  mp_manager_mt& operator=(mp_manager_mt&&) = delete;
+
+  void relation(osmium::Relation const&);
+  void prepare_for_lookup();
+
+  void way(osmium::Way const&, osmium::memory::Buffer& out);
+
+  void dump_stats() const;
+
+  struct impl;
+  std::unique_ptr<impl> impl_;
+};
+
+}  // namespace tiles
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
 #include <vector>
 
 #include "osmium/osm.hpp"
@@ -24,19 +27,32 @@ struct pending_feature {
 
   int64_t get_id() const { return obj_.id(); }
 
-  bool has_tag(std::string const& key, std::string const& value) {
-    return value == obj_.get_value_by_key(key.c_str(), "");
+  // linear scan over the tag list: neither key nor value are copied
+  char const* get_value(std::string_view const key) const {
+    for (auto const& tag : obj_.tags()) {
+      if (key == tag.key()) {
+        return tag.value();
+      }
+    }
+    return nullptr;
+  }
+
+  bool has_tag(std::string_view const key,
+               std::string_view const value) const {
+    auto const* actual_value = get_value(key);
+    return value == (actual_value == nullptr ? "" : actual_value);
   }
 
-  bool has_any_tag(std::string const& key, sol::variadic_args va) {
+  bool has_any_tag(std::string_view const key, sol::variadic_args va) const {
+    auto const* actual_value = get_value(key);
     if (std::distance(va.begin(), va.end()) == 0) {
-      return obj_.get_value_by_key(key.c_str()) != nullptr;
+      return actual_value != nullptr;
+    } else if (actual_value == nullptr) {
+      return false;
     } else {
-      auto const* const actual_value = obj_.get_value_by_key(key.c_str(), "");
-      return std::any_of(std::begin(va), std::end(va),
-                         [&actual_value](std::string const& value) {
-                           return actual_value == value;
-                         });
+      return std::any_of(std::begin(va), std::end(va), [&](auto const& value) {
+        return value.template as<std::string_view>() == actual_value;
+      });
     }
   }
 
@@ -52,7 +68,12 @@ struct pending_feature {
   // pairwise growing area, lower zoom_level:
   // >> max_area_1, zoom_level_1, max_area_2, zoom_level_2, ...
   void set_approved_min_by_area(sol::variadic_args va) {
-    utl::verify(std::distance(va.begin(), va.end()) % 2 == 0,
+    set_approved_min_by_area(va.begin(), va.end());
+  }
+
+  template <typename It>
+  void set_approved_min_by_area(It const begin, It const end) {
+    utl::verify(std::distance(begin, end) % 2 == 0,
                 "set_approved_by_area input size not even!");
 
     if (!geometry_) {
@@ -60,10 +81,10 @@ struct pending_feature {
     }
     auto const area = tiles::area(*geometry_);
 
-    for (auto it = va.begin(); it != va.end(); it += 2) {
+    for (auto it = begin; it != end; it += 2) {
       auto const limit = static_cast<fixed_coord_t>(*(it + 1));
       if (limit == -1 || area < limit) {
-        set_approved_min(*it);
+        set_approved_min(static_cast<uint32_t>(*it));
         break;
       }
     }
@@ -74,54 +95,55 @@ struct pending_feature {
     zoom_levels_ = {min, max};
   }
 
-  void set_target_layer(std::string target_layer) {
-    target_layer_ = std::move(target_layer);
+  void set_target_layer(std::string_view const target_layer) {
+    target_layer_ = target_layer;
   }
 
-  void add_bool(std::string tag, bool const v) {
-    metadata_.emplace_back(std::move(tag), encode_bool(v));
+  void add_bool(std::string_view const tag, bool const v) {
+    metadata_.emplace_back(std::string{tag}, encode_bool(v));
   }
 
-  void add_string(std::string tag, std::string const& v) {
-    metadata_.emplace_back(std::move(tag), encode_string(v));
+  void add_string(std::string_view const tag, std::string_view const v) {
+    metadata_.emplace_back(std::string{tag}, encode_string(v));
   }
 
-  void add_numeric(std::string tag, double const v) {
-    metadata_.emplace_back(std::move(tag), encode_numeric(v));
+  void add_numeric(std::string_view const tag, double const v) {
+    metadata_.emplace_back(std::string{tag}, encode_numeric(v));
   }
 
-  void add_integer(std::string tag, int64_t const v) {
-    metadata_.emplace_back(std::move(tag), encode_integer(v));
+  void add_integer(std::string_view const tag, int64_t const v) {
+    metadata_.emplace_back(std::string{tag}, encode_integer(v));
   }
 
-  void add_tag_as_bool(std::string tag) {
-    if (auto const* v = obj_.get_value_by_key(tag.c_str()); v != nullptr) {
-      add_bool(std::move(tag), std::strcmp("true", v) != 0);
+  void add_tag_as_bool(std::string_view const tag) {
+    if (auto const* v = get_value(tag); v != nullptr) {
+      add_bool(tag, std::strcmp("true", v) != 0);
     }
   }
 
-  void add_tag_as_string(std::string tag) {
-    if (auto const* v = obj_.get_value_by_key(tag.c_str()); v != nullptr) {
-      add_string(std::move(tag), std::string(v));
+  void add_tag_as_string(std::string_view const tag) {
+    if (auto const* v = get_value(tag); v != nullptr) {
+      add_string(tag, v);
     }
   }
 
-  void add_tag_as_numeric(std::string tag) {
-    if (auto const* v = obj_.get_value_by_key(tag.c_str()); v != nullptr) {
-      try {
-        // from_chars for double is still not supported in 2020 :(
-        add_numeric(std::move(tag), std::stod(std::string(v)));
-      } catch (...) {
+  void add_tag_as_numeric(std::string_view const tag) {
+    if (auto const* v = get_value(tag); v != nullptr) {
+      // from_chars for double is still not supported in 2020 :(
+      char* end = nullptr;
+      auto const parsed = std::strtod(v, &end);
+      if (end != v) {
+        add_numeric(tag, parsed);
       }
     }
   }
 
-  void add_tag_as_integer(std::string tag) {
-    if (auto const* v = obj_.get_value_by_key(tag.c_str()); v != nullptr) {
+  void add_tag_as_integer(std::string_view const tag) {
+    if (auto const* v = get_value(tag); v != nullptr) {
       int64_t parsed{0};
       if (auto [p, ec] = std::from_chars(v, v + std::strlen(v), parsed);
           ec == std::errc()) {
-        add_numeric(std::move(tag), parsed);
+        add_numeric(tag, parsed);
       }
     }
   }
@@ -144,4 +166,28 @@ struct pending_feature {
   std::optional<fixed_geometry> geometry_;
 };
 
+// pending_feature as seen by the process_* functions of the profile
+inline void register_pending_feature(sol::state& lua) {
+  lua.new_usertype<pending_feature>(  //
+      "pending_feature",  //
+      "get_id", &pending_feature::get_id,  //
+      "has_tag", &pending_feature::has_tag,  //
+      "has_any_tag", &pending_feature::has_any_tag,  //
+      "has_any_tag", &pending_feature::has_any_tag,  //
+      "set_approved_min", &pending_feature::set_approved_min,  //
+      "set_approved_min_by_area",
+      sol::resolve<void(sol::variadic_args)>(
+          &pending_feature::set_approved_min_by_area),  //
+      "set_approved_full", &pending_feature::set_approved_full,  //
+      "set_target_layer", &pending_feature::set_target_layer,  //
+      "add_bool", &pending_feature::add_bool,  //
+      "add_string", &pending_feature::add_string,  //
+      "add_numeric", &pending_feature::add_numeric,  //
+      "add_integer", &pending_feature::add_integer,  //
+      "add_tag_as_bool", &pending_feature::add_tag_as_bool,  //
+      "add_tag_as_string", &pending_feature::add_tag_as_string,  //
+      "add_tag_as_numeric", &pending_feature::add_tag_as_numeric,  //
+      "add_tag_as_integer", &pending_feature::add_tag_as_integer);
+}
+
 }  // namespace tiles
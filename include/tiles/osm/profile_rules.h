@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cinttypes>
+#include <limits>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "sol/sol.hpp"
+
+namespace osmium {
+class OSMObject;
+}  // namespace osmium
+
+namespace tiles {
+
+struct pending_feature;
+
+// declarative replacement for one branch of a process_* function
+// (see profile/profile.lua for the lua side of the declaration)
+struct profile_rule {
+  bool use_lua_{false};  // escape hatch: call process_* instead
+
+  std::string target_layer_;  // empty: matched objects are dropped
+
+  std::optional<uint32_t> approved_min_;
+  std::vector<double> approved_min_by_area_;
+
+  std::vector<std::string> string_tags_;
+  std::vector<std::string> integer_tags_;
+  std::vector<std::string> numeric_tags_;
+  std::vector<std::string> bool_tags_;
+  std::vector<std::pair<std::string, std::string>> strings_;
+};
+
+// ordered rules for one object type compiled into a lookup table:
+// interned key -> (any value | interned value) -> lowest matching rule index.
+// the first (lowest index) rule matched by any tag of the object wins.
+struct profile_rules {
+  static constexpr auto kNoRule = std::numeric_limits<uint32_t>::max();
+
+  void add_rule(profile_rule rule,
+                std::vector<std::pair<std::string, std::string>> const& match,
+                std::vector<std::string> const& match_any);
+
+  // nullptr: no rule matches, object can be dropped without calling lua
+  profile_rule const* match(osmium::OSMObject const&) const;
+
+  struct key_entry {
+    uint32_t any_{kNoRule};
+    std::unordered_map<std::string_view, uint32_t> values_;
+  };
+
+  std::vector<profile_rule> rules_;
+  std::unordered_map<std::string_view, key_entry> keys_;
+  std::set<std::string> strings_;  // backing storage of all string_views
+};
+
+// rules = { node = { rule... }, way = { ... }, area = { ... } }
+std::optional<profile_rules> read_profile_rules(sol::table const& decl,
+                                                char const* type);
+
+void apply_profile_rule(profile_rule const&, pending_feature&);
+
+}  // namespace tiles
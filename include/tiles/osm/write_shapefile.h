@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "geo/latlng.h"
+
+namespace tiles {
+
+// rings of one polygon: first ring is the outer ring (clockwise),
+// following rings are holes (counter-clockwise), all rings closed
+using shapefile_polygon = std::vector<std::vector<geo::latlng>>;
+
+// writes a zip with .shp and .shx (format as land-polygons-*-4326.zip)
+void write_shapefile(std::string const& fname,
+                     std::vector<shapefile_polygon> const&,
+                     bool with_shx = true);
+
+}  // namespace tiles
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "geo/latlng.h"
+#include "geo/tile.h"
+
+namespace tiles {
+
+struct workload {
+  std::vector<geo::tile> tiles_;
+
+  // recorded arrival time of each tile relative to the first one
+  // (non-decreasing), empty if not every tile line carries a timestamp
+  std::vector<std::chrono::microseconds> arrivals_;
+};
+
+// one tile per line: the first "z/x/y" (e.g. "14/8580/5551" or an access
+// log line with "GET /14/8580/5551.mvt"), other lines are skipped.
+// timestamps are taken from a leading seconds column ("12.5 14/8580/5551",
+// absolute or relative) or from the access log time ("[17/Oct/2026:10:00:00
+// +0200]", optionally with fractional seconds)
+workload read_workload(std::string const& fname);
+void write_workload(std::string const& fname, workload const&);
+
+struct zipf_workload_settings {
+  std::vector<geo::latlng> centers_;  // picked uniformly
+  uint32_t min_z_{10}, max_z_{16};  // picked uniformly
+  uint32_t radius_{16};  // max. distance in tiles from the center tile
+  double exponent_{1.};  // popularity of the k-th closest tile: 1 / k^s
+  size_t count_{10'000};
+  unsigned seed_{31337};
+};
+
+std::vector<geo::tile> make_zipf_workload(zipf_workload_settings const&);
+
+// nearest rank percentile (p in [0, 100]) of the measured latencies of a
+// workload run, latencies must be sorted and non-empty
+template <typename Duration>
+Duration percentile(std::vector<Duration> const& latencies, double const p) {
+  auto const rank = static_cast<size_t>(
+      std::ceil(p / 100. * static_cast<double>(latencies.size())));
+  return latencies.at(std::max(rank, size_t{1}) - 1);
+}
+
+}  // namespace tiles
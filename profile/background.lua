@@ -1,3 +1,12 @@
+-- tag keys inspected by the process_* functions below:
+-- objects without any of them are dropped before calling into lua
+prefilter_keys = {
+  node = { "place" },
+  way = { "highway", "railway", "waterway" },
+  area = { "building", "landuse", "leisure", "amenity", "natural", "waterway",
+           "highway" }
+}
+
 function process_node(node)
   if node:has_any_tag("place") then
     if node:has_tag("place", "country") then
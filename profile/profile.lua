@@ -1,59 +1,109 @@
-function process_node(node)
-  if node:has_any_tag("place") then
-    if node:has_tag("place", "city") then
-      node:set_approved_min(5)
-    elseif node:has_tag("place", "town") or
-           node:has_tag("place", "borough") then
-      node:set_approved_min(9)
-    elseif node:has_tag("place", "suburb") or
-           node:has_tag("place", "village") then
-      node:set_approved_min(11)
-    end
-
-    node:set_target_layer("cities")
-    node:add_tag_as_string("place")
-    node:add_tag_as_string("name")
-    node:add_tag_as_integer("population")
-
-  end
-end
-
+-- rules are evaluated natively (without calling into lua):
+-- the first rule (in order) matching any tag of an object wins.
+--   match = { key = true | "value" | { "value", ... }, ... }  (any of them)
+--   layer = "..."  (rules without layer drop matched objects)
+--   min = z | full = true | min_by_area = { z1, limit1, z2, limit2, ... }
+--   tags / integer_tags / numeric_tags / bool_tags = { "key", ... }
+--   strings = { key = "value", ... }
+--   lua = true  (delegate matched objects to the process_* function)
+-- objects without matching rule are dropped.
+rules = {
+  node = {
+    { match = { place = "city" }, layer = "cities", min = 5,
+      tags = { "place", "name" }, integer_tags = { "population" } },
+    { match = { place = { "town", "borough" } }, layer = "cities", min = 9,
+      tags = { "place", "name" }, integer_tags = { "population" } },
+    { match = { place = { "suburb", "village" } }, layer = "cities", min = 11,
+      tags = { "place", "name" }, integer_tags = { "population" } },
+
+    -- priority: ranks points for --point_grid / --max_tile_bytes
+    { match = { amenity = { "restaurant", "cafe", "fast_food", "pub", "bar",
+                            "pharmacy", "hospital", "bank", "post_office",
+                            "school", "university", "library", "cinema",
+                            "theatre", "police", "fuel" } },
+      layer = "poi", min = 14, tags = { "amenity", "name" },
+      integer_tags = { "priority" } },
+  },
+
+  way = {
+    { match = { highway = { "motorway", "trunk" } },
+      layer = "road", min = 5, tags = { "highway", "name", "ref" } },
+    { match = { highway = { "motorway_link", "trunk_link", "primary",
+                            "secondary", "tertiary", "aeroway" } },
+      layer = "road", min = 9, tags = { "highway", "name", "ref" } },
+    { match = { highway = { "residential", "living_street", "primary_link",
+                            "secondary_link", "tertiary_link", "unclassified",
+                            "service", "footway", "track", "steps",
+                            "cycleway", "path" } },
+      layer = "road", min = 12, tags = { "highway", "name" } },
+    -- any other highway is dropped, even with railway/waterway tags
+    -- (like the former elseif chain: highway is inspected first)
+    { match = { highway = true } },
+
+    { match = { railway = { "rail", "subway", "tram" } }, lua = true },
+
+    { match = { waterway = { "river", "canal" } }, layer = "waterway", min = 8 },
+    { match = { waterway = "stream" }, layer = "waterway", min = 13 },
+    { match = { waterway = { "ditch", "drain" } }, layer = "waterway", min = 15 },
+  },
+
+  area = {
+    { match = { building = true },
+      layer = "building", min_by_area = { 14, 1e8, 12, 1e10, 10, -1 } },
+
+    { match = { landuse = { "residential", "retail", "industrial",
+                            "commercial" } },
+      layer = "landuse", tags = { "landuse" },
+      min_by_area = { 14, 1e8, 10, 1e10, 8, -1 } },
+    { match = { landuse = { "quarry", "farmyard", "railway" } },
+      layer = "landuse", strings = { landuse = "industrial" },
+      min_by_area = { 14, 1e8, 10, 1e10, 8, -1 } },
+    { match = { leisure = "sports_centre",
+                amenity = { "hospital", "police", "fire_station",
+                            "kindergarten", "school", "place_of_worship",
+                            "university" } },
+      layer = "landuse", strings = { landuse = "complex" },
+      min_by_area = { 14, 1e8, 10, 1e10, 8, -1 } },
+    { match = { landuse = "forest", natural = { "wood", "oarchard", "scrub" } },
+      layer = "landuse", strings = { landuse = "nature_heavy" },
+      min_by_area = { 14, 1e8, 10, 1e10, 8, -1 } },
+    { match = { landuse = { "farmland", "vineyard", "plant_nursery", "meadow",
+                            "grass" },
+                natural = "grassland" },
+      layer = "landuse", strings = { landuse = "nature_light" },
+      min_by_area = { 14, 1e8, 10, 1e10, 8, -1 } },
+    { match = { leisure = { "park", "garden", "playground", "stadium" },
+                landuse = { "recreation_ground", "greenhouse_horticulture",
+                            "allotments" } },
+      layer = "landuse", strings = { landuse = "park" },
+      min_by_area = { 14, 1e8, 10, 1e10, 8, -1 } },
+    { match = { landuse = "cemetery" },
+      layer = "landuse", strings = { landuse = "cemetery" },
+      min_by_area = { 14, 1e8, 10, 1e10, 8, -1 } },
+
+    { match = { landuse = { "brownfield", "greenfield", "construction" } },
+      layer = "construction", min_by_area = { 14, 1e8, 10, 1e10, 8, -1 } },
+
+    { match = { natural = "water",
+                waterway = { "riverbank", "basin", "pond" },
+                leisure = "swimming_pool" },
+      layer = "water", min_by_area = { 12, 1e6, 10, 1e4, 0, -1 } },
+
+    { match = { natural = "beach" },
+      layer = "landuse", strings = { landuse = "beach" },
+      min_by_area = { 14, 1e8, 10, 1e10, 8, -1 } },
+
+    { match = { highway = { "pedestrian", "service" }, amenity = "parking" },
+      layer = "pedestrian", min_by_area = { 12, 1e8, 10, 1e10, 8, -1 } },
+
+    { match = { leisure = "pitch" },
+      layer = "sport", min_by_area = { 14, 1e8, 12, 1e10, 8, -1 } },
+  }
+}
+
+-- only called for ways matched by a rule with lua = true
 function process_way(way)
-  if way:has_any_tag("highway") then
-    way:set_target_layer("road")
-    way:add_tag_as_string("highway")
-    way:add_tag_as_string("name")
-
-    if way:has_tag("highway", "motorway") or
-       way:has_tag("highway", "trunk") then
-      way:set_approved_min(5)
-      way:add_tag_as_string("ref")
-
-    elseif way:has_tag("highway", "motorway_link") or
-           way:has_tag("highway", "trunk_link") or
-           way:has_tag("highway", "primary") or
-           way:has_tag("highway", "secondary") or
-           way:has_tag("highway", "tertiary") or
-           way:has_tag("highway", "aeroway") then
-      way:set_approved_min(9)
-      way:add_tag_as_string("ref")
-
-    elseif way:has_tag("highway", "residential") or
-           way:has_tag("highway", "living_street") or
-           way:has_tag("highway", "primary_link") or
-           way:has_tag("highway", "secondary_link") or
-           way:has_tag("highway", "tertiary_link") or
-           way:has_tag("highway", "unclassified") or
-           way:has_tag("highway", "service") or
-           way:has_tag("highway", "footway") or
-           way:has_tag("highway", "track") or
-           way:has_tag("highway", "steps") or
-           way:has_tag("highway", "cycleway") or
-           way:has_tag("highway", "path") then
-      way:set_approved_min(12)
-    end
-
-  elseif way:has_any_tag("railway", "rail", "subway", "tram") then
+  if way:has_any_tag("railway", "rail", "subway", "tram") then
     if way:has_tag("railway", "disused") or
        way:has_tag("railway", "abandoned") then
       way:set_target_layer("rail")
@@ -83,148 +133,5 @@ function process_way(way)
       way:set_approved_min(5)
       way:add_string("rail", "primary")
     end
-
-  elseif way:has_any_tag("waterway") then
-    way:set_target_layer("waterway")
-
-    if way:has_tag("waterway", "river") or
-       way:has_tag("waterway", "canal") then
-       way:set_approved_min(8)
-    elseif way:has_tag("waterway", "stream") then
-      way:set_approved_min(13)
-    elseif way:has_tag("waterway", "ditch") or
-           way:has_tag("waterway", "drain") then
-      way:set_approved_min(15)
-    end
-  -- elseif way:has_tag("boundary", "administrative") and
-  --        not way:has_tag("maritime", "yes") then
-  --   if way:has_tag("admin_level", "2") then
-  --     way:set_target_layer("border")
-  --     way:set_approved_full()
-  --     way:add_tag_as_integer("admin_level")
-  --   elseif way:has_tag("admin_level", "4") then
-  --     way:set_target_layer("border")
-  --     way:set_approved_full()
-  --     way:add_tag_as_integer("admin_level")
-  --   end
-  end
-end
-
-function process_area(area)
-  if area:has_any_tag("building") then
-    area:set_target_layer("building")
-    area:set_approved_min_by_area(14, 1e8,
-                                  12, 1e10,
-                                  10, -1)
-
-  elseif area:has_any_tag("landuse", "residential", "retail", "industrial", "commercial") then
-    area:set_target_layer("landuse")
-    area:add_tag_as_string("landuse")
-    area:set_approved_min_by_area(14, 1e8,
-                                  10, 1e10,
-                                   8, -1)
-
-  elseif area:has_any_tag("landuse", "quarry", "farmyard", "railway") then
-    area:set_target_layer("landuse")
-    area:add_string("landuse", "industrial")
-    area:set_approved_min_by_area(14, 1e8,
-                                  10, 1e10,
-                                   8, -1)
-
-  elseif area:has_tag("leisure", "sports_centre") or
-         area:has_tag("amenity", "hospital") or
-         area:has_tag("amenity", "police") or
-         area:has_tag("amenity", "fire_station") or
-         area:has_tag("amenity", "kindergarten") or
-         area:has_tag("amenity", "school") or
-         area:has_tag("amenity", "place_of_worship") or
-         area:has_tag("amenity", "university") then
-    area:set_target_layer("landuse")
-    area:add_string("landuse", "complex")
-    area:set_approved_min_by_area(14, 1e8,
-                                  10, 1e10,
-                                   8, -1)
-
-  elseif area:has_tag("landuse", "forest") or
-         area:has_tag("natural", "wood") or
-         area:has_tag("natural", "oarchard") or
-         area:has_tag("natural", "scrub") then
-    area:set_target_layer("landuse")
-    area:add_string("landuse", "nature_heavy")
-    area:set_approved_min_by_area(14, 1e8,
-                                  10, 1e10,
-                                   8, -1)
-
-  elseif area:has_tag("landuse", "farmland") or
-         area:has_tag("landuse", "vineyard") or
-         area:has_tag("landuse", "plant_nursery") or
-         area:has_tag("landuse", "meadow") or
-         area:has_tag("natural", "grassland") or
-         area:has_tag("landuse", "grass") then
-    area:set_target_layer("landuse")
-    area:add_string("landuse", "nature_light")
-    area:set_approved_min_by_area(14, 1e8,
-                                  10, 1e10,
-                                   8, -1)
-
-  elseif area:has_tag("leisure", "park") or
-         area:has_tag("leisure", "garden") or
-         area:has_tag("leisure", "playground") or
-         area:has_tag("leisure", "stadium") or
-         area:has_tag("landuse", "recreation_ground") or
-         area:has_tag("landuse", "greenhouse_horticulture") or
-         area:has_tag("landuse", "allotments") then
-    area:set_target_layer("landuse")
-    area:add_string("landuse", "park")
-    area:set_approved_min_by_area(14, 1e8,
-                                  10, 1e10,
-                                   8, -1)
-
-  elseif area:has_tag("landuse", "cemetery") then
-    area:set_target_layer("landuse")
-    area:add_string("landuse", "cemetery")
-    area:set_approved_min_by_area(14, 1e8,
-                                  10, 1e10,
-                                   8, -1)
-
-
-  elseif area:has_tag("landuse", "brownfield") or
-         area:has_tag("landuse", "greenfield") or
-         area:has_tag("landuse", "construction") then
-    area:set_target_layer("construction")
-    area:set_approved_min_by_area(14, 1e8,
-                                  10, 1e10,
-                                   8, -1)
-
-  elseif area:has_tag("natural", "water") or
-         area:has_tag("waterway", "riverbank") or
-         area:has_tag("waterway", "basin") or
-         area:has_tag("waterway", "pond") or
-         area:has_tag("leisure", "swimming_pool") then
-    area:set_target_layer("water")
-    area:set_approved_min_by_area(12, 1e6,
-                                  10, 1e4,
-                                   0, -1)
-
-  elseif area:has_tag("natural", "beach") then
-    area:set_target_layer("landuse")
-    area:add_string("landuse", "beach")
-    area:set_approved_min_by_area(14, 1e8,
-                                  10, 1e10,
-                                   8, -1)
-
-  elseif area:has_tag("highway", "pedestrian") or
-         area:has_tag("highway", "service") or
-         area:has_tag("amenity", "parking") then
-    area:set_target_layer("pedestrian")
-    area:set_approved_min_by_area(12, 1e8,
-                                  10, 1e10,
-                                  8, -1)
-
-  elseif area:has_tag("leisure", "pitch") then
-    area:set_target_layer("sport")
-    area:set_approved_min_by_area(14, 1e8,
-                                  12, 1e10,
-                                  8, -1)
   end
 end
@@ -1,7 +1,17 @@
 #include <cstdlib>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #include "conf/configuration.h"
 #include "conf/options_parser.h"
@@ -12,6 +22,7 @@
 #include "tiles/db/tile_database.h"
 #include "tiles/get_tile.h"
 #include "tiles/perf_counter.h"
+#include "tiles/workload.h"
 
 namespace tiles {
 
@@ -22,13 +33,232 @@ struct benchmark_settings : public conf::configuration {
           "xyz coords of a single tile, z for all tiles on a certain zoom "
           "level, if not present random smaple");
     param(compress_, "compress", "compress the tiles");
+    param(threads_, "threads",
+          "throughput mode: render the workload (random sample or zoom "
+          "level) with 1, 2, 4, .. up to N threads (0: sequential)");
+    param(workload_, "workload",
+          "replay a workload file (one z/x/y per line, e.g. from access "
+          "logs) in its original order");
+    param(replay_, "replay",
+          "open loop replay: issue each tile of the workload at its recorded "
+          "arrival time (needs timestamps) on N threads (default: #cores)");
+    param(replay_speedup_, "replay_speedup",
+          "replay: divide the recorded arrival times by this factor");
+    param(zipf_centers_, "zipf_centers",
+          "generate a zipf distributed workload around these centers "
+          "(\"lat,lng\")");
+    param(zipf_zoom_, "zipf_zoom", "min and max zoom level of zipf workload");
+    param(zipf_count_, "zipf_count", "number of tiles in the zipf workload");
+    param(zipf_exponent_, "zipf_exponent", "exponent of the zipf workload");
+    param(write_workload_, "write_workload",
+          "write the workload to this file (to replay it later)");
   }
 
   std::string db_fname_{"tiles.mdb"};
   std::vector<uint32_t> tile_;
   bool compress_{true};
+  uint32_t threads_{0};
+
+  std::string workload_;
+  bool replay_{false};
+  double replay_speedup_{1.};
+  std::vector<std::string> zipf_centers_;
+  std::vector<uint32_t> zipf_zoom_{10, 16};
+  size_t zipf_count_{10'000};
+  double zipf_exponent_{1.};
+  std::string write_workload_;
 };
 
+std::optional<workload> load_workload(benchmark_settings const& opt) {
+  std::optional<workload> workload;
+  if (!opt.workload_.empty()) {
+    workload = read_workload(opt.workload_);
+  } else if (!opt.zipf_centers_.empty()) {
+    utl::verify(opt.zipf_zoom_.size() == 2, "zipf_zoom: need min and max");
+
+    zipf_workload_settings settings;
+    for (auto const& center : opt.zipf_centers_) {
+      auto const comma = center.find(',');
+      utl::verify(comma != std::string::npos, "invalid zipf center {}",
+                  center);
+      settings.centers_.push_back(geo::latlng{
+          std::stod(center.substr(0, comma)),
+          std::stod(center.substr(comma + 1))});
+    }
+    settings.min_z_ = opt.zipf_zoom_[0];
+    settings.max_z_ = opt.zipf_zoom_[1];
+    settings.count_ = opt.zipf_count_;
+    settings.exponent_ = opt.zipf_exponent_;
+    workload = tiles::workload{make_zipf_workload(settings), {}};
+  }
+
+  if (workload && !opt.write_workload_.empty()) {
+    write_workload(opt.write_workload_, *workload);
+  }
+  return workload;
+}
+
+std::vector<geo::tile> make_benchmark_tiles(std::vector<uint32_t> const& tile) {
+  std::vector<geo::tile> tiles;
+  if (tile.empty()) {
+    geo::latlng p1{49.83, 8.55};
+    geo::latlng p2{50.13, 8.74};
+    for (auto z = 9; z < 18; z += 2) {
+      for (auto const& t : geo::make_tile_range(p1, p2, z)) {
+        tiles.push_back(t);
+      }
+    }
+  } else {
+    utl::verify(tile.size() == 1, "throughput mode: need a zoom level");
+    for (auto const& t : geo::make_tile_range(tile.front())) {
+      tiles.push_back(t);
+    }
+  }
+
+  std::mt19937 g(31337);
+  std::shuffle(begin(tiles), end(tiles), g);
+  return tiles;
+}
+
+using latency_t = std::chrono::microseconds;
+
+void print_latencies(std::map<uint32_t, std::vector<latency_t>>& latencies) {
+  fmt::print(std::cout, "{:>4} {:>8} {:>10} {:>10} {:>10} {:>10}\n", "z",
+             "tiles", "p50[us]", "p95[us]", "p99[us]", "max[us]");
+  for (auto& [z, lat] : latencies) {
+    std::sort(begin(lat), end(lat));
+    fmt::print(std::cout, "{:>4} {:>8} {:>10} {:>10} {:>10} {:>10}\n", z,
+               lat.size(), percentile(lat, 50).count(),
+               percentile(lat, 95).count(), percentile(lat, 99).count(),
+               lat.back().count());
+  }
+}
+
+// closed loop: tiles are dispatched to the threads in workload order
+void run_throughput(tile_db_handle& db_handle, pack_handle const& pack_handle,
+                    render_ctx const& render_ctx,
+                    std::vector<geo::tile> const& tiles,
+                    uint32_t const num_threads) {
+  std::map<uint32_t, std::vector<latency_t>> latencies;  // per zoom level
+  std::mutex latencies_mutex;
+  std::atomic_size_t next{0};
+
+  auto const start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (auto i = 0U; i < num_threads; ++i) {
+    threads.emplace_back([&] {
+      null_perf_counter npc;
+      std::vector<std::pair<uint32_t, latency_t>> local;
+      for (auto idx = next++; idx < tiles.size(); idx = next++) {
+        auto const tile_start = std::chrono::steady_clock::now();
+        auto const rendered_tile =
+            get_tile(db_handle, pack_handle, render_ctx, tiles[idx], npc);
+        local.emplace_back(tiles[idx].z_,
+                           std::chrono::duration_cast<latency_t>(
+                               std::chrono::steady_clock::now() - tile_start));
+      }
+
+      std::lock_guard<std::mutex> lock{latencies_mutex};
+      for (auto const& [z, latency] : local) {
+        latencies[z].push_back(latency);
+      }
+    });
+  }
+  std::for_each(begin(threads), end(threads), [](auto& t) { t.join(); });
+  auto const duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+
+  fmt::print(std::cout,
+             "=== threads {:>3}: {} tiles in {}ms -> {:.1f} tiles/s\n",
+             num_threads, tiles.size(), duration.count(),
+             static_cast<double>(tiles.size()) * 1000. /
+                 std::max(1., static_cast<double>(duration.count())));
+  print_latencies(latencies);
+}
+
+// open loop: each tile is issued at its recorded arrival time (scaled by
+// 1 / speedup) independent of the completions, which reproduces the recorded
+// concurrency. latencies are measured from the scheduled start and include
+// the queueing delay if all threads are busy.
+void run_replay(tile_db_handle& db_handle, pack_handle const& pack_handle,
+                render_ctx const& render_ctx, workload const& w,
+                double const speedup, uint32_t const num_threads) {
+  utl::verify(!w.tiles_.empty() && w.arrivals_.size() == w.tiles_.size(),
+              "replay: need a workload with timestamps");
+  utl::verify(speedup > 0., "replay: invalid speedup {}", speedup);
+
+  std::map<uint32_t, std::vector<latency_t>> latencies;  // per zoom level
+  std::vector<latency_t> start_delays;
+  std::mutex latencies_mutex;
+  std::atomic_size_t next{0};
+  std::atomic_size_t in_flight{0}, max_in_flight{0};
+
+  auto const start = std::chrono::steady_clock::now();
+  auto const scheduled_start = [&](size_t const idx) {
+    return start + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::duration<double, std::micro>{
+                           static_cast<double>(w.arrivals_[idx].count()) /
+                           speedup});
+  };
+
+  std::vector<std::thread> threads;
+  for (auto i = 0U; i < num_threads; ++i) {
+    threads.emplace_back([&] {
+      null_perf_counter npc;
+      std::vector<std::tuple<uint32_t, latency_t, latency_t>> local;
+      for (auto idx = next++; idx < w.tiles_.size(); idx = next++) {
+        auto const tile_scheduled = scheduled_start(idx);
+        std::this_thread::sleep_until(tile_scheduled);
+
+        auto const tile_start = std::chrono::steady_clock::now();
+        auto const current = ++in_flight;
+        for (auto seen = max_in_flight.load();
+             seen < current &&
+             !max_in_flight.compare_exchange_weak(seen, current);) {
+        }
+
+        auto const rendered_tile =
+            get_tile(db_handle, pack_handle, render_ctx, w.tiles_[idx], npc);
+        --in_flight;
+
+        local.emplace_back(w.tiles_[idx].z_,
+                           std::chrono::duration_cast<latency_t>(
+                               std::chrono::steady_clock::now() -
+                               tile_scheduled),
+                           std::chrono::duration_cast<latency_t>(
+                               tile_start - tile_scheduled));
+      }
+
+      std::lock_guard<std::mutex> lock{latencies_mutex};
+      for (auto const& [z, latency, start_delay] : local) {
+        latencies[z].push_back(latency);
+        start_delays.push_back(start_delay);
+      }
+    });
+  }
+  std::for_each(begin(threads), end(threads), [](auto& t) { t.join(); });
+  auto const duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  auto const recorded = std::chrono::duration_cast<std::chrono::milliseconds>(
+      w.arrivals_.back());
+
+  fmt::print(std::cout,
+             "=== replay threads {:>3}, speedup {}: {} tiles in {}ms "
+             "(recorded {}ms) -> {:.1f} tiles/s, max in flight {}\n",
+             num_threads, speedup, w.tiles_.size(), duration.count(),
+             recorded.count(),
+             static_cast<double>(w.tiles_.size()) * 1000. /
+                 std::max(1., static_cast<double>(duration.count())),
+             max_in_flight.load());
+
+  std::sort(begin(start_delays), end(start_delays));
+  fmt::print(std::cout, "start delay [us]: p50 {} p99 {} max {}\n",
+             percentile(start_delays, 50).count(),
+             percentile(start_delays, 99).count(),
+             start_delays.back().count());
+  print_latencies(latencies);
+}
+
 int run_tiles_benchmark(int argc, char const** argv) {
   benchmark_settings opt;
 
@@ -57,7 +287,24 @@ int run_tiles_benchmark(int argc, char const** argv) {
   render_ctx.ignore_prepared_ = true;
   render_ctx.compress_result_ = opt.compress_;
 
-  if (opt.tile_.empty()) {
+  auto const workload = load_workload(opt);
+  if (opt.replay_) {
+    utl::verify(workload.has_value(), "replay: need a workload file");
+    run_replay(db_handle, pack_handle, render_ctx, *workload,
+               opt.replay_speedup_,
+               opt.threads_ != 0
+                   ? opt.threads_
+                   : std::max(1U, std::thread::hardware_concurrency()));
+  } else if (workload.has_value() && opt.threads_ == 0) {
+    run_throughput(db_handle, pack_handle, render_ctx, workload->tiles_, 1);
+  } else if (opt.threads_ != 0) {
+    auto const tiles = workload.has_value() ? workload->tiles_
+                                            : make_benchmark_tiles(opt.tile_);
+    for (auto n = 1U; n < opt.threads_; n *= 2) {
+      run_throughput(db_handle, pack_handle, render_ctx, tiles, n);
+    }
+    run_throughput(db_handle, pack_handle, render_ctx, tiles, opt.threads_);
+  } else if (opt.tile_.empty()) {
     geo::latlng p1{49.83, 8.55};
     geo::latlng p2{50.13, 8.74};
 
@@ -1,5 +1,6 @@
 #include "tiles/db/bq_tree.h"
 
+#include <algorithm>
 #include <array>
 #include <map>
 #include <stack>
@@ -60,27 +61,22 @@ std::pair<std::optional<bool>, bq_node_t> bq_tree::find_parent_leaf(
     return {std::nullopt, nodes_.at(0)};
   }
 
-  std::vector<geo::tile> trace{q};
-  while (!(trace.back().parent() == geo::tile{0, 0, 0})) {
-    trace.push_back(trace.back().parent());
-  }
-  std::reverse(begin(trace), end(trace));
-
-  // curr is at lvl z, tile is at lvl z+1
+  // curr is at lvl z - 1, the ancestor of q at lvl z is extracted from the
+  // coordinate bits (no trace of parent tiles required)
   auto curr = nodes_.at(0);
-  for (auto const& tile : trace) {
-    // std::cout << "tile" << tile << std::endl;
-    // printf("%i %08x\n\n", tile.quad_pos(), curr);
+  for (auto z = 1U; z <= q.z_; ++z) {
+    auto const shift = q.z_ - z;
+    auto const quad_pos = geo::tile{q.x_ >> shift, q.y_ >> shift, z}.quad_pos();
 
-    if (bit_set(curr, tile.quad_pos() + kFalseOffset)) {
+    if (bit_set(curr, quad_pos + kFalseOffset)) {
       return {{false}, kInvalidNode};
     }
-    if (bit_set(curr, tile.quad_pos() + kTrueOffset)) {
+    if (bit_set(curr, quad_pos + kTrueOffset)) {
       return {{true}, kInvalidNode};
     }
 
     auto offset = curr & kOffsetMask;
-    for (auto i = 0ULL; i < tile.quad_pos(); ++i) {
+    for (auto i = 0ULL; i < quad_pos; ++i) {
       if (!bit_set(curr, i + kFalseOffset) && !bit_set(curr, i + kTrueOffset)) {
         ++offset;
       }
@@ -92,12 +88,31 @@ std::pair<std::optional<bool>, bq_node_t> bq_tree::find_parent_leaf(
   return {std::nullopt, curr};
 }
 
+std::optional<bool> bq_tree::find_in_bitmap(geo::tile const& q) const {
+  if (!bitmap_z_.has_value() || q.z_ < *bitmap_z_) {
+    return std::nullopt;
+  }
+
+  auto const shift = q.z_ - *bitmap_z_;
+  auto const idx = (static_cast<uint64_t>(q.y_ >> shift) << *bitmap_z_) |
+                   static_cast<uint64_t>(q.x_ >> shift);
+  return ((bitmap_[idx / 64] >> (idx % 64)) & 1ULL) != 0;
+}
+
 bool bq_tree::contains(geo::tile const& q) const {
+  if (auto const bit = find_in_bitmap(q); bit.has_value()) {
+    return *bit;
+  }
+
   auto const decision = find_parent_leaf(q).first;
   return decision.has_value() ? *decision : false;
 }
 
 std::vector<geo::tile> bq_tree::all_leafs(geo::tile const& q) const {
+  if (auto const bit = find_in_bitmap(q); bit.has_value()) {
+    return *bit ? std::vector<geo::tile>{q} : std::vector<geo::tile>{};
+  }
+
   auto const parent = find_parent_leaf(q);
   auto const& decision = parent.first;
   if (decision.has_value()) {
@@ -132,6 +147,36 @@ std::vector<geo::tile> bq_tree::all_leafs(geo::tile const& q) const {
   return result;
 }
 
+void bq_tree::materialize_bitmap(uint32_t const max_z) {
+  bitmap_z_ = std::nullopt;
+  bitmap_.clear();
+
+  auto const leafs = all_leafs({0, 0, 0});
+  auto z = 0U;
+  for (auto const& leaf : leafs) {
+    z = std::max(z, leaf.z_);
+  }
+  if (z > max_z) {
+    return;  // not exact on a coarser level
+  }
+
+  std::vector<uint64_t> bitmap(((1ULL << (2 * z)) + 63) / 64, 0ULL);
+  for (auto const& leaf : leafs) {
+    auto const shift = z - leaf.z_;
+    auto const x_begin = static_cast<uint64_t>(leaf.x_) << shift;
+    auto const y_begin = static_cast<uint64_t>(leaf.y_) << shift;
+    for (auto y = y_begin; y < y_begin + (1ULL << shift); ++y) {
+      for (auto x = x_begin; x < x_begin + (1ULL << shift); ++x) {
+        auto const idx = (y << z) | x;
+        bitmap[idx / 64] |= 1ULL << (idx % 64);
+      }
+    }
+  }
+
+  bitmap_z_ = z;
+  bitmap_ = std::move(bitmap);
+}
+
 std::string_view bq_tree::string_view() const {
   return std::string_view{reinterpret_cast<char const*>(nodes_.data()),
                           nodes_.size() * sizeof(bq_node_t)};
@@ -87,6 +87,7 @@ void database_stats(tile_db_handle& db_handle, pack_handle& pack_handle) {
                   header_sizes.push_back(std::distance(pre, post));
                 } break;
                 case tags::feature::repeated_string_simplify_masks:
+                case tags::feature::repeated_string_simplify_levels:
                   simplify_mask_sizes.push_back(msg.get_view().size());
                   break;
                 case tags::feature::required_fixed_geometry_geometry:
@@ -132,13 +132,18 @@ prepare_manager make_prepare_manager(tile_db_handle& db_handle,
 }
 
 void prepare_tiles(tile_db_handle& db_handle, pack_handle& pack_handle,
-                   uint32_t max_zoomlevel) {
+                   uint32_t max_zoomlevel, std::string const& point_grid,
+                   size_t const max_tile_bytes,
+                   std::string const& priority_key) {
   auto m = make_prepare_manager(db_handle, max_zoomlevel);
 
   auto render_ctx = make_render_ctx(db_handle);
   render_ctx.ignore_fully_seaside_ = true;
   render_ctx.tb_aggregate_lines_ = true;
   render_ctx.tb_aggregate_polygons_ = true;
+  render_ctx.tb_priority_key_ = priority_key;
+  render_ctx.tb_max_tile_bytes_ = max_tile_bytes;
+  set_point_grid(render_ctx, point_grid);
   null_perf_counter npc;
 
   std::vector<std::thread> threads;
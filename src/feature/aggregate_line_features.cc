@@ -1,12 +1,11 @@
 #include "tiles/feature/aggregate_line_features.h"
 
-#include <stack>
+#include <algorithm>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
 
-#include "utl/concat.h"
 #include "utl/equal_ranges_linear.h"
-#include "utl/erase_duplicates.h"
-#include "utl/erase_if.h"
-#include "utl/to_vec.h"
 #include "utl/verify.h"
 
 #include "tiles/feature/feature.h"
@@ -16,238 +15,177 @@
 
 namespace tiles {
 
-struct line;
-using line_handle = std::unique_ptr<line>;
+constexpr auto const kNoLink = std::numeric_limits<uint32_t>::max();
 
-struct line {
-  fixed_xy from_{}, to_{};
-
-  line_handle left_, right_;
-  feature* feature_{nullptr};
-  uint32_t geo_idx_{std::numeric_limits<uint32_t>::max()};
+// incidence: line_idx * 2 + (0: from end, 1: to end)
+inline uint32_t from_end(uint32_t const line_idx) { return line_idx * 2; }
+inline uint32_t to_end(uint32_t const line_idx) { return line_idx * 2 + 1; }
 
-  bool reversed_{false};
-  bool oneway_{false};
+struct line {
+  fixed_line* geo_{nullptr};
+  bool closed_{false};  // a "blossom", never joined
 };
 
-template <typename FeatureIt>
-std::vector<line_handle> make_line_handles(FeatureIt lb, FeatureIt ub) {
-  std::vector<line_handle> lines;
-  for (auto it = lb; it != ub; ++it) {
-    auto const& l = mpark::get<fixed_polyline>(it->geometry_);
-    utl::verify(l.size() < std::numeric_limits<uint32_t>::max(),
-                "make_line_handles: too many features");
+struct endpoint {
+  uint32_t count_{0};
+  uint32_t first_{kNoLink}, second_{kNoLink};  // first two incidences
+};
 
-    for (auto i = 0ULL; i < l.size(); ++i) {
-      lines.emplace_back(std::make_unique<line>());
-      lines.back()->from_ = l[i].front();
-      lines.back()->to_ = l[i].back();
-      lines.back()->feature_ = &*it;
-      lines.back()->geo_idx_ = i;
-      // TODO(root): oneway support (needs special tag?!)
-    }
+struct fixed_xy_hash {
+  size_t operator()(fixed_xy const& pos) const {
+    return std::hash<uint64_t>{}(
+        (static_cast<uint64_t>(pos.x()) << 32U) ^
+        static_cast<uint64_t>(pos.y()) * 0x9E3779B97F4A7C15ULL);
   }
-  return lines;
-}
+};
 
-void join_lines(std::vector<line_handle>& handles) {
-  std::vector<std::pair<fixed_xy, line_handle*>> idx;
-  for (auto& lh : handles) {
-    idx.emplace_back(lh->from_, &lh);
-    idx.emplace_back(lh->to_, &lh);
+struct fixed_xy_equal {
+  bool operator()(fixed_xy const& a, fixed_xy const& b) const {
+    return a.x() == b.x() && a.y() == b.y();
   }
-  utl::erase_duplicates(
-      idx,
-      [](auto const& a, auto const& b) {
-        return std::tie(a.first.x(), a.first.y(), a.second) <
-               std::tie(b.first.x(), b.first.y(), b.second);
-      },
-      [](auto const& a, auto const& b) {
-        return std::tie(a.first.x(), a.first.y(), a.second) ==
-               std::tie(b.first.x(), b.first.y(), b.second);
-      });
+};
 
-  auto const find_incident_line = [&](line_handle const& lh,
-                                      fixed_xy const& pos) -> line_handle* {
-    if (pos == invalid_xy) {
-      return nullptr;
+// "oneway" tag: yes/true/1/-1 (-1 is consistent in itself, too)
+inline bool is_oneway(std::vector<metadata> const& meta) {
+  return std::any_of(begin(meta), end(meta), [](auto const& m) {
+    if (m.key_ != "oneway" || m.value_.empty()) {
+      return false;
     }
-
-    auto it0 = std::lower_bound(
-        begin(idx), end(idx), pos, [](auto const& a, auto const& b) {
-          return std::tie(a.first.x(), a.first.y()) < std::tie(b.x(), b.y());
-        });
-
-    size_t count = 0;
-    line_handle* other = nullptr;
-    for (auto it = it0; it != end(idx) && it->first == pos; ++it) {
-      ++count;
-      // NOLINTNEXTLINE
-      if (it->second->get() == lh.get() || it->second->get() == nullptr) {
-        continue;  // found self or already gone
-      }
-      other = it->second;
+    auto const type = static_cast<metadata_value_t>(m.value_[0]);
+    if (type == metadata_value_t::bool_true) {
+      return true;
     }
-
-    if (count == 2) {
-      return other;
+    if (type == metadata_value_t::string) {
+      auto const val = std::string_view{m.value_}.substr(1);
+      return val == "yes" || val == "true" || val == "1" || val == "-1";
     }
+    return false;
+  });
+}
 
-    // degree != 2 -> "burn" this coordinate for further processing
-    for (auto it = it0; it != end(idx) && it->first == pos; ++it) {
-      // NOLINTNEXTLINE
-      if (it->second->get() == nullptr) {
-        continue;  // self can already be gone in bwd pass
-      }
-
-      if ((**it->second).from_ == pos) {
-        (**it->second).from_ = invalid_xy;
+// flat, index based line joining:
+// - all lines of one metadata group in one vector
+// - hash map from endpoint to its incidences: lines are joined at endpoints
+//   with degree two (for oneway groups: only to -> from)
+// - link_[incidence] is the incidence of the joined neighbor line
+struct line_joiner {
+  template <typename FeatureIt>
+  line_joiner(FeatureIt lb, FeatureIt ub, bool const oneway)
+      : oneway_{oneway} {
+    for (auto it = lb; it != ub; ++it) {
+      for (auto& l : mpark::get<fixed_polyline>(it->geometry_)) {
+        if (l.empty()) {
+          continue;
+        }
+        lines_.push_back(line{&l, l.front() == l.back()});
       }
-      if ((**it->second).to_ == pos) {
-        (**it->second).to_ = invalid_xy;
+    }
+    utl::verify(lines_.size() < std::numeric_limits<uint32_t>::max() / 2,
+                "aggregate_line_features: too many lines");
+
+    std::unordered_map<fixed_xy, endpoint, fixed_xy_hash, fixed_xy_equal>
+        endpoints;
+    endpoints.reserve(lines_.size() * 2);
+
+    auto const add = [&](fixed_xy const& pos, uint32_t const incidence) {
+      auto& ep = endpoints[pos];
+      if (ep.count_ == 0) {
+        ep.first_ = incidence;
+      } else if (ep.count_ == 1) {
+        ep.second_ = incidence;
       }
+      ++ep.count_;
+    };
+    for (auto i = 0U; i < lines_.size(); ++i) {
+      add(lines_[i].geo_->front(), from_end(i));
+      add(lines_[i].geo_->back(), to_end(i));
     }
 
-    return nullptr;
-  };
-
-  auto const mark_reversed = [](line* l) {
-    std::stack<line*> stack{{l}};
-    while (!stack.empty()) {
-      auto* curr = stack.top();
-      stack.pop();
-
-      curr->reversed_ = !curr->reversed_;
-
-      if (curr->left_) {
-        stack.push(curr->left_.get());
+    link_.resize(lines_.size() * 2, kNoLink);
+    for (auto const& [pos, ep] : endpoints) {
+      if (ep.count_ != 2 || lines_[ep.first_ / 2].closed_ ||
+          lines_[ep.second_ / 2].closed_) {
+        continue;  // junction, dead end or blossom
       }
-      if (curr->right_) {
-        stack.push(curr->right_.get());
+      if (oneway_ && (ep.first_ % 2) == (ep.second_ % 2)) {
+        continue;  // conflicting oneway directions
       }
+      link_[ep.first_] = ep.second_;
+      link_[ep.second_] = ep.first_;
     }
-  };
+  }
 
-  for (auto it = begin(handles); it != end(handles); ++it) {
-    if (!*it || (**it).from_ == (**it).to_) {
-      continue;
-    }
+  fixed_polyline join() {
+    fixed_polyline result;
+    std::vector<bool> visited(lines_.size(), false);
+    std::vector<std::pair<uint32_t, bool>> chain;  // (line, reversed)
 
-    line_handle* other = nullptr;
-    while ((other = find_incident_line(*it, (**it).from_)) != nullptr) {
-      if (*other == nullptr) {
-        break;  // other alreay moved if join already discarded
+    for (auto i = 0U; i < lines_.size(); ++i) {
+      if (visited[i]) {
+        continue;
       }
-      if ((**it).oneway_ != (**other).oneway_) {
-        break;  // dont join oneway with twoway
-      }
-      if ((**other).from_ == (**other).to_) {
-        break;  // other is a "blossom"
-      }
-
-      auto joined = std::make_unique<line>();
-      joined->to_ = (**it).to_;
-      joined->oneway_ = (**it).oneway_;
 
-      if ((**it).from_ == (**other).to_) {  //  --(other)--> X --(this)-->
-        joined->from_ = (**other).from_;
-      } else {  //  <--(other)-- X --(this)-->
-        if ((**it).oneway_) {
-          break;  // dont join conflicting oneway directions
+      // walk backwards to the start of the chain (or once around a cycle)
+      auto start = std::make_pair(i, false);
+      while (true) {
+        auto const [l, reversed] = start;
+        auto const prev = link_[reversed ? to_end(l) : from_end(l)];
+        if (prev == kNoLink || prev / 2 == i) {
+          break;
         }
-        joined->from_ = (**other).to_;
-        mark_reversed(other->get());
-      }
-
-      joined->left_ = std::move(*other);
-      joined->right_ = std::move(*it);
-      *it = std::move(joined);
-    }
-
-    if ((**it).from_ == (**it).to_) {
-      continue;  // cycle detected
-    }
-
-    while ((other = find_incident_line(*it, (**it).to_)) != nullptr) {
-      if (*other == nullptr) {
-        break;  // other alreay moved if join already discarded
+        start = {prev / 2, prev % 2 == 0};  // prev is the exit end
       }
-      if ((**it).oneway_ != (**other).oneway_) {
-        break;  // dont join oneway with twoway
-      }
-      if ((**other).from_ == (**other).to_) {
-        break;  // other is a "blossom"
-      }
-
-      auto joined = std::make_unique<line>();
-      joined->from_ = (**it).from_;
-      joined->oneway_ = (**it).oneway_;
 
-      if ((**it).to_ == (**other).from_) {  // --(this)--> X --(other)-->
-        joined->to_ = (**other).to_;
-      } else {  // --(this)--> X <--(other)--
-        if ((**it).oneway_) {
-          break;  // conflicting oneway directions
+      // walk forward and collect the chain
+      chain.clear();
+      auto curr = start;
+      while (true) {
+        auto const [l, reversed] = curr;
+        chain.push_back(curr);
+        visited[l] = true;
+
+        auto const next = link_[reversed ? from_end(l) : to_end(l)];
+        if (next == kNoLink || visited[next / 2]) {
+          break;
         }
-        joined->to_ = (**other).from_;
-        mark_reversed(other->get());
+        curr = {next / 2, next % 2 == 1};  // next is the entry end
       }
 
-      joined->left_ = std::move(*it);
-      joined->right_ = std::move(*other);
-      *it = std::move(joined);
+      result.emplace_back(concat(chain));
     }
+    return result;
   }
-}
-
-fixed_polyline aggregate_geometry(std::vector<line_handle> lines) {
-  fixed_polyline polyline;
-
-  for (auto& line : lines) {
-    if (!line) {  // joined away
-      continue;
-    } else if (line->feature_ != nullptr) {  // unjoined / single
-      polyline.emplace_back(
-          std::move(mpark::get<fixed_polyline>(line->feature_->geometry_)
-                        .at(line->geo_idx_)));
-    } else {  // join result;
-      fixed_line joined_geo;
 
-      std::stack<line_handle> stack;
-      stack.emplace(std::move(line));
-      while (!stack.empty()) {
-        auto curr = std::move(stack.top());
-        stack.pop();
+  fixed_line concat(std::vector<std::pair<uint32_t, bool>> const& chain) {
+    if (chain.size() == 1 && !chain.front().second) {
+      return std::move(*lines_[chain.front().first].geo_);
+    }
 
-        if (curr->feature_ != nullptr) {
-          auto const skip = joined_geo.empty() ? 0 : 1;
-          auto const& curr_geo =
-              mpark::get<fixed_polyline>(curr->feature_->geometry_)
-                  .at(curr->geo_idx_);
+    auto size = 0ULL;
+    for (auto const& [l, reversed] : chain) {
+      size += lines_[l].geo_->size();
+    }
 
-          if (curr->reversed_) {
-            std::reverse_copy(begin(curr_geo), std::next(end(curr_geo), -skip),
-                              std::back_inserter(joined_geo));
-          } else {
-            std::copy(std::next(begin(curr_geo), skip), end(curr_geo),
-                      std::back_inserter(joined_geo));
-          }
-        } else {
-          if (curr->reversed_) {
-            stack.emplace(std::move(curr->left_));
-            stack.emplace(std::move(curr->right_));
-          } else {
-            stack.emplace(std::move(curr->right_));
-            stack.emplace(std::move(curr->left_));
-          }
-        }
+    fixed_line joined;
+    joined.reserve(size);
+    for (auto const& [l, reversed] : chain) {
+      auto const& geo = *lines_[l].geo_;
+      auto const skip = joined.empty() ? 0 : 1;  // shared endpoint
+      if (reversed) {
+        std::reverse_copy(begin(geo), std::next(end(geo), -skip),
+                          std::back_inserter(joined));
+      } else {
+        std::copy(std::next(begin(geo), skip), end(geo),
+                  std::back_inserter(joined));
       }
-
-      polyline.emplace_back(std::move(joined_geo));
     }
+    return joined;
   }
-  return polyline;
-}
+
+  bool oneway_;
+  std::vector<line> lines_;
+  std::vector<uint32_t> link_;
+};
 
 std::vector<feature> aggregate_line_features(std::vector<feature> features,
                                              uint32_t const z) {
@@ -261,20 +199,17 @@ std::vector<feature> aggregate_line_features(std::vector<feature> features,
       features,
       [](auto const& lhs, auto const& rhs) { return lhs.meta_ == rhs.meta_; },
       [&](auto lb, auto ub) {
-        auto lines = make_line_handles(lb, ub);
-        join_lines(lines);
-
         feature f;
         f.id_ = lb->id_;
+        f.geometry_ = line_joiner{lb, ub, is_oneway(lb->meta_)}.join();
         f.meta_ = std::move(lb->meta_);
 
-        f.geometry_ = aggregate_geometry(std::move(lines));
         if (z <= kMaxZoomLevel) {
           f.geometry_ =
               simplify(std::move(f.geometry_), 1ULL << (kMaxZoomLevel - z));
         }
 
-        result.emplace_back((f));
+        result.emplace_back(std::move(f));
       });
 
   return result;
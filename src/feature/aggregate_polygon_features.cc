@@ -1,15 +1,76 @@
 #include "tiles/feature/aggregate_polygon_features.h"
 
+#include <algorithm>
+#include <tuple>
+
+#include "boost/geometry.hpp"
+
+#include "clipper/clipper.hpp"
+
 #include "utl/equal_ranges_linear.h"
-#include "utl/to_vec.h"
+#include "utl/verify.h"
 
 #include "tiles/feature/feature.h"
 #include "tiles/fixed/algo/simplify.h"
 #include "tiles/fixed/convert.h"
 #include "tiles/util.h"
 
+namespace cl = ClipperLib;
+
 namespace tiles {
 
+namespace {
+
+// snap to the tile pixel grid of zoom level z (one unit of the 4096 extent)
+cl::Path snap_ring(fixed_ring const& ring, fixed_coord_t const grid) {
+  auto const snap = [&](fixed_coord_t const c) {
+    return ((c + grid / 2) / grid) * grid;
+  };
+
+  cl::Path path;
+  path.reserve(ring.size());
+  for (auto const& pt : ring) {
+    cl::IntPoint const snapped{snap(pt.x()), snap(pt.y())};
+    if (path.empty() || !(path.back() == snapped)) {
+      path.push_back(snapped);
+    }
+  }
+  if (path.size() > 1 && path.front() == path.back()) {
+    path.pop_back();  // clipper rings are implicitly closed
+  }
+  return path;
+}
+
+void polytree_to_polygon(fixed_polygon& polygon, cl::PolyNodes const& nodes) {
+  auto const path_to_ring = [](auto const& path) {
+    utl::verify(!path.empty(), "path empty");
+    fixed_ring ring;
+    ring.reserve(path.size() + 1);
+    for (auto const& pt : path) {
+      ring.emplace_back(pt.X, pt.Y);
+    }
+    ring.emplace_back(path[0].X, path[0].Y);
+    return ring;
+  };
+
+  for (auto const* outer : nodes) {
+    utl::verify(!outer->IsHole(), "outer ring is hole");
+    fixed_simple_polygon simple;
+    simple.outer() = path_to_ring(outer->Contour);
+
+    for (auto const* inner : outer->Childs) {
+      utl::verify(inner->IsHole(), "inner ring is no hole");
+      simple.inners().emplace_back(path_to_ring(inner->Contour));
+
+      polytree_to_polygon(polygon, inner->Childs);
+    }
+
+    polygon.emplace_back(std::move(simple));
+  }
+}
+
+}  // namespace
+
 std::vector<feature> aggregate_polygon_features(std::vector<feature> features,
                                                 uint32_t const z) {
   std::sort(
@@ -17,26 +78,49 @@ std::vector<feature> aggregate_polygon_features(std::vector<feature> features,
         return std::tie(lhs.meta_, lhs.id_) < std::tie(rhs.meta_, rhs.id_);
       });
 
+  auto const grid = static_cast<fixed_coord_t>(1ULL << (kMaxZoomLevel - z));
+
   std::vector<feature> result;
   utl::equal_ranges_linear(
       features,
       [](auto const& lhs, auto const& rhs) { return lhs.meta_ == rhs.meta_; },
       [&](auto lb, auto ub) {
-        fixed_polygon final_polygon;
+        // input rings are oriented (boost::geometry::correct):
+        // non-zero filling yields the union, holes included.
+        // simplify before the union: it resolves self intersections
+        cl::Clipper clpr;
         for (auto it = lb; it != ub; ++it) {
-          for (auto& p : mpark::get<fixed_polygon>(it->geometry_)) {
-            final_polygon.emplace_back(std::move(p));
+          auto const simplified = simplify(std::move(it->geometry_), grid);
+          if (!mpark::holds_alternative<fixed_polygon>(simplified)) {
+            continue;
+          }
+
+          for (auto const& p : mpark::get<fixed_polygon>(simplified)) {
+            clpr.AddPath(snap_ring(p.outer(), grid), cl::ptSubject, true);
+            for (auto const& inner : p.inners()) {
+              clpr.AddPath(snap_ring(inner, grid), cl::ptSubject, true);
+            }
           }
         }
 
+        cl::PolyTree solution;
+        utl::verify(clpr.Execute(cl::ctUnion, solution, cl::pftNonZero,
+                                 cl::pftNonZero),
+                    "aggregate_polygon_features: union failed");
+        if (solution.Childs.empty()) {
+          return;  // everything collapsed while snapping
+        }
+
+        fixed_polygon final_polygon;
+        polytree_to_polygon(final_polygon, solution.Childs);
+        boost::geometry::correct(final_polygon);
+
         feature f;
         f.id_ = lb->id_;
+        f.layer_ = lb->layer_;
+        f.zoom_levels_ = lb->zoom_levels_;
         f.meta_ = std::move(lb->meta_);
-
-        // TODO(root): this is a noop
-        f.geometry_ =
-            simplify(std::move(final_polygon), 1ULL << (kMaxZoomLevel - z));
-
+        f.geometry_ = std::move(final_polygon);
         result.emplace_back(std::move(f));
       });
 
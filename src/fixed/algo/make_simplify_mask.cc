@@ -0,0 +1,113 @@
+#include "tiles/fixed/algo/make_simplify_mask.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include "tiles/constants.h"
+
+namespace tiles {
+
+constexpr auto const kLevelAlways = uint8_t{0};
+constexpr auto const kLevelFullDetail = static_cast<uint8_t>(kMaxZoomLevel);
+
+// squared tolerance of zoom level z (one z20 unit at z20)
+inline double squared_tolerance(uint32_t const z) {
+  auto const tolerance = static_cast<double>(1ULL << (kMaxZoomLevel - z));
+  return tolerance * tolerance;
+}
+
+// lowest zoom level z where the squared distance exceeds the tolerance
+inline uint8_t min_level(double const squared_dist) {
+  for (auto z = 0U; z < kMaxZoomLevel; ++z) {
+    if (squared_dist > squared_tolerance(z)) {
+      return static_cast<uint8_t>(z);
+    }
+  }
+  return kLevelFullDetail;
+}
+
+struct simplify_mask_builder {
+  explicit simplify_mask_builder(fixed_xy const* points, size_t const size)
+      : xs_(size), ys_(size), dist_(size), levels_(size, kLevelFullDetail) {
+    // flat arrays relative to the first point: exact in double precision
+    auto const x0 = points[0].x();
+    auto const y0 = points[0].y();
+    for (auto i = 0ULL; i < size; ++i) {
+      xs_[i] = static_cast<double>(points[i].x() - x0);
+      ys_[i] = static_cast<double>(points[i].y() - y0);
+    }
+  }
+
+  // branch free kernel (auto vectorized): squared distance to the segment
+  void compute_distances(size_t const lb, size_t const ub) {
+    auto const ax = xs_[lb];
+    auto const ay = ys_[lb];
+    auto const dx = xs_[ub] - ax;
+    auto const dy = ys_[ub] - ay;
+    auto const len2 = dx * dx + dy * dy;
+    auto const inv_len2 = len2 > 0. ? 1. / len2 : 0.;  // closed ring: point
+
+    double const* __restrict xs = xs_.data();
+    double const* __restrict ys = ys_.data();
+    double* __restrict dist = dist_.data();
+    for (auto i = lb + 1; i < ub; ++i) {
+      auto const px = xs[i] - ax;
+      auto const py = ys[i] - ay;
+      auto const t = std::min(1., std::max(0., (px * dx + py * dy) * inv_len2));
+      auto const ex = px - t * dx;
+      auto const ey = py - t * dy;
+      dist[i] = ex * ex + ey * ey;
+    }
+  }
+
+  void build() {
+    auto const size = xs_.size();
+    levels_.front() = kLevelAlways;
+    levels_.back() = kLevelAlways;
+
+    struct segment {
+      size_t lb_, ub_;
+      uint8_t parent_level_;
+    };
+    std::vector<segment> stack{{0, size - 1, kLevelAlways}};
+    while (!stack.empty()) {
+      auto const [lb, ub, parent_level] = stack.back();
+      stack.pop_back();
+      if (ub - lb < 2) {
+        continue;
+      }
+
+      compute_distances(lb, ub);
+      auto const max_it = std::max_element(std::next(begin(dist_), lb + 1),
+                                           std::next(begin(dist_), ub));
+      auto const split =
+          static_cast<size_t>(std::distance(begin(dist_), max_it));
+
+      // interior is below the z20 tolerance: full detail only (default)
+      if (*max_it <= squared_tolerance(kMaxZoomLevel)) {
+        continue;
+      }
+
+      auto const level = std::max(parent_level, min_level(*max_it));
+      levels_[split] = level;
+      stack.push_back({lb, split, level});
+      stack.push_back({split, ub, level});
+    }
+  }
+
+  std::vector<double> xs_, ys_, dist_;
+  std::vector<uint8_t> levels_;
+};
+
+std::string make_simplify_mask(fixed_xy const* points, size_t const size) {
+  if (size < 3) {
+    return std::string(size, static_cast<char>(kLevelAlways));
+  }
+
+  simplify_mask_builder builder{points, size};
+  builder.build();
+  return {begin(builder.levels_), end(builder.levels_)};
+}
+
+}  // namespace tiles
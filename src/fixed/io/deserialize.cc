@@ -1,5 +1,7 @@
 #include "tiles/fixed/io/deserialize.h"
 
+#include <algorithm>
+
 #include "protozero/pbf_message.hpp"
 
 #include "geo/simplify_mask.h"
@@ -7,6 +9,7 @@
 #include "utl/erase_if.h"
 #include "utl/verify.h"
 
+#include "tiles/constants.h"
 #include "tiles/fixed/algo/delta.h"
 #include "tiles/fixed/io/tags.h"
 #include "tiles/util.h"
@@ -42,6 +45,8 @@ struct default_decoder {
 
   range_t range_;
 
+  fixed_coord_t min_ring_extent_{0};  // see deserialize_polygon
+
   delta_decoder x_decoder_{kFixedCoordMagicOffset};
   delta_decoder y_decoder_{kFixedCoordMagicOffset};
 };
@@ -53,24 +58,50 @@ default_decoder make_default_decoder(pz::pbf_message<tags::fixed_geometry>& m) {
   return default_decoder{m.get_packed_sint64()};
 }
 
+// one screen pixel (of a 256px raster tile) in tile coordinates
+constexpr auto const kScreenPixelExtent = kTileSize / 256;
+
 struct simplifying_decoder : public default_decoder {
   simplifying_decoder(default_decoder::range_t range,
-                      std::vector<std::string_view> simplify_masks, uint32_t z)
+                      std::vector<std::string_view> simplify_masks, uint32_t z,
+                      simplify_mask_type type)
       : default_decoder{std::move(range)},
         simplify_masks_{std::move(simplify_masks)},
-        z_{z} {}
+        z_{z},
+        type_{type} {
+    min_ring_extent_ = static_cast<fixed_coord_t>(kScreenPixelExtent)
+                       << (kMaxZoomLevel - z);
+  }
 
   template <typename Container>
   void deserialize_points(Container& out) {
     utl::verify(curr_mask_ < simplify_masks_.size(), "mask part missing");
-    geo::simplify_mask_reader reader{simplify_masks_[curr_mask_].data(), z_};
-
+    auto const mask = simplify_masks_[curr_mask_];
     auto const size = get_next();
-    utl::verify(size == reader.size_, "simplify mask size mismatch");
 
+    if (type_ == simplify_mask_type::zoom_levels) {
+      utl::verify(size >= 0 && static_cast<size_t>(size) == mask.size(),
+                  "simplify mask size mismatch");
+      deserialize_points(out, size, [&](auto const i) {
+        return static_cast<uint8_t>(mask[i]) <= z_;
+      });
+    } else {
+      geo::simplify_mask_reader reader{mask.data(), z_};
+      utl::verify(size == reader.size_, "simplify mask size mismatch");
+      deserialize_points(out, size, [&](auto const i) {
+        return reader.get_bit(i);
+      });
+    }
+
+    ++curr_mask_;
+  }
+
+  template <typename Container, typename KeepFn>
+  void deserialize_points(Container& out, fixed_delta_t const size,
+                          KeepFn&& keep) {
     out.reserve(size);
     for (auto i = 0LL; i < size; ++i) {
-      if (reader.get_bit(i)) {
+      if (keep(i)) {
         // do not inline -> undefined execution order
         auto const x_val = x_decoder_.decode(get_next());
         auto const y_val = y_decoder_.decode(get_next());
@@ -80,22 +111,22 @@ struct simplifying_decoder : public default_decoder {
         y_decoder_.decode(get_next());
       }
     }
-
-    ++curr_mask_;
   }
 
   std::vector<std::string_view> simplify_masks_;
   uint32_t z_;
+  simplify_mask_type type_;
   size_t curr_mask_{0};
 };
 
 simplifying_decoder make_simplifying_decoder(
     pz::pbf_message<tags::fixed_geometry>& m,
-    std::vector<std::string_view> simplify_masks, uint32_t z) {
+    std::vector<std::string_view> simplify_masks, uint32_t z,
+    simplify_mask_type const type) {
   utl::verify(m.next(), "invalid message");
   utl::verify(m.tag() == tags::fixed_geometry::packed_sint64_geometry,
               "invalid tag");
-  return {m.get_packed_sint64(), std::move(simplify_masks), z};
+  return {m.get_packed_sint64(), std::move(simplify_masks), z, type};
 }
 
 template <typename Decoder>
@@ -133,9 +164,30 @@ fixed_geometry deserialize_polygon(Decoder&& decoder) {
     }
   }
 
-  utl::erase_if(polygon, [](auto& p) {
-    utl::erase_if(p.inners(), [](auto const& i) { return i.size() < 4; });
-    return p.outer().size() < 4;
+  // drop degenerate rings and (with known zoom level) rings which fit into
+  // a single screen pixel: simplify masks cannot remove those
+  auto const min_extent = decoder.min_ring_extent_;
+  auto const drop_ring = [&](fixed_ring const& ring) {
+    if (ring.size() < 4) {
+      return true;
+    }
+    if (min_extent == 0) {
+      return false;
+    }
+
+    auto const [min_x, max_x] = std::minmax_element(
+        begin(ring), end(ring),
+        [](auto const& a, auto const& b) { return a.x() < b.x(); });
+    auto const [min_y, max_y] = std::minmax_element(
+        begin(ring), end(ring),
+        [](auto const& a, auto const& b) { return a.y() < b.y(); });
+    return max_x->x() - min_x->x() < min_extent &&
+           max_y->y() - min_y->y() < min_extent;
+  };
+
+  utl::erase_if(polygon, [&](auto& p) {
+    utl::erase_if(p.inners(), drop_ring);
+    return drop_ring(p.outer());
   });
 
   if (polygon.empty()) {
@@ -164,7 +216,7 @@ fixed_geometry deserialize(std::string_view geo) {
 
 fixed_geometry deserialize(std::string_view geo,
                            std::vector<std::string_view> simplify_masks,
-                           uint32_t const z) {
+                           uint32_t const z, simplify_mask_type const type) {
   pz::pbf_message<tags::fixed_geometry> m{geo};
   utl::verify(m.next(), "invalid msg");
   utl::verify(m.tag() == tags::fixed_geometry::required_fixed_geometry_type,
@@ -175,10 +227,10 @@ fixed_geometry deserialize(std::string_view geo,
       return deserialize_point(make_default_decoder(m));
     case tags::fixed_geometry_type::POLYLINE:
       return deserialize_polyline(
-          make_simplifying_decoder(m, std::move(simplify_masks), z));
+          make_simplifying_decoder(m, std::move(simplify_masks), z, type));
     case tags::fixed_geometry_type::POLYGON:
       return deserialize_polygon(
-          make_simplifying_decoder(m, std::move(simplify_masks), z));
+          make_simplifying_decoder(m, std::move(simplify_masks), z, type));
     default: throw utl::fail("unknown geometry");
   }
 }
@@ -0,0 +1,390 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "conf/configuration.h"
+#include "conf/options_parser.h"
+
+#include "osmium/builder/osm_object_builder.hpp"
+#include "osmium/io/pbf_output.hpp"
+#include "osmium/io/writer.hpp"
+#include "osmium/memory/buffer.hpp"
+
+#include "tiles/osm/write_shapefile.h"
+#include "tiles/util.h"
+
+namespace ob = osmium::builder;
+namespace om = osmium::memory;
+
+namespace tiles {
+
+constexpr auto const kPi = 3.14159265358979323846;
+constexpr auto const kBlockSize = 0.0015;  // degrees (~150m)
+constexpr auto const kMaxWayBlocks = size_t{8};  // roads are split into ways
+constexpr auto const kRiverWayNodes = size_t{1000};
+constexpr auto const kBufferSize = 64ULL * 1024ULL * 1024ULL;
+
+struct generate_settings : public conf::configuration {
+  generate_settings() : configuration("tiles-generate options", "") {
+    param(osm_fname_, "osm_fname", "/path/to/synthetic.osm.pbf");
+    param(coastlines_fname_, "coastlines_fname", "/path/to/coastlines.zip");
+    param(seed_, "seed", "random seed (same seed: same output)");
+    param(center_, "center", "lat lng of the generated region");
+    param(cities_, "cities", "number of cities");
+    param(blocks_, "blocks", "road grid of a city: blocks per side");
+    param(rivers_, "rivers", "number of rivers");
+    param(river_nodes_, "river_nodes", "nodes per river");
+    param(poi_clusters_, "poi_clusters", "number of poi clusters");
+    param(pois_, "pois", "pois per cluster");
+    param(coastline_nodes_, "coastline_nodes", "nodes of the main land ring");
+    param(islands_, "islands", "number of small islands");
+  }
+
+  std::string osm_fname_{"synthetic.osm.pbf"};
+  std::string coastlines_fname_{"synthetic-coastlines.zip"};
+  unsigned seed_{42};
+  std::vector<double> center_{49.87, 8.65};
+  size_t cities_{4};
+  size_t blocks_{32};
+  size_t rivers_{4};
+  size_t river_nodes_{10'000};
+  size_t poi_clusters_{16};
+  size_t pois_{500};
+  size_t coastline_nodes_{100'000};
+  size_t islands_{100};
+};
+
+using tags_t = std::vector<std::pair<std::string, std::string>>;
+
+template <typename Builder>
+void add_tags(Builder& parent, tags_t const& tags) {
+  ob::TagListBuilder builder{parent};
+  for (auto const& [key, value] : tags) {
+    builder.add_tag(key, value);
+  }
+}
+
+// nodes are streamed to the writer, ways and relations are written after
+// all nodes (.osm.pbf files are sorted by type and id)
+struct osm_generator {
+  osm_generator(osmium::io::Writer& writer, unsigned const seed)
+      : writer_{writer}, gen_{seed} {}
+
+  osmium::object_id_type node(geo::latlng const& pos,
+                              tags_t const& tags = {}) {
+    auto const id = ++node_id_;
+    {
+      ob::NodeBuilder builder{nodes_};
+      builder.set_id(id).set_version(1).set_location(
+          osmium::Location{pos.lng_, pos.lat_});
+      if (!tags.empty()) {
+        add_tags(builder, tags);
+      }
+    }
+    nodes_.commit();
+
+    if (nodes_.committed() > kBufferSize) {
+      writer_(std::move(nodes_));
+      nodes_ = om::Buffer{kBufferSize, om::Buffer::auto_grow::yes};
+    }
+    return id;
+  }
+
+  osmium::object_id_type way(std::vector<osmium::object_id_type> const& refs,
+                             tags_t const& tags) {
+    auto const id = ++way_id_;
+    {
+      ob::WayBuilder builder{ways_};
+      builder.set_id(id).set_version(1);
+      add_tags(builder, tags);
+
+      ob::WayNodeListBuilder wnl{builder};
+      for (auto const ref : refs) {
+        wnl.add_node_ref(osmium::NodeRef{ref});
+      }
+    }
+    ways_.commit();
+    return id;
+  }
+
+  osmium::object_id_type ring(std::vector<geo::latlng> const& corners,
+                              tags_t const& tags) {
+    std::vector<osmium::object_id_type> refs;
+    refs.reserve(corners.size() + 1);
+    for (auto const& pos : corners) {
+      refs.push_back(node(pos));
+    }
+    refs.push_back(refs.front());
+    return way(refs, tags);
+  }
+
+  void multipolygon(osmium::object_id_type const outer,
+                    osmium::object_id_type const inner, tags_t const& tags) {
+    {
+      ob::RelationBuilder builder{relations_};
+      builder.set_id(++relation_id_).set_version(1);
+      add_tags(builder, tags);
+
+      ob::RelationMemberListBuilder members{builder};
+      members.add_member(osmium::item_type::way, outer, "outer");
+      members.add_member(osmium::item_type::way, inner, "inner");
+    }
+    relations_.commit();
+  }
+
+  void finish() {
+    writer_(std::move(nodes_));
+    writer_(std::move(ways_));
+    writer_(std::move(relations_));
+  }
+
+  // road grid, building blocks and multipolygons with holes
+  void city(size_t const idx, geo::latlng const& center, size_t const blocks) {
+    node(center, {{"place", "city"},
+                  {"name", fmt::format("City {}", idx)},
+                  {"population", std::to_string(100'000 * (idx + 1))}});
+
+    std::normal_distribution<double> jitter{0., kBlockSize * 0.02};
+    auto const origin =
+        geo::latlng{center.lat_ - kBlockSize * static_cast<double>(blocks) / 2,
+                    center.lng_ - kBlockSize * static_cast<double>(blocks) / 2};
+    auto const grid_pos = [&](size_t const row, size_t const col) {
+      return geo::latlng{
+          origin.lat_ + kBlockSize * static_cast<double>(row) + jitter(gen_),
+          origin.lng_ + kBlockSize * static_cast<double>(col) + jitter(gen_)};
+    };
+
+    auto const size = blocks + 1;
+    std::vector<osmium::object_id_type> grid(size * size);
+    for (auto row = 0ULL; row < size; ++row) {
+      for (auto col = 0ULL; col < size; ++col) {
+        grid[row * size + col] = node(grid_pos(row, col));
+      }
+    }
+
+    auto const road = [&](size_t const i, bool const horizontal) {
+      tags_t const tags{
+          {"highway", i % 8 == 0 ? "primary" : "residential"},
+          {"name", fmt::format("{} {}-{}", horizontal ? "Street" : "Avenue",
+                               idx, i)}};
+      for (auto lb = size_t{0}; lb < blocks; lb += kMaxWayBlocks) {
+        auto const ub = std::min(blocks, lb + kMaxWayBlocks);
+        std::vector<osmium::object_id_type> refs;
+        for (auto j = lb; j <= ub; ++j) {
+          refs.push_back(horizontal ? grid[i * size + j] : grid[j * size + i]);
+        }
+        way(refs, tags);
+      }
+    };
+    for (auto i = 0ULL; i < size; ++i) {
+      road(i, true);
+      road(i, false);
+    }
+
+    auto const rect = [](geo::latlng const& min, double const extent) {
+      return std::vector<geo::latlng>{
+          min,
+          {min.lat_ + extent, min.lng_},
+          {min.lat_ + extent, min.lng_ + extent},
+          {min.lat_, min.lng_ + extent}};
+    };
+    for (auto row = 0ULL; row < blocks; ++row) {
+      for (auto col = 0ULL; col < blocks; ++col) {
+        auto const min =
+            geo::latlng{origin.lat_ + kBlockSize * static_cast<double>(row),
+                        origin.lng_ + kBlockSize * static_cast<double>(col)};
+
+        if ((row * blocks + col) % 5 == 0) {
+          auto const outer = ring(
+              rect({min.lat_ + kBlockSize * 0.1, min.lng_ + kBlockSize * 0.1},
+                   kBlockSize * 0.8),
+              {});
+          auto const inner = ring(
+              rect({min.lat_ + kBlockSize * 0.4, min.lng_ + kBlockSize * 0.4},
+                   kBlockSize * 0.2),
+              {});
+          multipolygon(outer, inner,
+                       {{"type", "multipolygon"},
+                        {"landuse", (row + col) % 2 == 0 ? "forest" : "park"}});
+          continue;
+        }
+
+        // 2x2 buildings per block
+        for (auto i = 0; i < 4; ++i) {
+          auto const offset_lat = kBlockSize * (0.1 + 0.45 * (i / 2));
+          auto const offset_lng = kBlockSize * (0.1 + 0.45 * (i % 2));
+          ring(rect({min.lat_ + offset_lat, min.lng_ + offset_lng},
+                    kBlockSize * 0.35),
+               {{"building", "yes"}});
+        }
+      }
+    }
+  }
+
+  // random walk with smoothly changing direction, split into ways
+  void river(size_t const idx, geo::latlng pos, size_t const num_nodes) {
+    std::normal_distribution<double> turn{0., 0.1};
+    std::uniform_real_distribution<double> initial_angle{0., 2. * kPi};
+    auto angle = initial_angle(gen_);
+
+    tags_t const tags{{"waterway", "river"},
+                      {"name", fmt::format("River {}", idx)}};
+    std::vector<osmium::object_id_type> refs{node(pos)};
+    for (auto i = 1ULL; i < num_nodes; ++i) {
+      angle += turn(gen_);
+      pos = geo::latlng{pos.lat_ + std::sin(angle) * kBlockSize / 4,
+                        pos.lng_ + std::cos(angle) * kBlockSize / 4};
+      refs.push_back(node(pos));
+
+      if (refs.size() == kRiverWayNodes || i == num_nodes - 1) {
+        way(refs, tags);
+        refs = {refs.back()};  // next way starts at the shared node
+      }
+    }
+  }
+
+  void poi_cluster(geo::latlng const& center, size_t const num_pois) {
+    static constexpr char const* const kAmenities[] = {
+        "restaurant", "cafe", "pharmacy", "bank", "school", "fuel"};
+    std::normal_distribution<double> spread{0., kBlockSize * 2};
+    std::uniform_int_distribution<size_t> amenity{0, std::size(kAmenities) - 1};
+    std::uniform_int_distribution<int64_t> priority{0, 100};
+
+    for (auto i = 0ULL; i < num_pois; ++i) {
+      node({center.lat_ + spread(gen_), center.lng_ + spread(gen_)},
+           {{"amenity", kAmenities[amenity(gen_)]},
+            {"name", fmt::format("POI {}", node_id_ + 1)},
+            {"priority", std::to_string(priority(gen_))}});
+    }
+  }
+
+  osmium::io::Writer& writer_;
+  std::mt19937 gen_;
+
+  om::Buffer nodes_{kBufferSize, om::Buffer::auto_grow::yes};
+  om::Buffer ways_{kBufferSize, om::Buffer::auto_grow::yes};
+  om::Buffer relations_{kBufferSize, om::Buffer::auto_grow::yes};
+
+  osmium::object_id_type node_id_{0}, way_id_{0}, relation_id_{0};
+};
+
+// clockwise ring with jagged radius (degrees)
+std::vector<geo::latlng> make_land_ring(geo::latlng const& center,
+                                        double const radius,
+                                        size_t const num_points,
+                                        std::mt19937& gen) {
+  std::uniform_real_distribution<double> jitter{0.95, 1.0};
+
+  std::vector<geo::latlng> ring;
+  ring.reserve(num_points + 1);
+  for (auto i = 0ULL; i < num_points; ++i) {
+    auto const angle = -2. * kPi * static_cast<double>(i) /
+                       static_cast<double>(num_points);
+    auto const r = radius * jitter(gen);
+    ring.push_back(geo::latlng{center.lat_ + r * std::sin(angle),
+                               center.lng_ + r * std::cos(angle)});
+  }
+  ring.push_back(ring.front());
+  return ring;
+}
+
+int run_tiles_generate(int argc, char const** argv) {
+  generate_settings opt;
+
+  try {
+    conf::options_parser parser({&opt});
+    parser.read_command_line_args(argc, argv, false);
+
+    if (parser.help() || parser.version()) {
+      std::cout << "tiles-generate\n\n";
+      parser.print_help(std::cout);
+      return 0;
+    }
+
+    parser.read_configuration_file(false);
+    parser.print_used(std::cout);
+  } catch (std::exception const& e) {
+    std::cout << "options error: " << e.what() << "\n";
+    return 1;
+  }
+
+  if (opt.center_.size() != 2) {
+    std::cout << "options error: center needs lat and lng\n";
+    return 1;
+  }
+  geo::latlng const center{opt.center_[0], opt.center_[1]};
+
+  std::mt19937 gen{opt.seed_};
+  std::uniform_real_distribution<double> offset{-1., 1.};
+  auto const random_pos = [&] {
+    return geo::latlng{center.lat_ + offset(gen), center.lng_ + offset(gen)};
+  };
+
+  {
+    scoped_timer t{"generate osm"};
+
+    osmium::io::Header header;
+    header.set("generator", "tiles-generate");
+    osmium::io::Writer writer{opt.osm_fname_, header,
+                              osmium::io::overwrite::allow};
+
+    osm_generator osm{writer, opt.seed_};
+    for (auto i = 0ULL; i < opt.cities_; ++i) {
+      osm.city(i, random_pos(), opt.blocks_);
+    }
+    for (auto i = 0ULL; i < opt.rivers_; ++i) {
+      osm.river(i, random_pos(), opt.river_nodes_);
+    }
+    for (auto i = 0ULL; i < opt.poi_clusters_; ++i) {
+      osm.poi_cluster(random_pos(), opt.pois_);
+    }
+    osm.finish();
+    writer.close();
+
+    t_log("generated {} nodes, {} ways, {} relations",
+          printable_num{osm.node_id_}, printable_num{osm.way_id_},
+          printable_num{osm.relation_id_});
+  }
+
+  {
+    scoped_timer t{"generate coastlines"};
+
+    // main land covers all generated objects, islands around it
+    std::vector<shapefile_polygon> polygons;
+    polygons.push_back({make_land_ring(
+        center, 3., std::max(opt.coastline_nodes_, size_t{3}), gen)});
+
+    std::uniform_real_distribution<double> island_angle{0., 2. * kPi};
+    std::uniform_real_distribution<double> island_dist{3.5, 5.};
+    for (auto i = 0ULL; i < opt.islands_; ++i) {
+      auto const angle = island_angle(gen);
+      auto const dist = island_dist(gen);
+      polygons.push_back({make_land_ring(
+          {center.lat_ + dist * std::sin(angle),
+           center.lng_ + dist * std::cos(angle)},
+          0.05, 64, gen)});
+    }
+    write_shapefile(opt.coastlines_fname_, polygons);
+  }
+
+  return 0;
+}
+
+}  // namespace tiles
+
+int main(int argc, char const** argv) {
+  try {
+    return tiles::run_tiles_generate(argc, argv);
+  } catch (std::exception const& e) {
+    tiles::t_log("exception caught: {}", e.what());
+    return 1;
+  } catch (...) {
+    tiles::t_log("unknown exception caught");
+    return 1;
+  }
+}
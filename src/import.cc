@@ -23,9 +23,23 @@ struct import_settings : public conf::configuration {
     param(osm_profile_, "osm_profile", "/path/to/profile.lua");
     param(coastlines_fname_, "coastlines_fname", "/path/to/coastlines.zip");
     param(tmp_dname_, "tmp_dname", "/path/to/tmp/directory");
+    param(node_idx_, "node_idx",
+          "node location store: 'hybrid' (compact) or 'dense' (flat array, "
+          "needs 8 byte * max node id of memory/disk)");
+    param(metadata_dict_size_, "metadata_dict_size",
+          "max. number of key/value pairs in the shared metadata dictionary "
+          "(memory during import is proportional)");
     param(tasks_, "tasks",
           "'all' or any combination of: 'coastlines', "
           "'features', 'stats', 'pack', 'tiles'");
+    param(point_grid_, "point_grid",
+          "point thinning per layer: 'layer:cell_px,...' (e.g. 'poi:16'), "
+          "keeps the point with the highest priority per grid cell");
+    param(max_tile_bytes_, "max_tile_bytes",
+          "tile byte budget (0: unlimited), drops lowest priority first");
+    param(priority_key_, "priority_key",
+          "feature metadata key (integer/numeric) ranking the features for "
+          "point_grid and max_tile_bytes (missing: priority zero)");
   }
 
   bool has_any_task(std::vector<std::string> const& query) const {
@@ -40,7 +54,12 @@ struct import_settings : public conf::configuration {
   std::string osm_profile_{"../profile/profile.lua"};
   std::string coastlines_fname_{"land-polygons-complete-4326.zip"};
   std::string tmp_dname_{"."};
+  std::string node_idx_{"hybrid"};
+  size_t metadata_dict_size_{1'000'000};
   std::vector<std::string> tasks_{{"all"}};
+  std::string point_grid_;
+  size_t max_tile_bytes_{0};
+  std::string priority_key_{"priority"};
 };
 
 int run_tiles_import(int argc, char const** argv) {
@@ -65,6 +84,14 @@ int run_tiles_import(int argc, char const** argv) {
 
   if (opt.has_any_task({"features"})) {
     check_profile(opt.osm_profile_);
+    if (opt.node_idx_ != "hybrid" && opt.node_idx_ != "dense") {
+      std::cout << "options error: unknown node_idx " << opt.node_idx_ << "\n";
+      return 1;
+    }
+    if (opt.metadata_dict_size_ == 0) {
+      std::cout << "options error: metadata_dict_size must be positive\n";
+      return 1;
+    }
   }
 
   if (opt.has_any_task({"coastlines", "features"})) {
@@ -89,7 +116,10 @@ int run_tiles_import(int argc, char const** argv) {
     if (opt.has_any_task({"features"})) {
       t_log("load features");
       load_osm(db_handle, inserter, opt.osm_fname_, opt.osm_profile_,
-               opt.tmp_dname_);
+               opt.tmp_dname_,
+               opt.node_idx_ == "dense" ? node_idx_type::dense
+                                        : node_idx_type::hybrid,
+               opt.metadata_dict_size_);
     }
   }
 
@@ -104,7 +134,8 @@ int run_tiles_import(int argc, char const** argv) {
 
   if (opt.has_any_task({"tiles"})) {
     t_log("prepare tiles");
-    prepare_tiles(db_handle, pack_handle, 10);
+    prepare_tiles(db_handle, pack_handle, 10, opt.point_grid_,
+                  opt.max_tile_bytes_, opt.priority_key_);
   }
 
   t_log("import done!");
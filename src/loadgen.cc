@@ -0,0 +1,411 @@
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "boost/asio.hpp"
+#include "boost/beast/core.hpp"
+#include "boost/beast/http.hpp"
+
+#include "conf/configuration.h"
+#include "conf/options_parser.h"
+
+#include "fmt/core.h"
+#include "fmt/ostream.h"
+
+#include "tiles/util.h"
+#include "tiles/workload.h"
+
+namespace beast = boost::beast;  // from "boost/beast.hpp"
+namespace http = beast::http;  // from "boost/beast/http.hpp"
+namespace net = boost::asio;  // from "boost/asio.hpp"
+using tcp = boost::asio::ip::tcp;  // from "boost/asio/ip/tcp.hpp"
+
+namespace tiles {
+
+struct loadgen_settings : public conf::configuration {
+  loadgen_settings() : configuration("tiles-loadgen options", "") {
+    param(host_, "host", "tiles-server host");
+    param(port_, "port", "tiles-server port");
+    param(workload_, "workload",
+          "workload file: one z/x/y per line (see tiles-benchmark "
+          "write_workload), requested in order");
+    param(concurrency_, "concurrency", "number of concurrent connections");
+    param(threads_, "threads", "load generator io threads");
+    param(keep_alive_, "keep_alive",
+          "reuse connections (otherwise: one connection per request)");
+    param(accept_encoding_, "accept_encoding", "Accept-Encoding header");
+    param(requests_, "requests",
+          "number of requests (0: every workload tile once), the workload "
+          "is repeated if necessary");
+    param(duration_, "duration",
+          "run for this many seconds instead (repeating the workload)");
+    param(metrics_, "metrics", "print the server /metrics deltas");
+  }
+
+  std::string host_{"127.0.0.1"};
+  std::string port_{"8888"};
+  std::string workload_;
+  size_t concurrency_{16};
+  size_t threads_{1};
+  bool keep_alive_{true};
+  std::string accept_encoding_{"deflate"};
+  size_t requests_{0};
+  size_t duration_{0};
+  bool metrics_{true};
+};
+
+using load_clock = std::chrono::steady_clock;
+using latency_t = std::chrono::microseconds;
+
+// per connection (only touched by its handlers), merged at the end
+struct load_stats {
+  void merge(load_stats const& o) {
+    latencies_.insert(end(latencies_), begin(o.latencies_),
+                      end(o.latencies_));
+    for (auto const& [status, count] : o.status_) {
+      status_[status] += count;
+    }
+    errors_ += o.errors_;
+    connects_ += o.connects_;
+    bytes_ += o.bytes_;
+    body_bytes_ += o.body_bytes_;
+  }
+
+  std::vector<latency_t> latencies_;  // successful round trips
+  std::map<unsigned, size_t> status_;
+  size_t errors_{0};  // connect, write or read failed
+  size_t connects_{0};
+  size_t bytes_{0}, body_bytes_{0};  // received
+};
+
+struct load_state {
+  std::optional<size_t> next_target() {
+    auto const idx = next_++;
+    if (deadline_ ? load_clock::now() >= *deadline_ : idx >= limit_) {
+      return std::nullopt;
+    }
+    return idx % targets_.size();
+  }
+
+  std::vector<std::string> targets_;
+  size_t limit_{0};
+  std::optional<load_clock::time_point> deadline_;
+  std::atomic_size_t next_{0};
+};
+
+struct client_connection
+    : public std::enable_shared_from_this<client_connection> {
+  client_connection(net::io_context& ioc,
+                    tcp::resolver::results_type const& endpoints,
+                    load_state& state, loadgen_settings const& opt)
+      : socket_{net::make_strand(ioc)},
+        endpoints_{endpoints},
+        state_{state},
+        opt_{opt} {}
+
+  void next() {
+    auto const idx = state_.next_target();
+    if (!idx) {
+      close();
+      return;
+    }
+
+    req_ = http::request<http::empty_body>{http::verb::get,
+                                           state_.targets_[*idx], 11};
+    req_.set(http::field::host, opt_.host_ + ":" + opt_.port_);
+    if (!opt_.accept_encoding_.empty()) {
+      req_.set(http::field::accept_encoding, opt_.accept_encoding_);
+    }
+    req_.keep_alive(opt_.keep_alive_);
+
+    start_ = load_clock::now();  // latency includes a (re)connect
+    if (socket_.is_open()) {
+      write();
+    } else {
+      connect();
+    }
+  }
+
+  void connect() {
+    auto self = shared_from_this();
+    net::async_connect(socket_, endpoints_,
+                       [self](beast::error_code ec, tcp::endpoint const&) {
+                         if (ec) {
+                           self->fail();
+                           return;
+                         }
+                         ++self->stats_.connects_;
+                         self->write();
+                       });
+  }
+
+  void write() {
+    auto self = shared_from_this();
+    http::async_write(socket_, req_, [self](beast::error_code ec, size_t) {
+      if (ec) {
+        self->fail();
+        return;
+      }
+      self->read();
+    });
+  }
+
+  void read() {
+    auto self = shared_from_this();
+    res_ = {};
+    http::async_read(
+        socket_, buffer_, res_, [self](beast::error_code ec, size_t bytes) {
+          if (ec) {
+            self->fail();
+            return;
+          }
+
+          auto& stats = self->stats_;
+          stats.latencies_.push_back(std::chrono::duration_cast<latency_t>(
+              load_clock::now() - self->start_));
+          ++stats.status_[self->res_.result_int()];
+          stats.bytes_ += bytes;
+          stats.body_bytes_ += self->res_.body().size();
+
+          if (!self->res_.keep_alive()) {
+            self->close();
+          }
+          self->next();
+        });
+  }
+
+  void fail() {
+    ++stats_.errors_;
+    close();
+    next();
+  }
+
+  void close() {
+    beast::error_code ec;
+    socket_.shutdown(tcp::socket::shutdown_both, ec);
+    socket_.close(ec);
+    buffer_.clear();
+  }
+
+  tcp::socket socket_;
+  tcp::resolver::results_type endpoints_;
+  load_state& state_;
+  loadgen_settings const& opt_;
+
+  beast::flat_buffer buffer_{8192};
+  http::request<http::empty_body> req_;
+  http::response<http::string_body> res_;
+  load_clock::time_point start_;
+
+  load_stats stats_;
+};
+
+std::optional<std::map<std::string, double>> scrape_metrics(
+    loadgen_settings const& opt) {
+  try {
+    net::io_context ioc;
+    tcp::resolver resolver{ioc};
+    tcp::socket socket{ioc};
+    net::connect(socket, resolver.resolve(opt.host_, opt.port_));
+
+    http::request<http::empty_body> req{http::verb::get, "/metrics", 11};
+    req.set(http::field::host, opt.host_ + ":" + opt.port_);
+    req.keep_alive(false);
+    http::write(socket, req);
+
+    beast::flat_buffer buffer;
+    http::response<http::string_body> res;
+    http::read(socket, buffer, res);
+
+    beast::error_code ec;
+    socket.shutdown(tcp::socket::shutdown_both, ec);
+
+    if (res.result() != http::status::ok) {
+      t_log("metrics: server responded {}", res.result_int());
+      return std::nullopt;
+    }
+
+    // prometheus text format: "name{labels} value", comments start with #
+    std::map<std::string, double> metrics;
+    std::string_view body{res.body()};
+    while (!body.empty()) {
+      auto const eol = body.find('\n');
+      auto const line = body.substr(0, eol);
+      body = eol == std::string_view::npos ? "" : body.substr(eol + 1);
+
+      auto const space = line.rfind(' ');
+      if (line.empty() || line[0] == '#' || space == std::string_view::npos) {
+        continue;
+      }
+      metrics[std::string{line.substr(0, space)}] =
+          std::stod(std::string{line.substr(space + 1)});
+    }
+    return metrics;
+  } catch (std::exception const& e) {
+    t_log("metrics: scrape failed: {}", e.what());
+    return std::nullopt;
+  }
+}
+
+void print_report(load_stats& stats, loadgen_settings const& opt,
+                  std::chrono::milliseconds const duration) {
+  auto const seconds =
+      std::max(1., static_cast<double>(duration.count())) / 1e3;
+  auto const completed = stats.latencies_.size();
+  auto const total = completed + stats.errors_;
+
+  fmt::print(std::cout,
+             "=== {} requests in {:.2f}s -> {:.1f} req/s ({} connections, "
+             "{} connects, keep-alive {})\n",
+             total, seconds, static_cast<double>(completed) / seconds,
+             opt.concurrency_, stats.connects_, opt.keep_alive_ ? "on" : "off");
+
+  if (!stats.latencies_.empty()) {
+    auto& lat = stats.latencies_;
+    std::sort(begin(lat), end(lat));
+    auto const mean = std::accumulate(begin(lat), end(lat), latency_t{0}) /
+                      static_cast<latency_t::rep>(lat.size());
+    fmt::print(std::cout, "{:>10} {:>10} {:>10} {:>10} {:>10} {:>10}\n",
+               "mean[us]", "p50[us]", "p90[us]", "p99[us]", "p99.9[us]",
+               "max[us]");
+    fmt::print(std::cout, "{:>10} {:>10} {:>10} {:>10} {:>10} {:>10}\n",
+               mean.count(), percentile(lat, 50).count(),
+               percentile(lat, 90).count(), percentile(lat, 99).count(),
+               percentile(lat, 99.9).count(), lat.back().count());
+  }
+
+  auto http_errors = size_t{0};
+  for (auto const& [status, count] : stats.status_) {
+    fmt::print(std::cout, "status {}: {}\n", status, count);
+    if (status >= 400) {
+      http_errors += count;
+    }
+  }
+
+  auto const rate = [&](size_t const n) {
+    return total == 0 ? 0. : 100. * static_cast<double>(n) / total;
+  };
+  fmt::print(std::cout,
+             "errors: {} transport ({:.2f}%), {} http >= 400 ({:.2f}%)\n",
+             stats.errors_, rate(stats.errors_), http_errors,
+             rate(http_errors));
+  fmt::print(std::cout, "received: {} ({} body) -> {}/s\n",
+             printable_bytes{stats.bytes_}, printable_bytes{stats.body_bytes_},
+             printable_bytes{static_cast<double>(stats.bytes_) / seconds});
+}
+
+void print_metrics_delta(std::map<std::string, double> const& before,
+                         std::map<std::string, double> const& after) {
+  std::cout << "=== server /metrics deltas\n";
+  for (auto const& [name, value] : after) {
+    auto const it = before.find(name);
+    auto const delta = value - (it == end(before) ? 0. : it->second);
+    fmt::print(std::cout, "{:<42} {:>16.0f}\n", name, delta);
+  }
+}
+
+int run_tiles_loadgen(int argc, char const** argv) {
+  loadgen_settings opt;
+
+  try {
+    conf::options_parser parser({&opt});
+    parser.read_command_line_args(argc, argv, false);
+
+    if (parser.help() || parser.version()) {
+      std::cout << "tiles-loadgen\n\n";
+      parser.print_help(std::cout);
+      return 0;
+    }
+
+    parser.read_configuration_file(false);
+    parser.print_used(std::cout);
+  } catch (std::exception const& e) {
+    std::cout << "options error: " << e.what() << "\n";
+    return 1;
+  }
+
+  if (opt.workload_.empty() || opt.concurrency_ == 0) {
+    std::cout << "options error: need a workload and concurrency > 0\n";
+    return 1;
+  }
+
+  load_state state;
+  auto const workload = read_workload(opt.workload_);
+  for (auto const& tile : workload.tiles_) {
+    state.targets_.push_back(
+        fmt::format("/{}/{}/{}.mvt", tile.z_, tile.x_, tile.y_));
+  }
+  utl::verify(!state.targets_.empty(), "empty workload {}", opt.workload_);
+  state.limit_ = opt.requests_ != 0 ? opt.requests_ : state.targets_.size();
+  if (opt.duration_ != 0) {
+    state.limit_ = std::numeric_limits<size_t>::max();
+  }
+
+  auto const metrics_before =
+      opt.metrics_ ? scrape_metrics(opt) : std::nullopt;
+
+  net::io_context ioc{static_cast<int>(std::max(opt.threads_, size_t{1}))};
+  tcp::resolver resolver{ioc};
+  auto const endpoints = resolver.resolve(opt.host_, opt.port_);
+
+  auto const start = load_clock::now();
+  if (opt.duration_ != 0) {
+    state.deadline_ = start + std::chrono::seconds{opt.duration_};
+  }
+
+  std::vector<std::shared_ptr<client_connection>> connections;
+  for (auto i = 0ULL; i < opt.concurrency_; ++i) {
+    connections.push_back(
+        std::make_shared<client_connection>(ioc, endpoints, state, opt));
+    connections.back()->next();
+  }
+
+  std::vector<std::thread> threads;
+  for (auto i = 1ULL; i < opt.threads_; ++i) {
+    threads.emplace_back([&ioc] { ioc.run(); });
+  }
+  ioc.run();
+  std::for_each(begin(threads), end(threads), [](auto& t) { t.join(); });
+
+  auto const duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+      load_clock::now() - start);
+
+  load_stats stats;
+  for (auto const& c : connections) {
+    stats.merge(c->stats_);
+  }
+  print_report(stats, opt, duration);
+
+  if (metrics_before) {
+    if (auto const metrics_after = scrape_metrics(opt); metrics_after) {
+      print_metrics_delta(*metrics_before, *metrics_after);
+    }
+  }
+
+  return 0;
+}
+
+}  // namespace tiles
+
+int main(int argc, char const** argv) {
+  try {
+    return tiles::run_tiles_loadgen(argc, argv);
+  } catch (std::exception const& e) {
+    tiles::t_log("exception caught: {}", e.what());
+    return 1;
+  } catch (...) {
+    tiles::t_log("unknown exception caught");
+    return 1;
+  }
+}
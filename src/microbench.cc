@@ -0,0 +1,611 @@
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "conf/configuration.h"
+#include "conf/options_parser.h"
+
+#include "fmt/core.h"
+#include "fmt/ostream.h"
+
+#include "osmium/index/detail/tmpfile.hpp"
+
+#include "protozero/pbf_builder.hpp"
+
+#include "tiles/bin_utils.h"
+#include "tiles/db/bq_tree.h"
+#include "tiles/db/pack_file.h"
+#include "tiles/db/quad_tree.h"
+#include "tiles/feature/deserialize.h"
+#include "tiles/feature/serialize.h"
+#include "tiles/fixed/algo/clip.h"
+#include "tiles/fixed/algo/make_simplify_mask.h"
+#include "tiles/fixed/algo/shift.h"
+#include "tiles/fixed/io/deserialize.h"
+#include "tiles/fixed/io/serialize.h"
+#include "tiles/mvt/encode_geometry.h"
+#include "tiles/mvt/tile_spec.h"
+#include "tiles/osm/hybrid_node_idx.h"
+#include "tiles/util.h"
+
+namespace tiles {
+
+constexpr auto const kPi = 3.14159265358979323846;
+constexpr auto const kSeed = 42U;  // fixed inputs: comparable across runs
+
+// z10 tile, geometries cover it and its neighbors (i.e. are clipped)
+geo::tile const kTile{536, 347, 10};
+
+struct microbench_settings : public conf::configuration {
+  microbench_settings() : configuration("tiles-microbench options", "") {
+    param(filter_, "filter", "regex (full match) of the benchmarks to run");
+    param(list_, "list", "only list the benchmark names");
+    param(repetitions_, "repetitions", "measured repetitions per benchmark");
+    param(min_time_ms_, "min_time_ms",
+          "min duration of one repetition (iterations are calibrated)");
+    param(format_, "format", "output format: json (one object per line), csv");
+    param(output_, "output", "output file (- for stdout)");
+  }
+
+  std::string filter_{".*"};
+  bool list_{false};
+  size_t repetitions_{15};
+  size_t min_time_ms_{20};
+  std::string format_{"json"};
+  std::string output_{"-"};
+};
+
+// fn processes a fixed batch of "items" (e.g. queries) per call and returns
+// a checksum (consumed, so the compiler can not drop the work)
+struct microbench {
+  std::string name_;
+  size_t items_;  // per call
+  size_t bytes_;  // per call (0: not applicable)
+  std::function<size_t()> fn_;
+};
+
+struct microbench_result {
+  std::string name_;
+  size_t items_, bytes_, iterations_, repetitions_;
+  double min_, median_, mean_, max_, mad_;  // ns per item
+};
+
+size_t volatile microbench_sink = 0;
+
+double run_batch(microbench const& bench, size_t const iterations) {
+  using clock = std::chrono::steady_clock;
+  auto const start = clock::now();
+  auto checksum = size_t{0};
+  for (auto i = 0ULL; i < iterations; ++i) {
+    checksum += bench.fn_();
+  }
+  auto const stop = clock::now();
+  microbench_sink = microbench_sink + checksum;
+  return std::chrono::duration<double, std::nano>(stop - start).count();
+}
+
+double median_of(std::vector<double> v) {
+  std::sort(begin(v), end(v));
+  auto const n = v.size();
+  return n % 2 == 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2.;
+}
+
+microbench_result run_microbench(microbench const& bench,
+                                 microbench_settings const& opt) {
+  // calibrate: double the iterations until one batch takes min_time
+  // (the last calibration batch doubles as warmup)
+  auto const min_time = static_cast<double>(opt.min_time_ms_) * 1e6;
+  auto iterations = size_t{1};
+  while (true) {
+    auto const elapsed = run_batch(bench, iterations);
+    if (elapsed >= min_time) {
+      break;
+    }
+    iterations = elapsed <= 0.
+                     ? iterations * 2
+                     : std::max(iterations * 2,
+                                static_cast<size_t>(
+                                    static_cast<double>(iterations) *
+                                    min_time / elapsed * 1.1));
+  }
+
+  auto const items = static_cast<double>(iterations * bench.items_);
+  std::vector<double> samples;
+  for (auto i = 0ULL; i < std::max(opt.repetitions_, size_t{1}); ++i) {
+    samples.push_back(run_batch(bench, iterations) / items);
+  }
+
+  // median and median absolute deviation: robust against outliers
+  // (interrupts, frequency scaling) -- mean and max are reported, too
+  auto const median = median_of(samples);
+  std::vector<double> deviations;
+  for (auto const s : samples) {
+    deviations.push_back(std::abs(s - median));
+  }
+
+  return {bench.name_,
+          bench.items_,
+          bench.bytes_,
+          iterations,
+          samples.size(),
+          *std::min_element(begin(samples), end(samples)),
+          median,
+          std::accumulate(begin(samples), end(samples), 0.) /
+              static_cast<double>(samples.size()),
+          *std::max_element(begin(samples), end(samples)),
+          median_of(deviations)};
+}
+
+void write_header(std::ostream& out, std::string const& format) {
+  if (format == "csv") {
+    out << "name,items,bytes,iterations,repetitions,ns_min,ns_median,ns_mean,"
+           "ns_max,ns_mad,mb_per_s\n";
+  }
+}
+
+void write_result(std::ostream& out, std::string const& format,
+                  microbench_result const& r) {
+  // throughput of the median, bytes per item
+  auto const mb_per_s =
+      r.bytes_ == 0 ? 0.
+                    : static_cast<double>(r.bytes_) /
+                          static_cast<double>(r.items_) / r.median_ * 1e3;
+  if (format == "csv") {
+    out << fmt::format(
+               "{},{},{},{},{},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f}",
+               r.name_, r.items_, r.bytes_, r.iterations_, r.repetitions_,
+               r.min_, r.median_, r.mean_, r.max_, r.mad_, mb_per_s)
+        << std::endl;
+  } else {
+    out << fmt::format(
+               "{{\"name\":\"{}\",\"items\":{},\"bytes\":{},\"iterations\":{},"
+               "\"repetitions\":{},\"ns_min\":{:.3f},\"ns_median\":{:.3f},"
+               "\"ns_mean\":{:.3f},\"ns_max\":{:.3f},\"ns_mad\":{:.3f},"
+               "\"mb_per_s\":{:.3f}}}",
+               r.name_, r.items_, r.bytes_, r.iterations_, r.repetitions_,
+               r.min_, r.median_, r.mean_, r.max_, r.mad_, mb_per_s)
+        << std::endl;
+  }
+}
+
+// --- synthetic inputs
+
+fixed_box input_bounds() {
+  // the tile and half of its neighbors on each side
+  tile_spec const spec{kTile};
+  auto const& b = spec.draw_bounds_;
+  auto const dx = (b.max_corner().x() - b.min_corner().x()) / 2;
+  auto const dy = (b.max_corner().y() - b.min_corner().y()) / 2;
+  return {{b.min_corner().x() - dx, b.min_corner().y() - dy},
+          {b.max_corner().x() + dx, b.max_corner().y() + dy}};
+}
+
+fixed_point make_points(std::mt19937& gen, size_t const count) {
+  auto const box = input_bounds();
+  std::uniform_int_distribution<fixed_coord_t> x_dist{box.min_corner().x(),
+                                                      box.max_corner().x()};
+  std::uniform_int_distribution<fixed_coord_t> y_dist{box.min_corner().y(),
+                                                      box.max_corner().y()};
+  fixed_point points;
+  for (auto i = 0ULL; i < count; ++i) {
+    points.emplace_back(x_dist(gen), y_dist(gen));
+  }
+  return points;
+}
+
+// random walk (a road or river) across the input bounds
+fixed_polyline make_polyline(std::mt19937& gen, size_t const count) {
+  auto const box = input_bounds();
+  auto const step = (box.max_corner().x() - box.min_corner().x()) /
+                    static_cast<fixed_coord_t>(count);
+  std::uniform_int_distribution<fixed_coord_t> y_step{-step, step};
+
+  fixed_line line;
+  auto y = (box.min_corner().y() + box.max_corner().y()) / 2;
+  for (auto i = 0ULL; i < count; ++i) {
+    y = std::clamp(y + y_step(gen), box.min_corner().y(),
+                   box.max_corner().y());
+    line.emplace_back(box.min_corner().x() + static_cast<fixed_coord_t>(i) *
+                                                 step,
+                      y);
+  }
+  return fixed_polyline{line};
+}
+
+fixed_ring make_ring(std::mt19937& gen, fixed_xy const& center,
+                     double const radius, size_t const count) {
+  std::uniform_real_distribution<double> jitter{0.8, 1.0};
+  fixed_ring ring;
+  for (auto i = 0ULL; i < count; ++i) {
+    auto const angle =
+        2. * kPi * static_cast<double>(i) / static_cast<double>(count);
+    auto const r = radius * jitter(gen);
+    ring.emplace_back(
+        center.x() + static_cast<fixed_coord_t>(r * std::cos(angle)),
+        center.y() + static_cast<fixed_coord_t>(r * std::sin(angle)));
+  }
+  ring.push_back(ring.front());
+  return ring;
+}
+
+// a lake with islands, larger than the tile
+fixed_polygon make_polygon(std::mt19937& gen, size_t const count) {
+  auto const box = input_bounds();
+  fixed_xy const center{(box.min_corner().x() + box.max_corner().x()) / 2,
+                        (box.min_corner().y() + box.max_corner().y()) / 2};
+  auto const radius =
+      static_cast<double>(box.max_corner().x() - box.min_corner().x()) / 2.;
+
+  fixed_simple_polygon simple;
+  simple.outer() = make_ring(gen, center, radius, count);
+  for (auto i = 0; i < 4; ++i) {
+    auto const angle = kPi / 2. * i;
+    simple.inners().push_back(make_ring(
+        gen,
+        {center.x() + static_cast<fixed_coord_t>(radius / 2. * std::cos(angle)),
+         center.y() +
+             static_cast<fixed_coord_t>(radius / 2. * std::sin(angle))},
+        radius / 8., count / 8));
+  }
+
+  fixed_polygon polygon{simple};
+  boost::geometry::correct(polygon);
+  return polygon;
+}
+
+feature make_feature(std::mt19937& gen, uint64_t const id,
+                     fixed_geometry geometry) {
+  auto const string_value = [](std::string const& str) {
+    std::string value;
+    append(value, metadata_value_t::string);
+    value.append(str);
+    return value;
+  };
+  std::string integer;
+  append(integer, metadata_value_t::integer);
+  append(integer, static_cast<int64_t>(gen() % 1000));
+
+  feature f;
+  f.id_ = id;
+  f.layer_ = 1;
+  f.zoom_levels_ = {8, kMaxZoomLevel};
+  f.meta_ = {{"highway", string_value("residential")},
+             {"name", string_value(fmt::format("street {}", id))},
+             {"oneway", string_value("yes")},
+             {"maxspeed", integer}};
+  f.geometry_ = std::move(geometry);
+  return f;
+}
+
+// preorder, children in quad_pos order (see make_quad_tree)
+void make_quad_tree_input(std::mt19937& gen, geo::tile const& tile,
+                          uint32_t const max_z, uint32_t& offset,
+                          std::vector<quad_tree_input>& input) {
+  if (tile.z_ == kTile.z_ || gen() % 16 == 0) {
+    input.push_back({tile, offset++, 1});
+  }
+  if (tile.z_ == max_z) {
+    return;
+  }
+
+  std::vector<geo::tile> children;
+  for (auto i = 0U; i < 4; ++i) {
+    children.push_back(geo::tile{2 * tile.x_ + (i & 1U),
+                                 2 * tile.y_ + (i >> 1U), tile.z_ + 1});
+  }
+  std::sort(begin(children), end(children), [](auto const& a, auto const& b) {
+    return a.quad_pos() < b.quad_pos();
+  });
+  for (auto const& child : children) {
+    make_quad_tree_input(gen, child, max_z, offset, input);
+  }
+}
+
+std::vector<geo::tile> make_random_tiles(std::mt19937& gen,
+                                         geo::tile const& root,
+                                         uint32_t const max_z,
+                                         size_t const count) {
+  std::uniform_int_distribution<uint32_t> z_dist{root.z_, max_z};
+  std::vector<geo::tile> tiles;
+  for (auto i = 0ULL; i < count; ++i) {
+    auto const z = z_dist(gen);
+    auto const dz = z - root.z_;
+    std::uniform_int_distribution<uint32_t> offset_dist{0, (1U << dz) - 1};
+    tiles.push_back(geo::tile{(root.x_ << dz) + offset_dist(gen),
+                              (root.y_ << dz) + offset_dist(gen), z});
+  }
+  return tiles;
+}
+
+// --- benchmarks
+
+std::vector<microbench> make_microbenchs() {
+  std::vector<microbench> benchs;
+  auto const add = [&](std::string name, size_t const items,
+                       size_t const bytes, std::function<size_t()> fn) {
+    benchs.push_back({std::move(name), items, bytes, std::move(fn)});
+  };
+
+  std::mt19937 gen{kSeed};
+  tile_spec const spec{kTile};
+  auto const z = kTile.z_;
+
+  auto const points = fixed_geometry{make_points(gen, 1024)};
+  auto const polyline = fixed_geometry{make_polyline(gen, 4096)};
+  auto const polygon = fixed_geometry{make_polygon(gen, 8192)};
+
+  {  // feature (de)serialization
+    shared_metadata_decoder const decoder;
+    auto const line_feature =
+        serialize_feature(make_feature(gen, 1, polyline), {}, false);
+    add("deserialize_feature/polyline", 1, line_feature.size(), [=] {
+      auto const f = deserialize_feature(line_feature, decoder);
+      return f->meta_.size();
+    });
+    add("deserialize_feature/polyline_z10", 1, line_feature.size(), [=] {
+      auto const f = deserialize_feature(
+          line_feature, decoder,
+          {{kInvalidBoxHint, kInvalidBoxHint},
+           {kInvalidBoxHint, kInvalidBoxHint}},
+          z);
+      return f->meta_.size();
+    });
+
+    auto const geo = serialize(polygon);
+    auto const masks = make_simplify_mask(polygon);
+    add("deserialize/polygon", 1, geo.size(), [=] {
+      return mpark::get<fixed_polygon>(deserialize(geo)).size();
+    });
+    for (auto const mask_z : {6U, 10U, 14U}) {
+      add(fmt::format("deserialize/polygon_mask_z{}", mask_z), 1, geo.size(),
+          [=] {
+            std::vector<std::string_view> views(begin(masks), end(masks));
+            return mpark::get<fixed_polygon>(
+                       deserialize(geo, std::move(views), mask_z))
+                .size();
+          });
+    }
+  }
+
+  {  // render pipeline: clip -> shift -> encode
+    for (auto const& [name, geometry] :
+         {std::pair{"point", points}, std::pair{"polyline", polyline},
+          std::pair{"polygon", polygon}}) {
+      add(fmt::format("clip/{}", name), 1, 0, [spec, geometry = geometry] {
+        return clip(geometry, spec.draw_bounds_).index();
+      });
+
+      auto const clipped = clip(geometry, spec.draw_bounds_);
+      add(fmt::format("shift/{}", name), 1, 0, [=] {
+        return shift(clipped, z).index();  // includes the copy
+      });
+
+      auto const shifted = shift(clipped, z);
+      add(fmt::format("encode_geometry/{}", name), 1, 0,
+          [=, buf = std::string{}]() mutable {
+            buf.clear();
+            protozero::pbf_builder<tags::mvt::Feature> pb{buf};
+            encode_geometry(pb, shifted, spec);
+            return buf.size();
+          });
+    }
+  }
+
+  {  // quad tree of a feature pack
+    std::vector<quad_tree_input> input;
+    auto offset = uint32_t{0};
+    make_quad_tree_input(gen, kTile, kTile.z_ + 8, offset, input);
+    auto const tree = make_quad_tree(kTile, input);
+    auto const queries = make_random_tiles(gen, kTile, kTile.z_ + 8, 1024);
+    add("walk_quad_tree", queries.size(), 0, [=] {
+      auto sum = size_t{0};
+      for (auto const& q : queries) {
+        walk_quad_tree(tree.data(), kTile, q,
+                       [&](auto const node_offset, auto const node_size) {
+                         sum += node_offset + node_size;
+                       });
+      }
+      return sum;
+    });
+  }
+
+  {  // bq_tree of the seaside tiles: a few "continents" at z9
+    constexpr auto const kZ = 9U;
+    std::uniform_int_distribution<uint32_t> pos_dist{0, (1U << kZ) - 1};
+    std::uniform_int_distribution<uint32_t> radius_dist{16, 96};
+    std::vector<std::tuple<int64_t, int64_t, int64_t>> circles;
+    for (auto i = 0; i < 8; ++i) {
+      circles.emplace_back(pos_dist(gen), pos_dist(gen), radius_dist(gen));
+    }
+    std::vector<geo::tile> tiles;
+    for (auto y = 0U; y < (1U << kZ); ++y) {
+      for (auto x = 0U; x < (1U << kZ); ++x) {
+        if (std::any_of(begin(circles), end(circles), [&](auto const& c) {
+              auto const [cx, cy, r] = c;
+              return (x - cx) * (x - cx) + (y - cy) * (y - cy) <= r * r;
+            })) {
+          tiles.push_back(geo::tile{x, y, kZ});
+        }
+      }
+    }
+
+    auto const tree = make_bq_tree(tiles);
+    auto bitmap_tree = tree;
+    bitmap_tree.materialize_bitmap();
+
+    auto const queries = make_random_tiles(gen, {0, 0, 0}, 14, 1024);
+    add("bq_tree/contains", queries.size(), 0, [=] {
+      return static_cast<size_t>(std::count_if(
+          begin(queries), end(queries),
+          [&](auto const& q) { return tree.contains(q); }));
+    });
+    add("bq_tree/contains_bitmap", queries.size(), 0, [=] {
+      return static_cast<size_t>(std::count_if(
+          begin(queries), end(queries),
+          [&](auto const& q) { return bitmap_tree.contains(q); }));
+    });
+
+    auto const leaf_queries = make_random_tiles(gen, {0, 0, 0}, 6, 64);
+    add("bq_tree/all_leafs", leaf_queries.size(), 0, [=] {
+      auto sum = size_t{0};
+      for (auto const& q : leaf_queries) {
+        sum += tree.all_leafs(q).size();
+      }
+      return sum;
+    });
+  }
+
+  {  // pack records of one tile
+    std::vector<pack_record> records;
+    for (auto i = 0ULL; i < 64 * 1024; ++i) {
+      records.emplace_back(gen(), gen() % 4096);
+    }
+    auto const dat = pack_records_serialize(records);
+    add("pack_records_foreach", records.size(), dat.size(), [=] {
+      auto sum = size_t{0};
+      pack_records_foreach(dat, [&](auto const& r) { sum += r.size_; });
+      return sum;
+    });
+  }
+
+  {  // a tile sized buffer of serialized features
+    std::string buf;
+    for (auto i = 0ULL; buf.size() < 256 * 1024; ++i) {
+      buf.append(serialize_feature(
+          make_feature(gen, i, make_polyline(gen, 64 + gen() % 256))));
+    }
+    add("compress_deflate", 1, buf.size(),
+        [=] { return compress_deflate(buf).size(); });
+  }
+
+  {  // node locations of ways
+    auto const idx_fd = osmium::detail::create_tmp_file();
+    auto const dat_fd = osmium::detail::create_tmp_file();
+
+    std::vector<osmium::object_id_type> ids;
+    {
+      hybrid_node_idx_builder builder{idx_fd, dat_fd};
+      std::uniform_int_distribution<fixed_coord_t> step{-1000, 1000};
+      auto id = osmium::object_id_type{0};
+      auto x = fixed_coord_t{hybrid_node_idx::x_offset};
+      auto y = fixed_coord_t{hybrid_node_idx::y_offset};
+      for (auto i = 0ULL; i < 1'000'000; ++i) {
+        id += gen() % 8 == 0 ? 1 + gen() % 1000 : 1;  // sparse ranges
+        x += step(gen);
+        y += step(gen);
+        builder.push(id, {x, y});
+        ids.push_back(id);
+      }
+      builder.finish();
+    }
+    auto const nodes = std::make_shared<hybrid_node_idx>(idx_fd, dat_fd);
+
+    std::vector<osmium::object_id_type> queries;
+    std::uniform_int_distribution<size_t> idx_dist{0, ids.size() - 1};
+    for (auto i = 0; i < 1024; ++i) {
+      queries.push_back(ids[idx_dist(gen)]);
+    }
+    add("hybrid_node_idx/get_coords", queries.size(), 0, [=] {
+      auto sum = size_t{0};
+      for (auto const id : queries) {
+        sum += static_cast<size_t>(get_coords(*nodes, id)->x());
+      }
+      return sum;
+    });
+
+    // a way: consecutive node ids (batch lookup)
+    auto const way_start = idx_dist(gen) % (ids.size() - 1024);
+    add("hybrid_node_idx/get_coords_way", 1024, 0,
+        [=, locations = std::vector<osmium::Location>(1024)]() mutable {
+          std::vector<std::pair<osmium::object_id_type, osmium::Location*>>
+              query;
+          for (auto i = 0ULL; i < locations.size(); ++i) {
+            query.emplace_back(ids[way_start + i], &locations[i]);
+          }
+          get_coords(*nodes, query);
+          return static_cast<size_t>(locations.back().x());
+        });
+  }
+
+  return benchs;
+}
+
+int run_tiles_microbench(int argc, char const** argv) {
+  microbench_settings opt;
+
+  try {
+    conf::options_parser parser({&opt});
+    parser.read_command_line_args(argc, argv, false);
+
+    if (parser.help() || parser.version()) {
+      std::cout << "tiles-microbench\n\n";
+      parser.print_help(std::cout);
+      return 0;
+    }
+
+    parser.read_configuration_file(false);
+    parser.print_used(std::cerr);  // stdout: results only
+  } catch (std::exception const& e) {
+    std::cout << "options error: " << e.what() << "\n";
+    return 1;
+  }
+
+  if (opt.format_ != "json" && opt.format_ != "csv") {
+    std::cout << "options error: unknown format " << opt.format_ << "\n";
+    return 1;
+  }
+
+  regex_matcher const filter{opt.filter_};
+  auto benchs = make_microbenchs();
+  benchs.erase(std::remove_if(begin(benchs), end(benchs),
+                              [&](auto const& b) {
+                                return !filter.match(b.name_).has_value();
+                              }),
+               end(benchs));
+
+  if (opt.list_) {
+    for (auto const& b : benchs) {
+      std::cout << b.name_ << "\n";
+    }
+    return 0;
+  }
+
+  std::ofstream file;
+  if (opt.output_ != "-") {
+    file.open(opt.output_);
+    utl::verify(file.good(), "cannot open output file {}", opt.output_);
+  }
+  auto& out = opt.output_ == "-" ? std::cout : file;
+
+  write_header(out, opt.format_);
+  for (auto const& b : benchs) {
+    auto const r = run_microbench(b, opt);
+    write_result(out, opt.format_, r);
+    if (opt.output_ != "-") {
+      t_log("{:<36} {:>12.1f} ns (+/- {:.1f})", r.name_, r.median_, r.mad_);
+    }
+  }
+  return 0;
+}
+
+}  // namespace tiles
+
+int main(int argc, char const** argv) {
+  try {
+    return tiles::run_tiles_microbench(argc, argv);
+  } catch (std::exception const& e) {
+    tiles::t_log("exception caught: {}", e.what());
+    return 1;
+  } catch (...) {
+    tiles::t_log("unknown exception caught");
+    return 1;
+  }
+}
@@ -1,5 +1,7 @@
 #include "tiles/mvt/encode_geometry.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 #include "boost/geometry.hpp"
@@ -29,11 +31,17 @@ std::pair<delta_encoder, delta_encoder> delta_encoders(fixed_box const& box) {
           delta_encoder{static_cast<fixed_coord_t>(box.min_corner().y())}};
 }
 
-void encode(pz::pbf_builder<ttm::Feature>&, fixed_null const&,
-            tile_spec const&) {}
+bool encode(pz::pbf_builder<ttm::Feature>&, fixed_null const&,
+            tile_spec const&, fixed_coord_t) {
+  return false;
+}
+
+bool encode(pz::pbf_builder<ttm::Feature>& pb, fixed_point const& point,
+            tile_spec const& spec, fixed_coord_t) {
+  if (point.empty()) {
+    return false;
+  }
 
-void encode(pz::pbf_builder<ttm::Feature>& pb, fixed_point const& point,
-            tile_spec const& spec) {
   pb.add_enum(ttm::Feature::optional_GeomType_type, ttm::GeomType::POINT);
 
   auto [x_enc, y_enc] = delta_encoders(spec.px_bounds_);
@@ -45,23 +53,61 @@ void encode(pz::pbf_builder<ttm::Feature>& pb, fixed_point const& point,
       sw.add_element(encode_zigzag32(y_enc.encode(p.y())));
     }
   }
+  return true;
 }
 
+// number of LINE_TO vertices (repeated points skipped) and length
+// (computed up to min_length) of the quantized path
 template <bool ClosePath, typename Container>
-void encode_path(pz::packed_field_uint32& sw, delta_encoder& x_enc,
-                 delta_encoder& y_enc, Container const& c) {
+std::pair<size_t, double> path_info(Container const& c,
+                                    fixed_coord_t const min_length) {
   utl::verify(c.size() > 1, "encode_path: container polyline");
 
+  auto count = 0ULL;
+  auto length = 0.;
+  auto const* prev = &c.front();
+  auto const limit = ClosePath ? c.size() - 1 : c.size();
+  for (auto i = 1ULL; i < limit; ++i) {
+    if (c[i] == *prev) {
+      continue;
+    }
+
+    ++count;
+    if (length < min_length) {
+      length += std::hypot(static_cast<double>(c[i].x() - prev->x()),
+                           static_cast<double>(c[i].y() - prev->y()));
+    }
+    prev = &c[i];
+  }
+  return {count, length};
+}
+
+template <typename Container>
+bool is_valid_line(Container const& c, fixed_coord_t const min_length) {
+  auto const [count, length] = path_info<false>(c, min_length);
+  return count >= 1 && length >= min_length;
+}
+
+template <typename Container>
+bool is_valid_ring(Container const& c) {
+  return path_info<true>(c, 0).first >= 2;
+}
+
+template <bool ClosePath, typename Container>
+void encode_path(pz::packed_field_uint32& sw, delta_encoder& x_enc,
+                 delta_encoder& y_enc, Container const& c) {
   sw.add_element(encode_command(MOVE_TO, 1));
   sw.add_element(encode_zigzag32(x_enc.encode(c.front().x())));
   sw.add_element(encode_zigzag32(y_enc.encode(c.front().y())));
 
-  auto const limit = ClosePath ? c.size() - 2 : c.size() - 1;
-  sw.add_element(encode_command(LINE_TO, limit));
-  for (auto i = 1ULL; i <= limit; ++i) {
+  sw.add_element(encode_command(LINE_TO, path_info<ClosePath>(c, 0).first));
+  auto const limit = ClosePath ? c.size() - 1 : c.size();
+  for (auto i = 1ULL; i < limit; ++i) {
     auto x = x_enc.encode(c[i].x());
     auto y = y_enc.encode(c[i].y());
-    utl::verify(x != 0 || y != 0, "encode_path: both deltas are zero");
+    if (x == 0 && y == 0) {
+      continue;  // repeated point after quantization
+    }
     sw.add_element(encode_zigzag32(x));
     sw.add_element(encode_zigzag32(y));
   }
@@ -71,8 +117,16 @@ void encode_path(pz::packed_field_uint32& sw, delta_encoder& x_enc,
   }
 }
 
-void encode(pz::pbf_builder<ttm::Feature>& pb,
-            fixed_polyline const& multi_polyline, tile_spec const& spec) {
+bool encode(pz::pbf_builder<ttm::Feature>& pb,
+            fixed_polyline const& multi_polyline, tile_spec const& spec,
+            fixed_coord_t const min_line_length) {
+  auto const is_valid = [&](auto const& polyline) {
+    return is_valid_line(polyline, min_line_length);
+  };
+  if (std::none_of(begin(multi_polyline), end(multi_polyline), is_valid)) {
+    return false;
+  }
+
   pb.add_enum(ttm::Feature::optional_GeomType_type, ttm::GeomType::LINESTRING);
 
   auto [x_enc, y_enc] = delta_encoders(spec.px_bounds_);
@@ -80,32 +134,52 @@ void encode(pz::pbf_builder<ttm::Feature>& pb,
     pz::packed_field_uint32 sw{pb, geometry_tag};
 
     for (auto const& polyline : multi_polyline) {
-      encode_path<false>(sw, x_enc, y_enc, polyline);
+      if (is_valid(polyline)) {
+        encode_path<false>(sw, x_enc, y_enc, polyline);
+      }
     }
   }
+  return true;
 }
 
-void encode(pz::pbf_builder<ttm::Feature>& pb,
-            fixed_polygon const& multi_polygon, tile_spec const& spec) {
+bool encode(pz::pbf_builder<ttm::Feature>& pb,
+            fixed_polygon const& multi_polygon, tile_spec const& spec,
+            fixed_coord_t) {
+  auto const is_valid = [](auto const& polygon) {
+    return is_valid_ring(polygon.outer());
+  };
+  if (std::none_of(begin(multi_polygon), end(multi_polygon), is_valid)) {
+    return false;
+  }
+
   pb.add_enum(ttm::Feature::optional_GeomType_type, ttm::GeomType::POLYGON);
-  utl::verify(!multi_polygon.empty(), "multi_polygon empty");
 
   auto [x_enc, y_enc] = delta_encoders(spec.px_bounds_);
   {
     pz::packed_field_uint32 sw{pb, geometry_tag};
 
     for (auto const& polygon : multi_polygon) {
+      if (!is_valid(polygon)) {
+        continue;
+      }
+
       encode_path<true>(sw, x_enc, y_enc, polygon.outer());
       for (auto const& inner : polygon.inners()) {
-        encode_path<true>(sw, x_enc, y_enc, inner);
+        if (is_valid_ring(inner)) {
+          encode_path<true>(sw, x_enc, y_enc, inner);
+        }
       }
     }
   }
+  return true;
 }
 
-void encode_geometry(pz::pbf_builder<ttm::Feature>& pb,
-                     fixed_geometry const& geometry, tile_spec const& spec) {
-  mpark::visit([&](auto const& arg) { encode(pb, arg, spec); }, geometry);
+bool encode_geometry(pz::pbf_builder<ttm::Feature>& pb,
+                     fixed_geometry const& geometry, tile_spec const& spec,
+                     fixed_coord_t const min_line_length) {
+  return mpark::visit(
+      [&](auto const& arg) { return encode(pb, arg, spec, min_line_length); },
+      geometry);
 }
 
 }  // namespace tiles
@@ -1,11 +1,14 @@
 #include "tiles/mvt/tile_builder.h"
 
+#include <algorithm>
 #include <iostream>
 #include <limits>
+#include <string_view>
 #include <unordered_set>
 
 #include "boost/algorithm/string/predicate.hpp"
 
+#include "utl/erase_if.h"
 #include "utl/get_or_create.h"
 #include "utl/get_or_create_index.h"
 
@@ -29,9 +32,42 @@ namespace tiles {
 
 constexpr auto const kVectorTileExtend = 4096;
 constexpr auto const kRasterTileExtend = 256;
-constexpr auto const kScreenPixelArea =
-    (kVectorTileExtend / kRasterTileExtend) *
-    (kVectorTileExtend / kRasterTileExtend);
+constexpr auto const kScreenPixelLength = kVectorTileExtend / kRasterTileExtend;
+constexpr auto const kScreenPixelArea = kScreenPixelLength * kScreenPixelLength;
+
+// numeric value of the priority tag (default: zero),
+// coastlines are never dropped
+double feature_priority(feature const& f, std::string_view const key) {
+  if (f.layer_ == kLayerCoastlineIdx) {
+    return std::numeric_limits<double>::infinity();
+  }
+
+  for (auto const& m : f.meta_) {
+    if (m.key_ != key || m.value_.empty()) {
+      continue;
+    }
+    switch (read<metadata_value_t>(m.value_.data())) {
+      case metadata_value_t::integer:
+        if (m.value_.size() == 1 + sizeof(int64_t)) {
+          return static_cast<double>(read<int64_t>(m.value_.data(), 1));
+        }
+        break;
+      case metadata_value_t::numeric:
+        if (m.value_.size() == 1 + sizeof(double)) {
+          return read<double>(m.value_.data(), 1);
+        }
+        break;
+      default: break;
+    }
+  }
+  return 0.;
+}
+
+struct budgeted_feature {
+  double priority_;
+  std::string buf_;
+  bool dropped_{false};
+};
 
 struct layer_builder {
   layer_builder(render_ctx const& ctx, std::string layer_name,
@@ -44,6 +80,13 @@ struct layer_builder {
     pb_.add_uint32(ttm::Layer::required_uint32_version, 2);
     pb_.add_string(ttm::Layer::required_string_name, layer_name_);
     pb_.add_uint32(ttm::Layer::optional_uint32_extent, kVectorTileExtend);
+
+    if (auto const it = ctx_.tb_point_grid_.find(layer_name_);
+        it != end(ctx_.tb_point_grid_)) {
+      point_cell_size_ =
+          (static_cast<fixed_coord_t>(it->second) * kScreenPixelLength)
+          << (kMaxZoomLevel - spec_.tile_.z_);
+    }
   }
 
   void add_feature(feature f) {
@@ -61,8 +104,11 @@ struct layer_builder {
       return;
     }
 
-    if (ctx_.tb_aggregate_lines_ &&
-        mpark::holds_alternative<fixed_polyline>(f.geometry_)) {
+    if (point_cell_size_ != 0 &&
+        mpark::holds_alternative<fixed_point>(f.geometry_)) {
+      point_buffer_.emplace_back(std::move(f));
+    } else if (ctx_.tb_aggregate_lines_ &&
+               mpark::holds_alternative<fixed_polyline>(f.geometry_)) {
       line_buffer_.emplace_back(std::move(f));
     } else if (ctx_.tb_aggregate_polygons_ &&
                mpark::holds_alternative<fixed_polygon>(f.geometry_)) {
@@ -79,17 +125,60 @@ struct layer_builder {
       return;
     }
 
-    has_geometry_ = true;
-    ++features_written_;
-
     std::string feature_buf;
     pbf_builder<ttm::Feature> feature_pb(feature_buf);
 
-    encode_geometry(feature_pb, f.geometry_, spec_);
+    auto const min_line_length =
+        ctx_.tb_drop_subpixel_lines_ ? kScreenPixelLength : 0;
+    if (!encode_geometry(feature_pb, f.geometry_, spec_, min_line_length)) {
+      return;  // collapsed after quantization
+    }
+
+    has_geometry_ = true;
+    ++features_written_;
 
     feature_pb.add_uint64(ttm::Feature::optional_uint64_id, f.id_);
     write_metadata(feature_pb, f.meta_);
-    pb_.add_message(ttm::Layer::repeated_Feature_features, feature_buf);
+
+    if (ctx_.tb_max_tile_bytes_ != 0) {
+      budgeted_.push_back({feature_priority(f, ctx_.tb_priority_key_),
+                           std::move(feature_buf)});
+    } else {
+      pb_.add_message(ttm::Layer::repeated_Feature_features, feature_buf);
+    }
+  }
+
+  // grid based thinning: per cell the point with the highest priority
+  void thin_points() {
+    std::vector<std::pair<double, feature*>> points;
+    points.reserve(point_buffer_.size());
+    for (auto& f : point_buffer_) {
+      points.emplace_back(feature_priority(f, ctx_.tb_priority_key_), &f);
+    }
+    std::stable_sort(
+        begin(points), end(points),
+        [](auto const& a, auto const& b) { return a.first > b.first; });
+
+    std::unordered_set<uint64_t> used_cells;
+    for (auto const& [priority, f] : points) {
+      f->geometry_ = clip(f->geometry_, spec_.draw_bounds_);
+      if (mpark::holds_alternative<fixed_null>(f->geometry_)) {
+        continue;
+      }
+
+      auto const& pt = mpark::get<fixed_point>(f->geometry_).front();
+      auto const cell =
+          (static_cast<uint64_t>(pt.x() / point_cell_size_) << 32U) |
+          static_cast<uint64_t>(pt.y() / point_cell_size_);
+      if (!used_cells.insert(cell).second) {
+        ++points_thinned_;
+        continue;
+      }
+
+      f->geometry_ = shift(f->geometry_, spec_.tile_.z_);
+      write_feature(*f);
+    }
+    point_buffer_.clear();
   }
 
   void write_metadata(pbf_builder<ttm::Feature>& pb,
@@ -109,13 +198,21 @@ struct layer_builder {
   }
 
   void aggregate_geometry() {
-    if (ctx_.tb_aggregate_polygons_ && !polygon_buffer_.empty()) {
-      //   for (auto&& f :
-      //   aggregate_polygon_features(std::move(polygon_buffer_),
-      //                                              spec_.tile_.z_)) {
+    if (!point_buffer_.empty()) {
+      thin_points();
+    }
 
+    if (ctx_.tb_aggregate_polygons_ && !polygon_buffer_.empty()) {
+      // clip first: the union only has to handle the visible part
       for (auto& f : polygon_buffer_) {
         f.geometry_ = clip(f.geometry_, spec_.draw_bounds_);
+      }
+      utl::erase_if(polygon_buffer_, [](auto const& f) {
+        return mpark::holds_alternative<fixed_null>(f.geometry_);
+      });
+
+      for (auto& f : aggregate_polygon_features(std::move(polygon_buffer_),
+                                                spec_.tile_.z_)) {
         f.geometry_ = shift(f.geometry_, spec_.tile_.z_);
 
         if (f.layer_ != kLayerCoastlineIdx && ctx_.tb_drop_subpixel_polygons_ &&
@@ -138,6 +235,12 @@ struct layer_builder {
   }
 
   std::string finish() {
+    for (auto const& f : budgeted_) {
+      if (!f.dropped_) {
+        pb_.add_message(ttm::Layer::repeated_Feature_features, f.buf_);
+      }
+    }
+
     std::vector<std::string const*> keys(meta_key_cache_.size());
     for (auto const& pair : meta_key_cache_) {
       keys[pair.second] = &pair.first;
@@ -183,10 +286,14 @@ struct layer_builder {
     }
 
     if (ctx_.tb_print_stats_) {
-      fmt::print("tile layer: {:<10} added:{} written:{} ({})\n", layer_name_,
-                 printable_num{features_added_},
-                 printable_num{features_written_},
-                 printable_bytes{buf_.size()});
+      auto const dropped =
+          std::count_if(begin(budgeted_), end(budgeted_),
+                        [](auto const& f) { return f.dropped_; });
+      fmt::print(
+          "tile layer: {:<10} added:{} written:{} thinned:{} dropped:{} ({})\n",
+          layer_name_, printable_num{features_added_},
+          printable_num{features_written_}, printable_num{points_thinned_},
+          printable_num{dropped}, printable_bytes{buf_.size()});
     }
 
     return buf_;
@@ -198,7 +305,10 @@ struct layer_builder {
 
   bool has_geometry_;
 
-  std::vector<feature> line_buffer_, polygon_buffer_;
+  fixed_coord_t point_cell_size_{0};  // zero: no point thinning
+
+  std::vector<feature> point_buffer_, line_buffer_, polygon_buffer_;
+  std::vector<budgeted_feature> budgeted_;
 
   std::string buf_;
   pbf_builder<ttm::Layer> pb_;
@@ -210,6 +320,7 @@ struct layer_builder {
 
   size_t features_added_{0};
   size_t features_written_{0};
+  size_t points_thinned_{0};
 };
 
 struct tile_builder::impl {
@@ -230,7 +341,13 @@ struct tile_builder::impl {
 
     for (auto const& pair : builders_) {
       pair.second->aggregate_geometry();
+    }
 
+    if (ctx_.tb_max_tile_bytes_ != 0) {
+      apply_byte_budget();
+    }
+
+    for (auto const& pair : builders_) {
       if (pair.second->has_geometry_) {
         pb.add_message(ttm::Tile::repeated_Layer_layers, pair.second->finish());
       }
@@ -281,6 +398,43 @@ struct tile_builder::impl {
     return buf;
   }
 
+  // drop features (lowest priority first) until the encoded features fit
+  void apply_byte_budget() {
+    std::vector<budgeted_feature*> features;
+    size_t total_size = 0;
+    for (auto it = builders_.rbegin(); it != builders_.rend(); ++it) {
+      auto& budgeted = it->second->budgeted_;
+      for (auto f_it = budgeted.rbegin(); f_it != budgeted.rend(); ++f_it) {
+        features.push_back(&*f_it);
+        total_size += f_it->buf_.size();
+      }
+    }
+    if (total_size <= ctx_.tb_max_tile_bytes_) {
+      return;
+    }
+
+    // reverse insertion order: on ties, later features are dropped first
+    std::stable_sort(begin(features), end(features),
+                     [](auto const* a, auto const* b) {
+                       return a->priority_ < b->priority_;
+                     });
+    for (auto* f : features) {
+      if (total_size <= ctx_.tb_max_tile_bytes_ ||
+          f->priority_ == std::numeric_limits<double>::infinity()) {
+        break;
+      }
+      f->dropped_ = true;
+      total_size -= f->buf_.size();
+    }
+
+    for (auto const& pair : builders_) {
+      auto& builder = *pair.second;
+      builder.has_geometry_ = std::any_of(
+          begin(builder.budgeted_), end(builder.budgeted_),
+          [](auto const& f) { return !f.dropped_; });
+    }
+  }
+
   render_ctx const& ctx_;
   tile_spec spec_;
   std::map<size_t, std::unique_ptr<layer_builder>> builders_;
@@ -0,0 +1,140 @@
+#include "tiles/osm/dense_node_idx.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+#include "osmium/index/detail/mmap_vector_file.hpp"
+#include "osmium/index/detail/tmpfile.hpp"
+#include "osmium/osm/way.hpp"
+#include "osmium/visitor.hpp"
+
+#include "utl/verify.h"
+
+#include "tiles/util.h"
+
+namespace o = osmium;
+namespace od = osmium::detail;
+
+using osm_id_t = o::object_id_type;
+
+namespace tiles {
+
+struct packed_xy {
+  uint32_t x_, y_;  // coordinate + 1 (zero -> missing)
+};
+
+struct dense_node_idx::impl {
+  explicit impl(int dat_fd) : dat_{dat_fd} {}
+
+  od::mmap_vector_file<packed_xy> dat_;
+};
+
+dense_node_idx::dense_node_idx()
+    : impl_{std::make_unique<impl>(od::create_tmp_file())} {}
+dense_node_idx::dense_node_idx(int dat_fd)
+    : impl_{std::make_unique<impl>(dat_fd)} {}
+dense_node_idx::~dense_node_idx() = default;
+
+std::optional<fixed_xy> get_coords(dense_node_idx const& nodes,
+                                   osm_id_t const& id) {
+  auto const& dat = nodes.impl_->dat_;
+
+  auto const abs_id = static_cast<size_t>(std::abs(id));
+  if (abs_id >= dat.size()) {
+    return std::nullopt;
+  }
+
+  auto const& slot = dat[abs_id];
+  if (slot.x_ == 0) {
+    return std::nullopt;
+  }
+  return fixed_xy{static_cast<fixed_coord_t>(slot.x_) - 1,
+                  static_cast<fixed_coord_t>(slot.y_) - 1};
+}
+
+void get_coords(
+    dense_node_idx const& nodes,
+    std::vector<std::pair<o::object_id_type, o::Location*>>& queries) {
+  for (auto& [id, loc] : queries) {
+    if (auto const coords = get_coords(nodes, id); coords.has_value()) {
+      loc->set_x(coords->x());
+      loc->set_y(coords->y());
+    }
+  }
+}
+
+void update_locations(dense_node_idx const& nodes, o::memory::Buffer& buffer) {
+  for (auto& way : buffer.select<o::Way>()) {
+    for (auto& node_ref : way.nodes()) {
+      if (auto const coords = get_coords(nodes, node_ref.ref());
+          coords.has_value()) {
+        node_ref.set_location(o::Location{
+            static_cast<int32_t>(coords->x() - hybrid_node_idx::x_offset),
+            static_cast<int32_t>(coords->y() - hybrid_node_idx::y_offset)});
+      }
+    }
+  }
+}
+
+struct dense_node_idx_builder::impl {
+  explicit impl(od::mmap_vector_file<packed_xy>& dat) : dat_{dat} {}
+
+  void push(osm_id_t const id, fixed_xy const& pos) {
+    constexpr auto coord_max = std::numeric_limits<uint32_t>::max() - 1;
+    utl::verify(pos.x() >= 0 && pos.y() >= 0 && pos.x() <= coord_max &&
+                    pos.y() <= coord_max,
+                "pos ({}, {}) not within bounds (0 / {})",  //
+                pos.x(), pos.y(), coord_max);
+
+    auto const abs_id = static_cast<size_t>(std::abs(id));
+    if (abs_id >= dat_.size()) {
+      if (abs_id >= dat_.capacity()) {
+        // grow geometrically, every remap of the file is expensive
+        dat_.reserve(std::max(abs_id + 1, 2 * dat_.capacity()));
+      }
+      dat_.resize(abs_id + 1);  // new slots are zero -> missing
+    }
+
+    auto const packed = packed_xy{static_cast<uint32_t>(pos.x() + 1),
+                                  static_cast<uint32_t>(pos.y() + 1)};
+    auto& slot = dat_[abs_id];
+    if (slot.x_ != 0) {
+      utl::verify(slot.x_ == packed.x_ && slot.y_ == packed.y_,
+                  "input: duplicate absolute node id with mismatching "
+                  "coordinates {}",
+                  abs_id);
+      return;
+    }
+
+    slot = packed;
+    ++stat_nodes_;
+  }
+
+  void dump_stats() const {
+    tiles::t_log("data size: {} slots ({} bytes)", dat_.size(),
+                 dat_.size() * sizeof(packed_xy));
+    tiles::t_log("builder: nodes {} (fill rate {:.2f})", stat_nodes_,
+                 dat_.empty() ? 0. : static_cast<double>(stat_nodes_) /
+                                         static_cast<double>(dat_.size()));
+  }
+
+  od::mmap_vector_file<packed_xy>& dat_;
+  size_t stat_nodes_ = 0;
+};
+
+dense_node_idx_builder::dense_node_idx_builder(dense_node_idx& nodes)
+    : impl_{std::make_unique<impl>(nodes.impl_->dat_)} {}
+
+dense_node_idx_builder::~dense_node_idx_builder() = default;
+
+void dense_node_idx_builder::push(o::object_id_type const id,
+                                  fixed_xy const& coords) const {
+  impl_->push(id, coords);
+}
+
+void dense_node_idx_builder::finish() const {}
+
+void dense_node_idx_builder::dump_stats() const { impl_->dump_stats(); }
+
+}  // namespace tiles
@@ -1,5 +1,11 @@
 #include "tiles/osm/feature_handler.h"
 
+#include <algorithm>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
 #include "sol/sol.hpp"
 
 #include "tiles/db/feature_inserter_mt.h"
@@ -7,41 +13,118 @@
 #include "tiles/db/shared_metadata.h"
 #include "tiles/fixed/fixed_geometry.h"
 #include "tiles/osm/pending_feature.h"
+#include "tiles/osm/profile_rules.h"
 #include "tiles/osm/read_osm_geometry.h"
 
 namespace tiles {
 
+// tag keys which are inspected by one of the process_* functions.
+// objects without any of these keys can not be approved by the profile and
+// are dropped before any call into lua (no filtering if not declared)
+struct tag_prefilter {
+  tag_prefilter() = default;
+  explicit tag_prefilter(std::vector<std::string> keys)
+      : active_{true}, keys_{std::move(keys)} {
+    std::sort(begin(keys_), end(keys_));
+  }
+
+  bool matches(osmium::OSMObject const& obj) const {
+    if (!active_) {
+      return true;
+    }
+    return std::any_of(
+        std::begin(obj.tags()), std::end(obj.tags()), [&](auto const& tag) {
+          return std::binary_search(begin(keys_), end(keys_),
+                                    std::string_view{tag.key()}, std::less<>{});
+        });
+  }
+
+  bool active_{false};
+  std::vector<std::string> keys_;
+};
+
+// per handler (= per thread) cache in front of the shared layer_names_builder
+// which needs to lock a mutex for every lookup
+struct layer_idx_cache {
+  size_t get(layer_names_builder& builder, std::string const& name) {
+    if (auto const it = cache_.find(name); it != end(cache_)) {
+      return it->second;
+    }
+    return cache_.emplace(name, builder.get_layer_idx(name)).first->second;
+  }
+
+  std::unordered_map<std::string, size_t> cache_;
+};
+
 struct script_runner {
   explicit script_runner(std::string const& osm_profile) {
     lua_.script_file(osm_profile);
     lua_.open_libraries(sol::lib::base, sol::lib::package);
 
-    lua_.new_usertype<pending_feature>(  //
-        "pending_feature",  //
-        "get_id", &pending_feature::get_id,  //
-        "has_tag", &pending_feature::has_tag,  //
-        "has_any_tag", &pending_feature::has_any_tag,  //
-        "has_any_tag", &pending_feature::has_any_tag,  //
-        "set_approved_min", &pending_feature::set_approved_min,  //
-        "set_approved_min_by_area", &pending_feature::set_approved_min_by_area,
-        "set_approved_full", &pending_feature::set_approved_full,  //
-        "set_target_layer", &pending_feature::set_target_layer,  //
-        "add_bool", &pending_feature::add_bool,  //
-        "add_string", &pending_feature::add_string,  //
-        "add_numeric", &pending_feature::add_numeric,  //
-        "add_integer", &pending_feature::add_integer,  //
-        "add_tag_as_bool", &pending_feature::add_tag_as_bool,  //
-        "add_tag_as_string", &pending_feature::add_tag_as_string,  //
-        "add_tag_as_numeric", &pending_feature::add_tag_as_numeric,  //
-        "add_tag_as_integer", &pending_feature::add_tag_as_integer);
+    register_pending_feature(lua_);
 
     process_node_ = lua_["process_node"];
     process_way_ = lua_["process_way"];
     process_area_ = lua_["process_area"];
+
+    // optional: rules = { node = {...}, way = {...}, area = {...} }
+    if (sol::optional<sol::table> decl = lua_["rules"]; decl) {
+      node_rules_ = read_profile_rules(*decl, "node");
+      way_rules_ = read_profile_rules(*decl, "way");
+      area_rules_ = read_profile_rules(*decl, "area");
+    }
+
+    // optional: prefilter_keys = { node = {...}, way = {...}, area = {...} }
+    if (sol::optional<sol::table> decl = lua_["prefilter_keys"]; decl) {
+      node_filter_ = read_prefilter(*decl, "node");
+      way_filter_ = read_prefilter(*decl, "way");
+      area_filter_ = read_prefilter(*decl, "area");
+    }
+
+    verify_rules(node_rules_, process_node_, "node");
+    verify_rules(way_rules_, process_way_, "way");
+    verify_rules(area_rules_, process_area_, "area");
+  }
+
+  static void verify_rules(std::optional<profile_rules> const& rules,
+                           sol::function const& process, char const* type) {
+    utl::verify(process.valid() ||
+                    (rules && std::none_of(begin(rules->rules_),
+                                           end(rules->rules_),
+                                           [](auto const& r) {
+                                             return r.use_lua_;
+                                           })),
+                "profile: process_{} missing", type);
+  }
+
+  static tag_prefilter read_prefilter(sol::table const& decl,
+                                      char const* type) {
+    sol::optional<sol::table> keys = decl[type];
+    if (!keys) {
+      return tag_prefilter{};
+    }
+
+    std::vector<std::string> vec;
+    for (auto const& [idx, key] : *keys) {
+      utl::verify(key.get_type() == sol::type::string,
+                  "prefilter_keys.{}: only strings allowed", type);
+      vec.emplace_back(key.as<std::string>());
+    }
+    return tag_prefilter{std::move(vec)};
   }
 
   sol::state lua_;
 
+  layer_idx_cache layer_idx_cache_;
+
+  tag_prefilter node_filter_;
+  tag_prefilter way_filter_;
+  tag_prefilter area_filter_;
+
+  std::optional<profile_rules> node_rules_;
+  std::optional<profile_rules> way_rules_;
+  std::optional<profile_rules> area_rules_;
+
   sol::function process_node_;
   sol::function process_way_;
   sol::function process_area_;
@@ -63,7 +146,8 @@ feature_handler::feature_handler(
     : runner_{std::make_unique<script_runner>(osm_profile)},
       inserter_{inserter},
       layer_names_builder_{layer_names_builder},
-      shared_metadata_builder_{shared_metadata_builder} {}
+      metadata_counter_{
+          std::make_unique<local_metadata_counter>(shared_metadata_builder)} {}
 
 feature_handler::feature_handler(feature_handler&&) noexcept = default;
 feature_handler::~feature_handler() = default;
@@ -71,10 +155,29 @@ feature_handler::~feature_handler() = default;
 template <typename OSMObject>
 void handle_feature(feature_inserter_mt& inserter,
                     layer_names_builder& layer_names,
-                    shared_metadata_builder& shared_metadata_builder,
+                    layer_idx_cache& layer_idx_cache,
+                    local_metadata_counter& metadata_counter,
+                    tag_prefilter const& filter,
+                    std::optional<profile_rules> const& rules,
                     sol::function const& process, OSMObject const& obj) {
+  if (!filter.matches(obj)) {
+    return;
+  }
+
+  profile_rule const* rule = nullptr;
+  if (rules) {
+    rule = rules->match(obj);
+    if (rule == nullptr) {
+      return;
+    }
+  }
+
   auto pf = pending_feature{obj, [&obj] { return read_osm_geometry(obj); }};
-  process(pf);
+  if (rule == nullptr || rule->use_lua_) {
+    process(pf);
+  } else {
+    apply_profile_rule(*rule, pf);
+  }
 
   if (!pf.is_approved_) {
     return;
@@ -91,25 +194,28 @@ void handle_feature(feature_inserter_mt& inserter,
   }
 
   pf.finish_metadata();
-  shared_metadata_builder.update(pf.metadata_);
+  metadata_counter.update(pf.metadata_);
 
   inserter.insert(feature{static_cast<uint64_t>(pf.get_id()),
-                          layer_names.get_layer_idx(pf.target_layer_),
+                          layer_idx_cache.get(layer_names, pf.target_layer_),
                           pf.zoom_levels_, std::move(pf.metadata_),
                           std::move(*pf.geometry_)});
 }
 
 void feature_handler::node(osmium::Node const& n) {
-  handle_feature(inserter_, layer_names_builder_, shared_metadata_builder_,
-                 runner_->process_node_, n);
+  handle_feature(inserter_, layer_names_builder_, runner_->layer_idx_cache_,
+                 *metadata_counter_, runner_->node_filter_,
+                 runner_->node_rules_, runner_->process_node_, n);
 }
 void feature_handler::way(osmium::Way const& w) {
-  handle_feature(inserter_, layer_names_builder_, shared_metadata_builder_,
-                 runner_->process_way_, w);
+  handle_feature(inserter_, layer_names_builder_, runner_->layer_idx_cache_,
+                 *metadata_counter_, runner_->way_filter_,
+                 runner_->way_rules_, runner_->process_way_, w);
 }
 void feature_handler::area(osmium::Area const& a) {
-  handle_feature(inserter_, layer_names_builder_, shared_metadata_builder_,
-                 runner_->process_area_, a);
+  handle_feature(inserter_, layer_names_builder_, runner_->layer_idx_cache_,
+                 *metadata_counter_, runner_->area_filter_,
+                 runner_->area_rules_, runner_->process_area_, a);
 }
 
 }  // namespace tiles
@@ -1,5 +1,6 @@
 #include "tiles/osm/hybrid_node_idx.h"
 
+#include <cstring>
 #include <limits>
 #include <tuple>
 
@@ -48,6 +49,10 @@ namespace tiles {
 
 // a empty span with n = 0 and k = 0x1 marks EOF
 
+// long runs of consecutive nodes are split into multiple coord spans such that
+// an idx entry (i.e. absolute coordinates, a "checkpoint") is available at
+// least every kCoordsPerIndex nodes: lookups decode at most that many nodes
+
 // idx contains a sorted pairs
 // of osm node id and offset of the corresponding span in dat
 
@@ -334,12 +339,11 @@ void hybrid_node_idx::way(o::Way& way) const {
   }
 }
 
-struct hybrid_node_idx_builder::impl {
-  impl(od::mmap_vector_file<id_offset>& idx, od::mmap_vector_file<char>& dat)
-      : nodes_{nullptr}, idx_{idx}, dat_{dat} {}
-
-  explicit impl(std::unique_ptr<hybrid_node_idx::impl> nodes)
-      : nodes_{std::move(nodes)}, idx_{nodes_->idx_}, dat_{nodes_->dat_} {}
+// shared by the builder (writing directly into the mmap files) and the chunks
+// (encoding independent parts of the input into memory)
+template <typename IdxVec, typename DatVec>
+struct span_encoder {
+  span_encoder(IdxVec& idx, DatVec& dat) : idx_{idx}, dat_{dat} {}
 
   void push(osm_id_t const id, fixed_xy const& pos) {
     constexpr auto coord_min = std::numeric_limits<uint32_t>::min();
@@ -363,9 +367,11 @@ struct hybrid_node_idx_builder::impl {
                 abs_id, last_id_);
     ++stat_nodes_;
 
-    if (last_id_ + 1 != abs_id && !span_.empty()) {
+    if (last_id_ + 1 != abs_id && (!span_.empty() || !idx_.empty())) {
       push_coord_span();
       push_empty_span(abs_id);
+    } else if (span_.size() >= coords_until_checkpoint()) {
+      push_coord_span();  // consecutive: next coord span follows directly
     }
 
     last_id_ = abs_id;
@@ -373,9 +379,11 @@ struct hybrid_node_idx_builder::impl {
     span_.emplace_back(pos);
   }
 
-  void finish() {
-    push_coord_span();
-    push_empty_span(last_id_ + 1);  // 0 length empty span --> "EOF"
+  // the next span start is indexed once kCoordsPerIndex coords were written
+  size_t coords_until_checkpoint() const {
+    return coords_written_ >= kCoordsPerIndex
+               ? kCoordsPerIndex
+               : kCoordsPerIndex - coords_written_;
   }
 
   void push_coord_span() {
@@ -383,7 +391,7 @@ struct hybrid_node_idx_builder::impl {
       return;
     }
 
-    if (idx_.empty() || coords_written_ > kCoordsPerIndex) {
+    if (idx_.empty() || coords_written_ >= kCoordsPerIndex) {
       osm_id_t const start_id = last_id_ - span_.size() + 1;
       idx_.push_back(id_offset{start_id, dat_.size()});
       coords_written_ = 0;
@@ -466,6 +474,18 @@ struct hybrid_node_idx_builder::impl {
     return n;
   }
 
+  template <typename OtherIdxVec, typename OtherDatVec>
+  void add_stats(span_encoder<OtherIdxVec, OtherDatVec> const& o) {
+    stat_nodes_ += o.stat_nodes_;
+    stat_spans_ += o.stat_spans_;
+    for (auto i = 0ULL; i < stat_coord_chars_.size(); ++i) {
+      stat_coord_chars_[i] += o.stat_coord_chars_[i];
+    }
+    for (auto i = 0ULL; i < stat_span_cum_sizes_.size(); ++i) {
+      stat_span_cum_sizes_[i] += o.stat_span_cum_sizes_[i];
+    }
+  }
+
   void dump_stats() const {
     tiles::t_log("index size: {} entries", idx_.size());
     tiles::t_log("data size: {} bytes", dat_.size());
@@ -483,16 +503,15 @@ struct hybrid_node_idx_builder::impl {
     }
   }
 
-  std::unique_ptr<hybrid_node_idx::impl> nodes_;
-  od::mmap_vector_file<id_offset>& idx_;
-  od::mmap_vector_file<char>& dat_;
+  IdxVec& idx_;
+  DatVec& dat_;
 
   osm_id_t last_id_ = std::numeric_limits<osm_id_t>::min();
   fixed_xy last_pos_{0, 0};
 
   std::vector<fixed_xy> span_;
 
-  static constexpr auto const kCoordsPerIndex = 1024;  // one idx entry each n
+  static constexpr auto const kCoordsPerIndex = 1024ULL;  // idx entry each n
   size_t coords_written_ = 0;
 
   size_t stat_nodes_ = 0;
@@ -504,6 +523,113 @@ struct hybrid_node_idx_builder::impl {
   std::array<size_t, kStatSpanCumSizeLimits.size()> stat_span_cum_sizes_ = {};
 };
 
+struct hybrid_node_idx_chunk::impl {
+  std::vector<id_offset> idx_;
+  std::vector<char> dat_;
+  span_encoder<std::vector<id_offset>, std::vector<char>> enc_{idx_, dat_};
+};
+
+hybrid_node_idx_chunk::hybrid_node_idx_chunk()
+    : impl_{std::make_unique<impl>()} {}
+hybrid_node_idx_chunk::~hybrid_node_idx_chunk() = default;
+
+hybrid_node_idx_chunk::hybrid_node_idx_chunk(
+    hybrid_node_idx_chunk&&) noexcept = default;
+hybrid_node_idx_chunk& hybrid_node_idx_chunk::operator=(
+    hybrid_node_idx_chunk&&) noexcept = default;
+
+// all nodes of a chunk in id order (chunks have no eof marker)
+template <typename Fn>
+void for_each_node(hybrid_node_idx_chunk::impl const& chunk, Fn&& fn) {
+  auto const* dat_it = chunk.dat_.data();
+  auto const* const dat_end = chunk.dat_.data() + chunk.dat_.size();
+
+  auto curr_id = chunk.idx_.front().id_;
+  while (dat_it != dat_end) {
+    auto const header = pz::decode_varint(&dat_it, dat_end);
+    auto const span_size = static_cast<osm_id_t>(header >> 1);
+    if ((header & 0x1) == 0x1) {
+      curr_id += span_size;  // empty span
+      continue;
+    }
+
+    delta_decoder x_dec{read_fixed(&dat_it)};
+    delta_decoder y_dec{read_fixed(&dat_it)};
+    fn(curr_id++, fixed_xy{x_dec.curr_, y_dec.curr_});
+    for (auto i = 0; i < span_size; ++i) {
+      auto const x = x_dec.decode(
+          pz::decode_zigzag64(pz::decode_varint(&dat_it, dat_end)));
+      auto const y = y_dec.decode(
+          pz::decode_zigzag64(pz::decode_varint(&dat_it, dat_end)));
+      fn(curr_id++, fixed_xy{x, y});
+    }
+  }
+}
+
+void hybrid_node_idx_chunk::push(o::object_id_type const id,
+                                 fixed_xy const& coords) const {
+  impl_->enc_.push(id, coords);
+}
+
+void hybrid_node_idx_chunk::finish() const { impl_->enc_.push_coord_span(); }
+
+struct hybrid_node_idx_builder::impl {
+  impl(od::mmap_vector_file<id_offset>& idx, od::mmap_vector_file<char>& dat)
+      : nodes_{nullptr}, enc_{idx, dat} {}
+
+  explicit impl(std::unique_ptr<hybrid_node_idx::impl> nodes)
+      : nodes_{std::move(nodes)}, enc_{nodes_->idx_, nodes_->dat_} {}
+
+  void finish() {
+    enc_.push_coord_span();
+    enc_.push_empty_span(enc_.last_id_ + 1);  // 0 length empty span --> "EOF"
+  }
+
+  void append(hybrid_node_idx_chunk::impl const& chunk) {
+    auto const& c = chunk.enc_;
+    if (c.idx_.empty()) {
+      return;  // chunk without nodes
+    }
+
+    enc_.push_coord_span();
+
+    // the first span of each chunk is always indexed
+    auto const first_id = c.idx_.front().id_;
+
+    // repeated id on the chunk boundary (accepted by push if the coordinates
+    // match): rare, re-encode the chunk node by node
+    if (!enc_.idx_.empty() && first_id == enc_.last_id_) {
+      for_each_node(c, [&](osm_id_t const id, fixed_xy const& pos) {
+        enc_.push(id, pos);
+      });
+      return;
+    }
+
+    utl::verify(enc_.idx_.empty() || first_id > enc_.last_id_,
+                "input: node ids are not sorted! {} <= {}", first_id,
+                enc_.last_id_);
+    if (!enc_.idx_.empty() && first_id != enc_.last_id_ + 1) {
+      enc_.push_empty_span(first_id);
+    }
+
+    auto const offset = enc_.dat_.size();
+    for (auto const& e : c.idx_) {
+      enc_.idx_.push_back(id_offset{e.id_, e.offset_ + offset});
+    }
+    enc_.dat_.resize(offset + c.dat_.size());
+    std::memcpy(enc_.dat_.data() + offset, c.dat_.data(), c.dat_.size());
+
+    enc_.last_id_ = c.last_id_;
+    enc_.last_pos_ = c.last_pos_;
+    enc_.coords_written_ = c.coords_written_;
+    enc_.add_stats(c);
+  }
+
+  std::unique_ptr<hybrid_node_idx::impl> nodes_;
+  span_encoder<od::mmap_vector_file<id_offset>, od::mmap_vector_file<char>>
+      enc_;
+};
+
 hybrid_node_idx_builder::hybrid_node_idx_builder(hybrid_node_idx& nodes)
     : impl_{std::make_unique<impl>(nodes.impl_->idx_, nodes.impl_->dat_)} {}
 
@@ -515,14 +641,18 @@ hybrid_node_idx_builder::~hybrid_node_idx_builder() = default;
 
 void hybrid_node_idx_builder::push(o::object_id_type const id,
                                    fixed_xy const& coords) const {
-  impl_->push(id, coords);
+  impl_->enc_.push(id, coords);
+}
+
+void hybrid_node_idx_builder::append(hybrid_node_idx_chunk const& c) const {
+  impl_->append(*c.impl_);
 }
 
 void hybrid_node_idx_builder::finish() const { impl_->finish(); }
 
-void hybrid_node_idx_builder::dump_stats() const { impl_->dump_stats(); }
+void hybrid_node_idx_builder::dump_stats() const { impl_->enc_.dump_stats(); }
 size_t hybrid_node_idx_builder::get_stat_spans() const {
-  return impl_->stat_spans_;
+  return impl_->enc_.stat_spans_;
 }
 
 }  // namespace tiles
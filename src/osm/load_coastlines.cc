@@ -1,7 +1,10 @@
 #include "tiles/osm/load_coastlines.h"
 
+#include <algorithm>
+#include <cmath>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <type_traits>
 #include <variant>
 
@@ -39,11 +42,11 @@ using coastline_ptr = std::shared_ptr<coastline>;
 
 struct geo_task {
   geo::tile tile_{};
+  bool seed_{false};  // coastlines_ not yet queried from the rtree
   std::vector<coastline_ptr> coastlines_;
 };
 
 using geo_queue_t = queue_wrapper<geo_task>;
-using db_queue_t = queue_wrapper<std::pair<geo::tile, std::string>>;
 
 struct coastline_stats {
   static constexpr uint64_t kTotal = (1 << 10) * (1 << 10);
@@ -103,6 +106,91 @@ bool within(fixed_box const& outer, fixed_box const& inner) {
          outer.max_corner().y() >= inner.max_corner().y();
 }
 
+// packed (sort-tile-recursive) rtree over the coastline bounding boxes.
+// level 0 holds the leaf boxes, each upper level the union of kNodeSize
+// consecutive boxes of the level below.
+struct coastline_rtree {
+  static constexpr auto kNodeSize = 16ULL;
+
+  explicit coastline_rtree(std::vector<coastline_ptr> coastlines)
+      : coastlines_{std::move(coastlines)} {
+    auto const center_x = [](auto const& c) {
+      return c->box_.min_corner().x() / 2 + c->box_.max_corner().x() / 2;
+    };
+    auto const center_y = [](auto const& c) {
+      return c->box_.min_corner().y() / 2 + c->box_.max_corner().y() / 2;
+    };
+
+    std::sort(begin(coastlines_), end(coastlines_),
+              [&](auto const& a, auto const& b) {
+                return center_x(a) < center_x(b);
+              });
+
+    auto const num_nodes = (coastlines_.size() + kNodeSize - 1) / kNodeSize;
+    auto const num_slices = static_cast<size_t>(
+        std::ceil(std::sqrt(static_cast<double>(num_nodes))));
+    auto const slice_size = std::max(kNodeSize * num_slices, kNodeSize);
+    for (auto i = 0ULL; i < coastlines_.size(); i += slice_size) {
+      auto const slice_end = std::min(i + slice_size, coastlines_.size());
+      std::sort(std::next(begin(coastlines_), i),
+                std::next(begin(coastlines_), slice_end),
+                [&](auto const& a, auto const& b) {
+                  return center_y(a) < center_y(b);
+                });
+    }
+
+    levels_.emplace_back(
+        utl::to_vec(coastlines_, [](auto const& c) { return c->box_; }));
+    while (levels_.back().size() > kNodeSize) {
+      auto const& below = levels_.back();
+
+      std::vector<fixed_box> level;
+      level.reserve((below.size() + kNodeSize - 1) / kNodeSize);
+      for (auto i = 0ULL; i < below.size(); i += kNodeSize) {
+        auto box = below[i];
+        for (auto j = i + 1; j < std::min(i + kNodeSize, below.size()); ++j) {
+          box.min_corner().x(
+              std::min(box.min_corner().x(), below[j].min_corner().x()));
+          box.min_corner().y(
+              std::min(box.min_corner().y(), below[j].min_corner().y()));
+          box.max_corner().x(
+              std::max(box.max_corner().x(), below[j].max_corner().x()));
+          box.max_corner().y(
+              std::max(box.max_corner().y(), below[j].max_corner().y()));
+        }
+        level.push_back(box);
+      }
+      levels_.emplace_back(std::move(level));
+    }
+  }
+
+  template <typename Fn>
+  void query(fixed_box const& box, Fn&& fn) const {
+    query(box, fn, levels_.size() - 1, 0, levels_.back().size());
+  }
+
+  template <typename Fn>
+  void query(fixed_box const& box, Fn& fn, size_t const level,
+             size_t const lb, size_t const ub) const {
+    auto const& boxes = levels_[level];
+    for (auto i = lb; i < ub; ++i) {
+      if (!touches(box, boxes[i])) {
+        continue;
+      }
+
+      if (level == 0) {
+        fn(coastlines_[i]);
+      } else {
+        query(box, fn, level - 1, i * kNodeSize,
+              std::min((i + 1) * kNodeSize, levels_[level - 1].size()));
+      }
+    }
+  }
+
+  std::vector<coastline_ptr> coastlines_;
+  std::vector<std::vector<fixed_box>> levels_;
+};
+
 cl::Path box_to_path(fixed_box const& box) {
   return {{box.min_corner().x(), box.min_corner().y()},
           {box.max_corner().x(), box.min_corner().y()},
@@ -122,6 +210,19 @@ cl::Paths intersection(cl::Paths const& subject, cl::Path const& clip) {
   return solution;
 }
 
+// clipped geometry is passed down the pyramid: drop the (near) duplicate and
+// collinear vertices introduced by clipping and degenerate rings.
+// the tolerance is the clipper default (~1.4 fixed units -> sub pixel at z20)
+cl::Paths clip_and_clean(cl::Paths const& subject, cl::Path const& clip) {
+  auto solution = intersection(subject, clip);
+  cl::CleanPolygons(solution);
+  solution.erase(
+      std::remove_if(begin(solution), end(solution),
+                     [](auto const& path) { return path.size() < 3; }),
+      end(solution));
+  return solution;
+}
+
 void to_fixed_polygon(fixed_polygon& polygon, cl::PolyNodes const& nodes) {
   auto const path_to_ring = [](auto const& path) {
     utl::verify(!path.empty(), "path empty");
@@ -180,8 +281,31 @@ std::optional<std::string> finalize_tile(
                             std::move(polygon)});
 }
 
+// candidates from the rtree, large coastlines are clipped to the draw bounds
+// once here -> the children only clip the already reduced geometry
+std::vector<coastline_ptr> seed_coastlines(coastline_rtree const& rtree,
+                                           geo::tile const& tile) {
+  auto const draw_bounds = tile_spec{tile}.draw_bounds_;
+  auto const draw_clip = box_to_path(draw_bounds);
+
+  std::vector<coastline_ptr> seeded;
+  rtree.query(draw_bounds, [&](coastline_ptr const& coastline) {
+    if (within(draw_bounds, coastline->box_)) {
+      seeded.push_back(coastline);
+      return;
+    }
+
+    auto geo = clip_and_clean(coastline->geo_, draw_clip);
+    if (!geo.empty()) {
+      seeded.push_back(std::make_shared<struct coastline>(bounding_box(geo),
+                                                          std::move(geo)));
+    }
+  });
+  return seeded;
+}
+
 void process_coastline(
-    geo_task& task, geo_queue_t& geo_q, db_queue_t& db_q,
+    geo_task& task, geo_queue_t& geo_q, feature_inserter_mt& inserter,
     coastline_stats& stats,
     std::function<void(geo::tile const&)>&& seaside_appender) {
   for (auto const& child : task.tile_.direct_children()) {
@@ -198,12 +322,14 @@ void process_coastline(
         continue;
       }
 
-      if (within(insert_bounds, coastline->box_)) {
+      // clipping would be a no-op: pass down as is
+      if (within(draw_bounds, coastline->box_)) {
         matching.push_back(coastline);
         continue;
       }
 
-      auto geo = intersection(coastline->geo_, draw_clip);
+      // the parent geometry is already clipped to the parent draw bounds
+      auto geo = clip_and_clean(coastline->geo_, draw_clip);
       if (geo.empty()) {
         continue;
       }
@@ -234,7 +360,9 @@ void process_coastline(
       if (auto str = finalize_tile(tile_to_key(child),  //
                                    draw_clip, insert_clip, matching);
           str) {
-        db_q.enqueue({child, std::move(*str)});
+        // thread-safe, flush only persists above the cache threshold
+        inserter.insert(child, *str);
+        inserter.flush();
       } else {
         ++stats.fully_dirtside_;
       }
@@ -246,7 +374,6 @@ void process_coastline(
 void load_coastlines(tile_db_handle& db_handle, feature_inserter_mt& inserter,
                      std::string const& fname) {
   geo_queue_t geo_queue;
-  db_queue_t db_queue;
   coastline_stats stats;
 
   auto convert_path = [](auto const& in) {
@@ -255,6 +382,7 @@ void load_coastlines(tile_db_handle& db_handle, feature_inserter_mt& inserter,
     });
   };
 
+  std::optional<coastline_rtree> rtree;
   {
     std::vector<coastline_ptr> coastlines;
     auto coastline_handler = [&](fixed_simple_polygon geo) {
@@ -274,10 +402,17 @@ void load_coastlines(tile_db_handle& db_handle, feature_inserter_mt& inserter,
       throw;
     }
 
+    {
+      scoped_timer t{"coastline rtree"};
+      rtree.emplace(std::move(coastlines));
+    }
+    t_log("coastline rtree: {} coastlines, {} levels",
+          printable_num{rtree->coastlines_.size()}, rtree->levels_.size());
+
     constexpr auto const kInitialZoomlevel = 4ULL;
     auto it = geo::tile_iterator(kInitialZoomlevel);
     while (it->z_ == kInitialZoomlevel) {
-      geo_queue.enqueue(geo_task{*it, coastlines});
+      geo_queue.enqueue(geo_task{*it, true, {}});
       ++it;
     }
   }
@@ -297,8 +432,12 @@ void load_coastlines(tile_db_handle& db_handle, feature_inserter_mt& inserter,
           continue;
         }
 
+        if (task.seed_) {
+          task.coastlines_ = seed_coastlines(*rtree, task.tile_);
+        }
+
         process_coastline(
-            task, geo_queue, db_queue, stats, [&](auto const& tile) {
+            task, geo_queue, inserter, stats, [&](auto const& tile) {
               std::lock_guard<std::mutex> lock(fully_seaside_mutex);
               fully_seaside.push_back(tile);
             });
@@ -307,23 +446,9 @@ void load_coastlines(tile_db_handle& db_handle, feature_inserter_mt& inserter,
     });
   }
 
-  {
-    while (!geo_queue.finished() || !db_queue.finished()) {
-      std::pair<geo::tile, std::string> data;
-      if (!db_queue.dequeue(data)) {
-        continue;
-      }
-
-      inserter.insert(data.first, data.second);
-      inserter.flush();
-      db_queue.finish();
-    }
-  }
-
   std::for_each(begin(threads), end(threads), [](auto& t) { t.join(); });
 
   utl::verify(geo_queue.queue_.size_approx() == 0, "geo_queue not empty");
-  utl::verify(db_queue.queue_.size_approx() == 0, "db_queue not empty");
   stats.summary();
 
   bq_tree seaside_tree;
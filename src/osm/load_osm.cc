@@ -1,11 +1,13 @@
 #include "tiles/osm/load_osm.h"
 
+#include <exception>
+#include <thread>
+
 #include "boost/filesystem.hpp"
 
+#include "utl/raii.h"
 #include "utl/verify.h"
 
-#include "osmium/area/assembler.hpp"
-#include "osmium/area/multipolygon_manager.hpp"
 #include "osmium/io/pbf_input.hpp"
 #include "osmium/io/reader_with_progress_bar.hpp"
 #include "osmium/memory/buffer.hpp"
@@ -14,20 +16,22 @@
 #include "tiles/db/layer_names.h"
 #include "tiles/db/shared_metadata.h"
 #include "tiles/db/tile_database.h"
+#include "tiles/osm/dense_node_idx.h"
 #include "tiles/osm/feature_handler.h"
 #include "tiles/osm/hybrid_node_idx.h"
+#include "tiles/osm/mp_manager_mt.h"
 #include "tiles/util.h"
 #include "tiles/util_parallel.h"
 
 namespace tiles {
 
 namespace o = osmium;
-namespace oa = osmium::area;
 namespace oio = osmium::io;
-namespace orel = osmium::relations;
 namespace om = osmium::memory;
 namespace oeb = osmium::osm_entity_bits;
 
+constexpr auto const kAreaBufferSize = 1024ULL * 1024ULL;
+
 struct tmp_file {
   explicit tmp_file(std::string path)
       : path_{std::move(path)},
@@ -59,55 +63,139 @@ struct tmp_file {
   FILE* file_;
 };
 
-void load_osm(tile_db_handle& db_handle, feature_inserter_mt& inserter,
-              std::string const& osm_fname, std::string const& osm_profile,
-              std::string const& tmp_dname) {
-  oio::File input_file;
-  size_t file_size{0};
-  try {
-    input_file = oio::File{osm_fname};
-    file_size = oio::Reader{input_file}.file_size();
-  } catch (...) {
-    t_log("load_osm failed [file={}]", osm_fname);
-    throw;
+// hybrid: chunks are encoded by the workers and appended in order
+// dense: nothing to encode, buffers are written in order
+template <typename NodeIdx>
+struct node_idx_traits;
+
+template <>
+struct node_idx_traits<hybrid_node_idx> {
+  using builder_t = hybrid_node_idx_builder;
+  using chunk_t = hybrid_node_idx_chunk;
+
+  static chunk_t encode(om::Buffer& buf) {
+    chunk_t chunk;
+    o::apply(buf, chunk);
+    chunk.finish();
+    return chunk;
+  }
+
+  static void append(builder_t const& builder, chunk_t const& chunk) {
+    builder.append(chunk);
   }
+};
+
+template <>
+struct node_idx_traits<dense_node_idx> {
+  using builder_t = dense_node_idx_builder;
+  using chunk_t = om::Buffer;
+
+  static chunk_t encode(om::Buffer& buf) { return std::move(buf); }
+
+  static void append(builder_t const& builder, chunk_t& buf) {
+    o::apply(buf, builder);
+  }
+};
+
+template <typename NodeIdx>
+void load_osm(tile_db_handle& db_handle, feature_inserter_mt& inserter,
+              oio::File const& input_file, size_t const file_size,
+              std::string const& osm_profile, size_t const metadata_dict_size,
+              NodeIdx& node_idx) {
+  using traits = node_idx_traits<NodeIdx>;
 
   progress_tracker reader_progress;
   reader_progress->status("Load OSM").out_mod(3.F).in_high(2 * file_size);
 
-  oa::MultipolygonManager<oa::Assembler> mp_manager{
-      oa::Assembler::config_type{}};
-
-  auto const node_idx_file = tmp_file{
-      (boost::filesystem::path{tmp_dname} / "idx.bin").generic_string()};
-  auto const node_dat_file = tmp_file{
-      (boost::filesystem::path{tmp_dname} / "dat.bin").generic_string()};
-  hybrid_node_idx node_idx{node_idx_file.fileno(), node_dat_file.fileno()};
+  mp_manager_mt mp_manager;
 
   {
     reader_progress->status("Load OSM / Pass 1");
-    hybrid_node_idx_builder node_idx_builder{node_idx};
+    auto const thread_count =
+        std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
 
-    oio::Reader reader{input_file, oeb::node | oeb::relation};
-    while (auto buffer = reader.read()) {
+    // relations are few: collect them while the nodes are processed
+    std::exception_ptr relations_exception;
+    std::thread relations_thread{[&] {
+      try {
+        oio::Reader reader{input_file, oeb::relation};
+        while (auto buffer = reader.read()) {
+          o::apply(buffer, mp_manager);
+        }
+        reader.close();
+        mp_manager.prepare_for_lookup();
+      } catch (...) {
+        relations_exception = std::current_exception();
+      }
+    }};
+    auto const join_relations_thread = utl::make_finally([&] {
+      if (relations_thread.joinable()) {
+        relations_thread.join();  // also if this thread throws below
+      }
+    });
+
+    typename traits::builder_t node_idx_builder{node_idx};
+    in_order_queue<typename traits::chunk_t> chunk_queue;
+
+    // pbf blocks are decoded by the reader pool, workers encode chunks
+    osmium::thread::Pool pool{thread_count,
+                              static_cast<size_t>(thread_count * 8)};
+    oio::Reader reader{input_file, oeb::node, pool};
+    sequential_until_finish<om::Buffer> seq_reader{[&] {
       reader_progress->update(reader.offset());
-      o::apply(buffer, node_idx_builder, mp_manager);
+      return reader.read();
+    }};
+
+    std::atomic_bool has_exception{false};
+    std::vector<std::future<void>> workers;
+    workers.reserve(thread_count / 2);
+    for (auto i = 0; i < thread_count / 2; ++i) {
+      workers.emplace_back(pool.submit([&] {
+        try {
+          while (true) {
+            auto opt = seq_reader.process();
+            if (!opt.has_value()) {
+              break;
+            }
+
+            auto& [idx, buf] = *opt;
+            chunk_queue.process_in_order(
+                idx, traits::encode(buf),
+                [&](auto c) { traits::append(node_idx_builder, c); });
+          }
+        } catch (std::exception const& e) {
+          fmt::print(std::clog, "EXCEPTION CAUGHT: {} {}\n",
+                     std::this_thread::get_id(), e.what());
+          has_exception = true;
+        } catch (...) {
+          fmt::print(std::clog, "UNKNOWN EXCEPTION CAUGHT: {} \n",
+                     std::this_thread::get_id());
+          has_exception = true;
+        }
+      }));
+    }
+    utl::verify(!workers.empty(), "have no workers");
+    for (auto& worker : workers) {
+      worker.wait();
     }
     reader.close();
+    relations_thread.join();
 
-    mp_manager.prepare_for_lookup();
-    t_log("Multipolygon Manager Memory:");
-    orel::print_used_memory(std::clog, mp_manager.used_memory());
+    if (relations_exception) {
+      std::rethrow_exception(relations_exception);
+    }
+    utl::verify(!has_exception, "load_osm: exception caught!");
+    utl::verify(chunk_queue.queue_.empty(), "chunk_queue not empty!");
+
+    mp_manager.dump_stats();
 
     node_idx_builder.finish();
-    t_log("Hybrid Node Index Statistics:");
+    t_log("Node Index Statistics:");
     node_idx_builder.dump_stats();
   }
 
   layer_names_builder names_builder;
-  shared_metadata_builder metadata_builder;
-
-  in_order_queue<om::Buffer> mp_queue;
+  shared_metadata_builder metadata_builder{metadata_dict_size};
 
   {
     reader_progress->status("Load OSM / Pass 2");
@@ -141,7 +229,7 @@ void load_osm(tile_db_handle& db_handle, feature_inserter_mt& inserter,
     osmium::thread::Pool pool{thread_count,
                               static_cast<size_t>(thread_count * 8)};
 
-    oio::Reader reader{input_file, pool};
+    oio::Reader reader{input_file, oeb::node | oeb::way, pool};
     sequential_until_finish<om::Buffer> seq_reader{[&] {
       reader_progress->update(reader.file_size() + reader.offset());
       return reader.read();
@@ -159,17 +247,15 @@ void load_osm(tile_db_handle& db_handle, feature_inserter_mt& inserter,
               break;
             }
 
-            auto& [idx, buf] = *opt;
+            auto& buf = opt->second;
             update_locations(node_idx, buf);
             o::apply(buf, get_handler());
 
-            mp_queue.process_in_order(idx, std::move(buf), [&](auto buf2) {
-              o::apply(buf2, mp_manager.handler([&](auto&& mp_buffer) {
-                auto p = std::make_shared<om::Buffer>(
-                    std::forward<decltype(mp_buffer)>(mp_buffer));
-                pool.submit([p, &get_handler] { o::apply(*p, get_handler()); });
-              }));
-            });
+            om::Buffer areas{kAreaBufferSize, om::Buffer::auto_grow::yes};
+            for (auto const& way : buf.select<o::Way>()) {
+              mp_manager.way(way, areas);
+            }
+            o::apply(areas, get_handler());
           }
         } catch (std::exception const& e) {
           fmt::print(std::clog, "EXCEPTION CAUGHT: {} {}\n",
@@ -188,13 +274,11 @@ void load_osm(tile_db_handle& db_handle, feature_inserter_mt& inserter,
     }
 
     utl::verify(!has_exception, "load_osm: exception caught!");
-    utl::verify(mp_queue.queue_.empty(), "mp_queue not empty!");
 
     reader.close();
     reader_progress->update(reader_progress->in_high_);
 
-    t_log("Multipolygon Manager Memory:");
-    orel::print_used_memory(std::clog, mp_manager.used_memory());
+    mp_manager.dump_stats();
   }
 
   {
@@ -205,4 +289,41 @@ void load_osm(tile_db_handle& db_handle, feature_inserter_mt& inserter,
   }
 }
 
+void load_osm(tile_db_handle& db_handle, feature_inserter_mt& inserter,
+              std::string const& osm_fname, std::string const& osm_profile,
+              std::string const& tmp_dname, node_idx_type const idx_type,
+              size_t const metadata_dict_size) {
+  oio::File input_file;
+  size_t file_size{0};
+  try {
+    input_file = oio::File{osm_fname};
+    file_size = oio::Reader{input_file}.file_size();
+  } catch (...) {
+    t_log("load_osm failed [file={}]", osm_fname);
+    throw;
+  }
+
+  auto const tmp_path = [&](char const* name) {
+    return (boost::filesystem::path{tmp_dname} / name).generic_string();
+  };
+
+  switch (idx_type) {
+    case node_idx_type::hybrid: {
+      auto const node_idx_file = tmp_file{tmp_path("idx.bin")};
+      auto const node_dat_file = tmp_file{tmp_path("dat.bin")};
+      hybrid_node_idx node_idx{node_idx_file.fileno(),
+                               node_dat_file.fileno()};
+      load_osm(db_handle, inserter, input_file, file_size, osm_profile,
+               metadata_dict_size, node_idx);
+    } break;
+    case node_idx_type::dense: {
+      auto const node_dat_file = tmp_file{tmp_path("dense.bin")};
+      dense_node_idx node_idx{node_dat_file.fileno()};
+      load_osm(db_handle, inserter, input_file, file_size, osm_profile,
+               metadata_dict_size, node_idx);
+    } break;
+    default: throw utl::fail("load_osm: unknown node_idx_type");
+  }
+}
+
 }  // namespace tiles
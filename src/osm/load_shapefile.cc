@@ -1,7 +1,16 @@
 #include "tiles/osm/load_shapefile.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "miniz.h"
 
@@ -14,25 +23,32 @@
 #include "tiles/fixed/convert.h"
 #include "tiles/fixed/fixed_geometry.h"
 #include "tiles/util.h"
+#include "tiles/util_parallel.h"
 
 namespace tiles {
 
-int32_t read_int_big(utl::buffer const& buf, size_t const pos) {
-  return (buf.data()[pos + 3] << 0) |  //
-         (buf.data()[pos + 2] << 8) |  //
-         (buf.data()[pos + 1] << 16) |  //
-         (buf.data()[pos + 0] << 24);
+constexpr auto const kShpHeaderSize = 100ULL;
+constexpr auto const kShpRecordHeaderSize = 8ULL;
+constexpr auto const kShxRecordSize = 8ULL;
+constexpr auto const kRecordBatchSize = 1024ULL * 1024ULL;  // bytes
+
+int32_t read_int_big(char const* data) {
+  auto const* p = reinterpret_cast<uint8_t const*>(data);
+  return static_cast<int32_t>((static_cast<uint32_t>(p[3]) << 0U) |  //
+                              (static_cast<uint32_t>(p[2]) << 8U) |  //
+                              (static_cast<uint32_t>(p[1]) << 16U) |  //
+                              (static_cast<uint32_t>(p[0]) << 24U));
 }
 
-int32_t read_int_little(utl::buffer const& buf, size_t const pos) {
+int32_t read_int_little(char const* data) {
   int32_t val = 0;
-  std::memcpy(&val, buf.data() + pos, sizeof(int32_t));
+  std::memcpy(&val, data, sizeof(int32_t));
   return val;
 }
 
-double read_double_little(utl::buffer const& buf, size_t const pos) {
+double read_double_little(char const* data) {
   double val = NAN;
-  std::memcpy(&val, buf.data() + pos, sizeof(double));
+  std::memcpy(&val, data, sizeof(double));
   return val;
 }
 
@@ -42,101 +58,340 @@ auto emplace_back_ref(Vec& vec) -> decltype(vec.back()) {
   return vec.back();
 }
 
-void read_shapefile(utl::buffer const& buf,
-                    std::function<void(fixed_simple_polygon)> const& consumer) {
-  utl::verify(9994 == read_int_big(buf, 0), "shp: invalid magic number");
-  utl::verify(1000 == read_int_little(buf, 28), "shp: invalid file version");
-  utl::verify(5 == read_int_little(buf, 32),
+void verify_shapefile_header(char const* data) {
+  utl::verify(9994 == read_int_big(data), "shp: invalid magic number");
+  utl::verify(1000 == read_int_little(data + 28), "shp: invalid file version");
+  utl::verify(5 == read_int_little(data + 32),
               "shp: only polygons supported (main)");
+}
+
+// rc: record contents (after the record header)
+fixed_simple_polygon read_record(std::string_view const rc) {
+  utl::verify(rc.size() >= 44, "shp: record too small");
+  utl::verify(5 == read_int_little(rc.data()), "shp: only polygons supported");
+
+  auto const num_parts = read_int_little(rc.data() + 36);
+  auto const num_points = read_int_little(rc.data() + 40);
+
+  utl::verify(num_parts > 0, "shp: need at least one part");
+  utl::verify(num_points > 0, "shp: need at least one point");
+
+  auto const parts_offset = 44ULL;
+  auto const pts_offset = parts_offset + 4ULL * num_parts;
+  utl::verify(pts_offset + 16ULL * num_points <= rc.size(),
+              "shp: record offset limit violation");
+
+  fixed_simple_polygon polygon;
+  auto const read_ring = [&](auto const idx_lb, auto const idx_ub) {
+    utl::verify(0 <= idx_lb && idx_lb <= idx_ub && idx_ub <= num_points,
+                "shp: invalid part");
+    auto& ring = polygon.outer().empty() ? polygon.outer()
+                                         : emplace_back_ref(polygon.inners());
+
+    auto const count = idx_ub - idx_lb;
+    ring.reserve(count);
+    for (auto i = 0; i < count; ++i) {
+      auto const* pt = rc.data() + pts_offset + 16ULL * (idx_lb + i);
+      auto lng = read_double_little(pt);
+      auto lat = read_double_little(pt + 8);
+      ring.emplace_back(latlng_to_fixed({lat, lng}));
+    }
+  };
+
+  for (auto i = 0; i < num_parts - 1; ++i) {
+    read_ring(read_int_little(rc.data() + parts_offset + i * 4),
+              read_int_little(rc.data() + parts_offset + i * 4 + 4));
+  }
+  read_ring(read_int_little(rc.data() + parts_offset + 4 * (num_parts - 1)),
+            num_points);
+
+  utl::verify(!polygon.outer().empty(), "shp: read polygon is empty?!");
+  return polygon;
+}
+
+// record positions (in bytes) from the optional .shx index
+struct shx_record {
+  size_t offset_;  // of the record header in the .shp file
+  size_t size_;  // of the record contents
+};
+
+std::vector<shx_record> read_shx(utl::buffer const& shx) {
+  utl::verify(shx.size() >= kShpHeaderSize, "shx: file too small");
+  auto const* data = reinterpret_cast<char const*>(shx.data());
+  verify_shapefile_header(data);
+
+  std::vector<shx_record> records;
+  records.reserve((shx.size() - kShpHeaderSize) / kShxRecordSize);
+  for (auto pos = kShpHeaderSize; pos + kShxRecordSize <= shx.size();
+       pos += kShxRecordSize) {
+    records.push_back(
+        {static_cast<size_t>(read_int_big(data + pos)) * 2ULL,
+         static_cast<size_t>(read_int_big(data + pos + 4)) * 2ULL});
+  }
+  return records;
+}
 
-  int index = 0;
-  size_t rh_offset = 100;
-  while (rh_offset < buf.size()) {
-    utl::verify(++index == read_int_big(buf, rh_offset),
-                "shp: unexpected index");
+// consecutive records: one buffer, no copy per record
+struct record_batch {
+  size_t idx_{0};  // batches are consumed in this order
+  std::string data_;
+  std::vector<std::pair<size_t, size_t>> records_;  // contents: offset, size
+};
 
-    fixed_simple_polygon polygon;
-    auto const read_ring = [&buf, &polygon](auto const pts_offset,
-                                            auto const idx_lb,
-                                            auto const idx_ub) {
-      auto& ring = polygon.outer().empty() ? polygon.outer()
-                                           : emplace_back_ref(polygon.inners());
+// splits the decompressed .shp stream into record batches: at the record
+// offsets from the .shx index if present, otherwise by a header scan
+struct record_splitter {
+  record_splitter(std::optional<std::vector<shx_record>> shx,
+                  std::function<void(record_batch&&)> emit)
+      : shx_{std::move(shx)}, emit_{std::move(emit)} {}
 
-      auto const count = idx_ub - idx_lb;
-      ring.reserve(count);
-      for (auto i = 0; i < count; ++i) {
-        auto const pt_offset = pts_offset + 16 * i;
+  void append(char const* data, size_t const size) {
+    pending_.append(data, size);
 
-        auto lng = read_double_little(buf, pt_offset);
-        auto lat = read_double_little(buf, pt_offset + 8);
+    if (!header_verified_) {
+      if (pending_.size() < kShpHeaderSize) {
+        return;
+      }
+      verify_shapefile_header(pending_.data());
+      header_verified_ = true;
+      pending_.erase(0, kShpHeaderSize);
+      pending_offset_ = kShpHeaderSize;
+    }
 
-        ring.emplace_back(latlng_to_fixed({lat, lng}));
+    while (true) {
+      auto start = pos_;
+      auto content_size = 0ULL;
+      if (shx_) {
+        if (index_ == shx_->size()) {
+          // after the last indexed record: trailing bytes, not kept
+          trailing_bytes_ += pending_.size() - pos_;
+          pending_.resize(pos_);
+          break;
+        }
+        auto const& r = (*shx_)[index_];
+        utl::verify(r.offset_ >= pending_offset_ + pos_,
+                    "shx: record {} overlaps its predecessor", index_ + 1);
+        start = r.offset_ - pending_offset_;
+        content_size = r.size_;
+      } else {
+        if (pending_.size() < start + kShpRecordHeaderSize) {
+          break;
+        }
+        content_size =
+            static_cast<size_t>(read_int_big(pending_.data() + start + 4)) *
+            2ULL;
       }
-    };
 
-    auto const rc_offset = rh_offset + 8;
-    utl::verify(5 == read_int_little(buf, rc_offset),
-                "shp: only polygons supported");
+      if (pending_.size() < start + kShpRecordHeaderSize + content_size) {
+        break;
+      }
 
-    auto const num_parts = read_int_little(buf, rc_offset + 36);
-    auto const num_points = read_int_little(buf, rc_offset + 40);
+      auto const* rh = pending_.data() + start;
+      ++index_;
+      utl::verify(static_cast<int32_t>(index_) == read_int_big(rh),
+                  "shp: unexpected index");
+      utl::verify(
+          content_size == static_cast<size_t>(read_int_big(rh + 4)) * 2ULL,
+          "shp: record {} size does not match .shx", index_);
+
+      records_.emplace_back(start + kShpRecordHeaderSize, content_size);
+      pos_ = start + kShpRecordHeaderSize + content_size;
+
+      if (pos_ > kRecordBatchSize) {
+        flush();
+      }
+    }
+  }
 
-    utl::verify(num_parts > 0, "shp: need at least one part");
-    utl::verify(num_points > 0, "shp: need at least one point");
+  void finish() {
+    utl::verify(header_verified_, "shp: file too small");
+    utl::verify(!shx_ || shx_->size() == index_,
+                "shp: record count does not match .shx");
+    utl::verify(pending_.size() == pos_,
+                "shp: trailing bytes (truncated record?)");
+    if (trailing_bytes_ != 0) {
+      t_log("[load_shapefile] ignored {} trailing bytes after the last .shx "
+            "record",
+            trailing_bytes_);
+    }
+    flush();
+  }
 
-    auto const parts_offset = rc_offset + 44;
-    auto const pts_offset = parts_offset + 4 * num_parts;
-    for (auto i = 0; i < num_parts - 1; ++i) {
-      read_ring(pts_offset,  //
-                read_int_little(buf, parts_offset + i * 4),
-                read_int_little(buf, parts_offset + i * 4 + 4));
+  // the batch takes the buffer, only the incomplete tail is copied
+  void flush() {
+    if (records_.empty()) {
+      return;
     }
-    read_ring(pts_offset,  //
-              read_int_little(buf, parts_offset + 4 * (num_parts - 1)),  //
-              num_points);
 
-    utl::verify(!polygon.outer().empty(), "shp: read polygon is empty?!");
-    consumer(std::move(polygon));
+    record_batch batch;
+    batch.idx_ = batch_count_++;
+    batch.data_ = std::move(pending_);
+    batch.records_ = std::move(records_);
+    pending_ = batch.data_.substr(pos_);
+    batch.data_.resize(pos_);
 
-    rh_offset += 8 + read_int_big(buf, rh_offset + 4) * 2;
-    utl::verify(rh_offset <= buf.size(), "shp: offset limit violation");
+    pending_offset_ += pos_;
+    pos_ = 0;
+    records_ = {};
+
+    emit_(std::move(batch));
   }
-}
 
-utl::buffer load_buffer(std::string const& fname) {
-  utl::mmap_reader mem{fname.c_str()};
+  std::optional<std::vector<shx_record>> shx_;
+  std::function<void(record_batch&&)> emit_;
 
-  mz_zip_archive ar{};
-  utl::verify(mz_zip_reader_init_mem(&ar, mem.m_.ptr(), mem.m_.size(), 0) != 0,
-              "shp: invalid zipu");
-  auto const ar_deleter = utl::make_finally([&ar] { mz_zip_reader_end(&ar); });
+  bool header_verified_{false};
+  std::string pending_;
+  size_t pending_offset_{0};  // in the .shp file
+  size_t pos_{0};  // end of the last complete record in pending_
+  size_t index_{0};  // records seen
+  size_t trailing_bytes_{0};  // after the last .shx record
+
+  std::vector<std::pair<size_t, size_t>> records_;
+  size_t batch_count_{0};
+
+  std::exception_ptr exception_;
+};
 
+std::optional<mz_uint> find_zip_entry(mz_zip_archive& ar,
+                                      std::string_view const ext) {
   auto n = mz_zip_reader_get_num_files(&ar);
-  for (auto i = 0ULL; i < n; ++i) {
+  for (auto i = 0U; i < n; ++i) {
     mz_zip_archive_file_stat stat{};
     utl::verify(mz_zip_reader_file_stat(&ar, i, &stat) != 0,
                 "shp: unable to stat zip entry");
 
     std::string_view name{stat.m_filename};
-    if (name.size() < 4 || name.substr(name.size() - 4) != ".shp") {
-      continue;
+    if (name.size() >= ext.size() &&
+        name.substr(name.size() - ext.size()) == ext) {
+      return i;
     }
-
-    utl::buffer buf{stat.m_uncomp_size};
-    utl::verify(
-        mz_zip_reader_extract_to_mem(&ar, i, buf.data(), buf.size(), 0) != 0,
-        "shp: error extracting .shp file");
-    return buf;
   }
-  throw utl::fail("shp: .zip file contains no .shp file");
+  return std::nullopt;
 }
 
+utl::buffer extract_to_buffer(mz_zip_archive& ar, mz_uint const idx) {
+  mz_zip_archive_file_stat stat{};
+  utl::verify(mz_zip_reader_file_stat(&ar, idx, &stat) != 0,
+              "shp: unable to stat zip entry");
+
+  utl::buffer buf{stat.m_uncomp_size};
+  utl::verify(
+      mz_zip_reader_extract_to_mem(&ar, idx, buf.data(), buf.size(), 0) != 0,
+      "shp: error extracting zip entry");
+  return buf;
+}
+
+// decompression (calling thread) is streamed into the record splitter,
+// the records are parsed by worker threads. the consumer is called in
+// record order, one polygon at a time.
 void load_shapefile(std::string const& fname,
                     std::function<void(fixed_simple_polygon)> const& consumer) {
-  t_log("[load_shapefile] load buffer");
-  auto&& buf = load_buffer(fname);
-  t_log("[load_shapefile] read shapefile");
-  read_shapefile(buf, consumer);
+  utl::mmap_reader mem{fname.c_str()};
+
+  mz_zip_archive ar{};
+  utl::verify(mz_zip_reader_init_mem(&ar, mem.m_.ptr(), mem.m_.size(), 0) != 0,
+              "shp: invalid zipu");
+  auto const ar_deleter = utl::make_finally([&ar] { mz_zip_reader_end(&ar); });
+
+  auto const shp_idx = find_zip_entry(ar, ".shp");
+  utl::verify(shp_idx.has_value(), "shp: .zip file contains no .shp file");
+
+  std::optional<std::vector<shx_record>> shx;
+  if (auto const shx_idx = find_zip_entry(ar, ".shx"); shx_idx) {
+    shx = read_shx(extract_to_buffer(ar, *shx_idx));
+    t_log("[load_shapefile] .shx index with {} records",
+          printable_num(shx->size()));
+  }
+
+  queue_wrapper<record_batch> queue;
+  queue.add_keep_alive();  // until extraction is finished
+
+  in_order_queue<std::vector<fixed_simple_polygon>> ordered;
+
+  std::mutex exception_mutex;
+  std::exception_ptr exception;
+  auto const set_exception = [&] {
+    std::lock_guard<std::mutex> lock{exception_mutex};
+    exception = std::current_exception();
+  };
+
+  // in_order_queue: one batch at a time, in batch order
+  auto const consume = [&](std::vector<fixed_simple_polygon>&& polygons) {
+    try {
+      for (auto& p : polygons) {
+        consumer(std::move(p));
+      }
+    } catch (...) {
+      set_exception();
+    }
+  };
+
+  auto const num_workers =
+      std::max(2U, std::thread::hardware_concurrency()) - 1;
+  std::vector<std::thread> threads;
+  threads.reserve(num_workers);
+  for (auto i = 0ULL; i < num_workers; ++i) {
+    threads.emplace_back([&] {
+      while (!queue.finished()) {
+        record_batch batch;
+        if (!queue.dequeue(batch)) {
+          continue;
+        }
+
+        std::vector<fixed_simple_polygon> polygons;
+        try {
+          polygons.reserve(batch.records_.size());
+          for (auto const& [offset, size] : batch.records_) {
+            polygons.emplace_back(read_record(
+                std::string_view{batch.data_}.substr(offset, size)));
+          }
+        } catch (...) {
+          set_exception();
+          polygons.clear();  // keep the later batches flowing
+        }
+
+        ordered.process_in_order(batch.idx_, std::move(polygons), consume);
+        queue.finish();
+      }
+    });
+  }
+
+  {
+    auto const finally = utl::make_finally([&] {
+      queue.remove_keep_alive();
+      std::for_each(begin(threads), end(threads), [](auto& t) { t.join(); });
+    });
+
+    t_log("[load_shapefile] extract and read shapefile");
+    record_splitter splitter{std::move(shx), [&](auto&& batch) {
+                               queue.enqueue(std::move(batch));
+                             }};
+
+    // no exceptions through miniz: abort extraction and rethrow afterwards
+    auto const callback = [](void* opaque, mz_uint64 /* file_ofs */,
+                             void const* buf, size_t n) -> size_t {
+      auto* splitter = static_cast<record_splitter*>(opaque);
+      try {
+        splitter->append(static_cast<char const*>(buf), n);
+        return n;
+      } catch (...) {
+        splitter->exception_ = std::current_exception();
+        return 0;
+      }
+    };
+    auto const success = mz_zip_reader_extract_to_callback(
+        &ar, *shp_idx, callback, &splitter, 0);
+    if (splitter.exception_) {
+      std::rethrow_exception(splitter.exception_);
+    }
+    utl::verify(success != 0, "shp: error extracting .shp file");
+    splitter.finish();
+  }
+
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
   t_log("[load_shapefile] done.");
 }
 
@@ -0,0 +1,220 @@
+#include "tiles/osm/mp_manager_mt.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "osmium/area/assembler.hpp"
+#include "osmium/osm/relation.hpp"
+#include "osmium/osm/way.hpp"
+
+#include "tiles/util.h"
+
+namespace o = osmium;
+namespace oa = osmium::area;
+namespace om = osmium::memory;
+
+using osm_id_t = o::object_id_type;
+
+namespace tiles {
+
+struct mp_manager_mt::impl {
+  static constexpr auto kShards = 256ULL;
+  static constexpr auto kInitialBufferSize = 4096ULL;
+
+  struct relation_state {
+    uint32_t missing_{0};  // way member (occurences) not yet seen
+    std::unique_ptr<om::Buffer> ways_;  // stash of the member ways seen
+  };
+
+  static bool is_multipolygon(o::Relation const& rel) {
+    auto const* type = rel.tags().get_value_by_key("type");
+    if (type == nullptr || (std::strcmp(type, "multipolygon") != 0 &&
+                            std::strcmp(type, "boundary") != 0)) {
+      return false;
+    }
+    return std::any_of(
+        begin(rel.members()), end(rel.members()),
+        [](auto const& m) { return m.type() == o::item_type::way; });
+  }
+
+  void relation(o::Relation const& rel) {
+    if (!is_multipolygon(rel)) {
+      return;
+    }
+
+    auto const rel_idx = static_cast<uint32_t>(states_.size());
+    auto const offset = relations_.committed();
+    relation_offsets_.push_back(offset);
+    relations_.add_item(rel);
+    relations_.commit();
+
+    // untracked members get ref 0 (like osmium::relations::RelationsManager)
+    // the assembler pairs the members with ref != 0 with the member ways
+    for (auto& m : relations_.get<o::Relation>(offset).members()) {
+      if (m.type() != o::item_type::way) {
+        m.set_ref(0);
+      }
+    }
+
+    auto& state = states_.emplace_back();
+    for (auto const& m : rel.members()) {
+      if (m.type() == o::item_type::way) {
+        way_to_relation_.emplace_back(m.ref(), rel_idx);
+        ++state.missing_;
+      }
+    }
+  }
+
+  void prepare_for_lookup() {
+    // sorted by (way, relation): repeated members are adjacent
+    std::sort(begin(way_to_relation_), end(way_to_relation_));
+  }
+
+  void way(o::Way const& way, om::Buffer& out) {
+    auto const [lb, ub] = std::equal_range(
+        begin(way_to_relation_), end(way_to_relation_), way.id(),
+        way_id_less{});
+
+    if (lb == ub) {
+      assemble_way(way, out);
+      return;
+    }
+
+    for (auto it = lb; it != ub; ++it) {
+      auto const rel_idx = it->second;
+      std::unique_ptr<om::Buffer> complete;
+      {
+        std::lock_guard<std::mutex> l{mutexes_[rel_idx % kShards]};
+        auto& state = states_[rel_idx];
+        if (it == lb || std::prev(it)->second != rel_idx) {
+          if (!state.ways_) {
+            state.ways_ = std::make_unique<om::Buffer>(
+                kInitialBufferSize, om::Buffer::auto_grow::yes);
+          }
+          state.ways_->add_item(way);
+          state.ways_->commit();
+        }
+        if (--state.missing_ == 0) {
+          complete = std::move(state.ways_);
+        }
+      }
+
+      if (complete) {
+        assemble_relation(rel_idx, *complete, out);
+      }
+    }
+  }
+
+  void assemble_way(o::Way const& way, om::Buffer& out) {
+    // you need at least 4 nodes to make up a polygon
+    if (way.nodes().size() <= 3) {
+      return;
+    }
+
+    try {
+      if (!way.nodes().front().location() || !way.nodes().back().location()) {
+        return;
+      }
+      if (way.ends_have_same_location()) {
+        oa::Assembler assembler{config_};
+        assembler(way, out);
+        ++stat_way_areas_;
+      }
+    } catch (o::invalid_location const&) {
+      // ignore (same as osmium)
+    }
+  }
+
+  void assemble_relation(uint32_t const rel_idx, om::Buffer const& ways,
+                         om::Buffer& out) {
+    auto const& rel =
+        relations_.get<o::Relation>(relation_offsets_.at(rel_idx));
+
+    std::vector<o::Way const*> ways_by_id;
+    for (auto const& way : ways.select<o::Way>()) {
+      ways_by_id.push_back(&way);
+    }
+    std::sort(begin(ways_by_id), end(ways_by_id),
+              [](auto const* a, auto const* b) { return a->id() < b->id(); });
+
+    // the assembler expects the ways in member order
+    std::vector<o::Way const*> members;
+    members.reserve(rel.members().size());
+    for (auto const& m : rel.members()) {
+      if (m.type() != o::item_type::way) {
+        continue;
+      }
+      auto const it = std::lower_bound(
+          begin(ways_by_id), end(ways_by_id), m.ref(),
+          [](auto const* w, auto const id) { return w->id() < id; });
+      utl::verify(it != end(ways_by_id) && (*it)->id() == m.ref(),
+                  "mp_manager_mt: member way {} missing", m.ref());
+      members.push_back(*it);
+    }
+
+    try {
+      oa::Assembler assembler{config_};
+      assembler(rel, members, out);
+      ++stat_relation_areas_;
+    } catch (o::invalid_location const&) {
+      // ignore (same as osmium)
+    }
+  }
+
+  void dump_stats() const {
+    auto const incomplete = std::count_if(
+        begin(states_), end(states_),
+        [](auto const& s) { return s.missing_ != 0; });
+
+    t_log("mp_manager_mt: relations {} ({} incomplete)",
+          printable_num{states_.size()}, printable_num{incomplete});
+    t_log("mp_manager_mt: relation buffer {} index {}",
+          printable_bytes{relations_.committed()},
+          printable_bytes{way_to_relation_.size() *
+                          sizeof(decltype(way_to_relation_)::value_type)});
+    t_log("mp_manager_mt: assembled from relations {} from ways {}",
+          printable_num{stat_relation_areas_.load()},
+          printable_num{stat_way_areas_.load()});
+  }
+
+  struct way_id_less {
+    bool operator()(std::pair<osm_id_t, uint32_t> const& a,
+                    osm_id_t const b) const {
+      return a.first < b;
+    }
+    bool operator()(osm_id_t const a,
+                    std::pair<osm_id_t, uint32_t> const& b) const {
+      return a < b.first;
+    }
+  };
+
+  oa::Assembler::config_type config_;
+
+  om::Buffer relations_{1024ULL * 1024ULL, om::Buffer::auto_grow::yes};
+  std::vector<size_t> relation_offsets_;
+  std::vector<relation_state> states_;
+  std::vector<std::pair<osm_id_t, uint32_t>> way_to_relation_;
+
+  std::array<std::mutex, kShards> mutexes_;
+
+  std::atomic_size_t stat_relation_areas_{0};
+  std::atomic_size_t stat_way_areas_{0};
+};
+
+mp_manager_mt::mp_manager_mt() : impl_{std::make_unique<impl>()} {}
+mp_manager_mt::~mp_manager_mt() = default;
+
+void mp_manager_mt::relation(o::Relation const& rel) { impl_->relation(rel); }
+void mp_manager_mt::prepare_for_lookup() { impl_->prepare_for_lookup(); }
+
+void mp_manager_mt::way(o::Way const& way, om::Buffer& out) {
+  impl_->way(way, out);
+}
+
+void mp_manager_mt::dump_stats() const { impl_->dump_stats(); }
+
+}  // namespace tiles
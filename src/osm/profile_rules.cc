@@ -0,0 +1,188 @@
+#include "tiles/osm/profile_rules.h"
+
+#include <algorithm>
+
+#include "osmium/osm/object.hpp"
+
+#include "utl/verify.h"
+
+#include "tiles/osm/pending_feature.h"
+
+namespace tiles {
+
+void profile_rules::add_rule(
+    profile_rule rule,
+    std::vector<std::pair<std::string, std::string>> const& match,
+    std::vector<std::string> const& match_any) {
+  utl::verify(!match.empty() || !match_any.empty(),
+              "profile_rules: rule without match");
+
+  auto const idx = static_cast<uint32_t>(rules_.size());
+  rules_.emplace_back(std::move(rule));
+
+  auto const intern = [&](std::string const& str) -> std::string_view {
+    return *strings_.emplace(str).first;
+  };
+
+  for (auto const& key : match_any) {
+    auto& entry = keys_[intern(key)];
+    entry.any_ = std::min(entry.any_, idx);
+  }
+  for (auto const& [key, value] : match) {
+    auto& entry = keys_[intern(key)];
+    auto const [it, inserted] = entry.values_.emplace(intern(value), idx);
+    if (!inserted) {
+      it->second = std::min(it->second, idx);
+    }
+  }
+}
+
+profile_rule const* profile_rules::match(osmium::OSMObject const& obj) const {
+  auto best = kNoRule;
+  for (auto const& tag : obj.tags()) {
+    auto const key_it = keys_.find(std::string_view{tag.key()});
+    if (key_it == end(keys_)) {
+      continue;
+    }
+
+    auto const& entry = key_it->second;
+    best = std::min(best, entry.any_);
+    if (auto const val_it = entry.values_.find(std::string_view{tag.value()});
+        val_it != end(entry.values_)) {
+      best = std::min(best, val_it->second);
+    }
+  }
+  return best == kNoRule ? nullptr : &rules_[best];
+}
+
+namespace {
+
+std::vector<std::string> read_string_list(sol::table const& rule,
+                                          char const* name) {
+  std::vector<std::string> vec;
+  if (sol::optional<sol::table> list = rule[name]; list) {
+    for (auto const& [idx, str] : *list) {
+      utl::verify(str.get_type() == sol::type::string,
+                  "profile_rules: {} only strings allowed", name);
+      vec.emplace_back(str.as<std::string>());
+    }
+  }
+  return vec;
+}
+
+}  // namespace
+
+std::optional<profile_rules> read_profile_rules(sol::table const& decl,
+                                                char const* type) {
+  sol::optional<sol::table> list = decl[type];
+  if (!list) {
+    return std::nullopt;
+  }
+
+  profile_rules rules;
+  // index based iteration: rule order is significant
+  for (auto i = 1ULL; i <= list->size(); ++i) {
+    sol::optional<sol::table> rule_decl = (*list)[i];
+    utl::verify(rule_decl.has_value(), "profile_rules: {}[{}] not a table",
+                type, i);
+
+    std::vector<std::pair<std::string, std::string>> match;
+    std::vector<std::string> match_any;
+
+    sol::optional<sol::table> match_decl = (*rule_decl)["match"];
+    utl::verify(match_decl.has_value(), "profile_rules: {}[{}] without match",
+                type, i);
+    for (auto const& [k, v] : *match_decl) {
+      auto const key = k.as<std::string>();
+      switch (v.get_type()) {
+        case sol::type::boolean:
+          utl::verify(v.as<bool>(), "profile_rules: {}[{}] match false", type,
+                      i);
+          match_any.emplace_back(key);
+          break;
+        case sol::type::string:
+          match.emplace_back(key, v.as<std::string>());
+          break;
+        case sol::type::table:
+          for (auto const& [idx, value] : v.as<sol::table>()) {
+            utl::verify(value.get_type() == sol::type::string,
+                        "profile_rules: {}[{}] match values must be strings",
+                        type, i);
+            match.emplace_back(key, value.as<std::string>());
+          }
+          break;
+        default:
+          throw utl::fail("profile_rules: {}[{}] invalid match for {}", type, i,
+                          key);
+      }
+    }
+
+    profile_rule rule;
+    rule.use_lua_ = rule_decl->get_or("lua", false);
+    rule.target_layer_ = rule_decl->get_or("layer", std::string{});
+
+    if (sol::optional<uint32_t> min = (*rule_decl)["min"]; min) {
+      rule.approved_min_ = *min;
+    } else if (rule_decl->get_or("full", false)) {
+      rule.approved_min_ = 0;
+    } else if (sol::optional<sol::table> by_area = (*rule_decl)["min_by_area"];
+               by_area) {
+      for (auto j = 1ULL; j <= by_area->size(); ++j) {
+        rule.approved_min_by_area_.push_back((*by_area)[j].get<double>());
+      }
+      utl::verify(rule.approved_min_by_area_.size() % 2 == 0,
+                  "profile_rules: {}[{}] min_by_area size not even", type, i);
+    }
+
+    utl::verify(rule.use_lua_ || rule.target_layer_.empty() ||
+                    rule.approved_min_ || !rule.approved_min_by_area_.empty(),
+                "profile_rules: {}[{}] layer without min/full/min_by_area",
+                type, i);
+
+    rule.string_tags_ = read_string_list(*rule_decl, "tags");
+    rule.integer_tags_ = read_string_list(*rule_decl, "integer_tags");
+    rule.numeric_tags_ = read_string_list(*rule_decl, "numeric_tags");
+    rule.bool_tags_ = read_string_list(*rule_decl, "bool_tags");
+
+    if (sol::optional<sol::table> strings = (*rule_decl)["strings"]; strings) {
+      for (auto const& [k, v] : *strings) {
+        rule.strings_.emplace_back(k.as<std::string>(), v.as<std::string>());
+      }
+    }
+
+    rules.add_rule(std::move(rule), match, match_any);
+  }
+  return rules;
+}
+
+void apply_profile_rule(profile_rule const& rule, pending_feature& pf) {
+  if (rule.target_layer_.empty()) {
+    return;  // explicit drop
+  }
+
+  pf.set_target_layer(rule.target_layer_);
+  if (rule.approved_min_) {
+    pf.set_approved_min(*rule.approved_min_);
+  } else {
+    pf.set_approved_min_by_area(begin(rule.approved_min_by_area_),
+                                end(rule.approved_min_by_area_));
+  }
+
+  for (auto const& tag : rule.string_tags_) {
+    pf.add_tag_as_string(tag);
+  }
+  for (auto const& tag : rule.integer_tags_) {
+    pf.add_tag_as_integer(tag);
+  }
+  for (auto const& tag : rule.numeric_tags_) {
+    pf.add_tag_as_numeric(tag);
+  }
+  for (auto const& tag : rule.bool_tags_) {
+    pf.add_tag_as_bool(tag);
+  }
+  for (auto const& [key, value] : rule.strings_) {
+    pf.add_string(key, value);
+  }
+}
+
+}  // namespace tiles
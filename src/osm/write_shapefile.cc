@@ -0,0 +1,132 @@
+#include "tiles/osm/write_shapefile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#include "miniz.h"
+
+#include "utl/verify.h"
+
+namespace tiles {
+
+constexpr auto const kShpHeaderSize = 100ULL;
+constexpr auto const kShpPolygon = 5;
+
+void append_int_big(std::string& buf, int32_t const val) {
+  auto const u = static_cast<uint32_t>(val);
+  buf.push_back(static_cast<char>((u >> 24U) & 0xFFU));
+  buf.push_back(static_cast<char>((u >> 16U) & 0xFFU));
+  buf.push_back(static_cast<char>((u >> 8U) & 0xFFU));
+  buf.push_back(static_cast<char>(u & 0xFFU));
+}
+
+template <typename T>
+void append_little(std::string& buf, T const val) {
+  char tmp[sizeof(T)];
+  std::memcpy(tmp, &val, sizeof(T));
+  buf.append(tmp, sizeof(T));
+}
+
+struct shp_box {
+  void extend(geo::latlng const& pos) {
+    min_x_ = std::min(min_x_, pos.lng_);
+    min_y_ = std::min(min_y_, pos.lat_);
+    max_x_ = std::max(max_x_, pos.lng_);
+    max_y_ = std::max(max_y_, pos.lat_);
+  }
+
+  void extend(shp_box const& other) {
+    extend({other.min_y_, other.min_x_});
+    extend({other.max_y_, other.max_x_});
+  }
+
+  void append(std::string& buf) const {
+    append_little<double>(buf, min_x_);
+    append_little<double>(buf, min_y_);
+    append_little<double>(buf, max_x_);
+    append_little<double>(buf, max_y_);
+  }
+
+  double min_x_{std::numeric_limits<double>::max()};
+  double min_y_{std::numeric_limits<double>::max()};
+  double max_x_{std::numeric_limits<double>::lowest()};
+  double max_y_{std::numeric_limits<double>::lowest()};
+};
+
+std::string make_header(size_t const file_size, shp_box const& box) {
+  std::string header;
+  append_int_big(header, 9994);
+  header.resize(24, '\0');
+  append_int_big(header, static_cast<int32_t>(file_size / 2));
+  append_little<int32_t>(header, 1000);
+  append_little<int32_t>(header, kShpPolygon);
+  box.append(header);
+  header.resize(kShpHeaderSize, '\0');  // z and m ranges: unused
+  return header;
+}
+
+void write_shapefile(std::string const& fname,
+                     std::vector<shapefile_polygon> const& polygons,
+                     bool const with_shx) {
+  std::string records, index;
+  shp_box file_box;
+  for (auto i = 0ULL; i < polygons.size(); ++i) {
+    auto const& polygon = polygons[i];
+    utl::verify(!polygon.empty(), "write_shapefile: empty polygon");
+
+    shp_box box;
+    auto num_points = 0;
+    for (auto const& ring : polygon) {
+      num_points += static_cast<int32_t>(ring.size());
+      std::for_each(begin(ring), end(ring),
+                    [&](auto const& pos) { box.extend(pos); });
+    }
+    file_box.extend(box);
+
+    std::string rc;
+    append_little<int32_t>(rc, kShpPolygon);
+    box.append(rc);
+    append_little<int32_t>(rc, static_cast<int32_t>(polygon.size()));
+    append_little<int32_t>(rc, num_points);
+
+    auto part_begin = 0;
+    for (auto const& ring : polygon) {
+      append_little<int32_t>(rc, part_begin);
+      part_begin += static_cast<int32_t>(ring.size());
+    }
+    for (auto const& ring : polygon) {
+      for (auto const& pos : ring) {
+        append_little<double>(rc, pos.lng_);
+        append_little<double>(rc, pos.lat_);
+      }
+    }
+
+    append_int_big(index,
+                   static_cast<int32_t>((kShpHeaderSize + records.size()) / 2));
+    append_int_big(index, static_cast<int32_t>(rc.size() / 2));
+
+    append_int_big(records, static_cast<int32_t>(i + 1));
+    append_int_big(records, static_cast<int32_t>(rc.size() / 2));
+    records.append(rc);
+  }
+
+  auto const shp =
+      make_header(kShpHeaderSize + records.size(), file_box) + records;
+  auto const shx = make_header(kShpHeaderSize + index.size(), file_box) + index;
+
+  std::remove(fname.c_str());
+  for (auto const& [name, data] : {std::make_pair("land_polygons.shp", &shp),
+                                   std::make_pair("land_polygons.shx", &shx)}) {
+    if (data == &shx && !with_shx) {
+      continue;
+    }
+    utl::verify(mz_zip_add_mem_to_archive_file_in_place(
+                    fname.c_str(), name, data->data(), data->size(), nullptr,
+                    0, MZ_DEFAULT_COMPRESSION) != 0,
+                "write_shapefile: cannot write {}", fname);
+  }
+}
+
+}  // namespace tiles
@@ -1,9 +1,14 @@
 #include <cstdlib>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <exception>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <numeric>
 #include <string>
+#include <string_view>
 
 #include "boost/algorithm/string/predicate.hpp"
 #include "boost/asio.hpp"
@@ -15,6 +20,8 @@
 #include "conf/configuration.h"
 #include "conf/options_parser.h"
 
+#include "fmt/core.h"
+
 #include "utl/parser/mmap_reader.h"
 
 #include "tiles/db/tile_database.h"
@@ -62,37 +69,54 @@ std::string url_decode(request_t const& req) {
 }
 
 struct http_connection : public std::enable_shared_from_this<http_connection> {
+  static constexpr auto const kIdleTimeout = std::chrono::seconds(60);
+
   http_connection(tcp::socket socket, callback_t const& callback)
       : socket_{std::move(socket)}, callback_{callback} {}
 
   void start() {
+    read();
+    check_deadline();
+  }
+
+  void read() {
     auto self = shared_from_this();
+    request_ = {};
     http::async_read(
         socket_, buffer_, request_, [self](beast::error_code ec, std::size_t) {
-          if (!ec) {
-            self->response_.version(self->request_.version());
-            self->response_.keep_alive(false);
-
-            try {
-              self->callback_(self->request_, self->response_);
-            } catch (std::exception const& e) {
-              tiles::t_log("unhandled error: {}", e.what());
-              self->response_.result(http::status::internal_server_error);
-            } catch (...) {
-              tiles::t_log("unhandled unknown error");
-              self->response_.result(http::status::internal_server_error);
-            }
-            self->response_.set(http::field::content_length,
-                                std::to_string(self->response_.body().size()));
-            http::async_write(self->socket_, self->response_,
-                              [self](beast::error_code ec, std::size_t) {
-                                self->socket_.shutdown(
-                                    tcp::socket::shutdown_send, ec);
-                                self->deadline_.cancel();
-                              });
+          if (ec) {  // closed by the client (keep-alive) or broken
+            self->deadline_.cancel();
+            return;
+          }
+
+          self->response_ = {};
+          self->response_.version(self->request_.version());
+          self->response_.keep_alive(self->request_.keep_alive());
+
+          try {
+            self->callback_(self->request_, self->response_);
+          } catch (std::exception const& e) {
+            tiles::t_log("unhandled error: {}", e.what());
+            self->response_.result(http::status::internal_server_error);
+          } catch (...) {
+            tiles::t_log("unhandled unknown error");
+            self->response_.result(http::status::internal_server_error);
           }
+          self->response_.set(http::field::content_length,
+                              std::to_string(self->response_.body().size()));
+          http::async_write(
+              self->socket_, self->response_,
+              [self](beast::error_code ec, std::size_t) {
+                if (!ec && self->response_.keep_alive()) {
+                  self->deadline_.expires_after(kIdleTimeout);
+                  self->check_deadline();
+                  self->read();
+                  return;
+                }
+                self->socket_.shutdown(tcp::socket::shutdown_send, ec);
+                self->deadline_.cancel();
+              });
         });
-    check_deadline();
   }
 
   void check_deadline() {
@@ -109,7 +133,7 @@ struct http_connection : public std::enable_shared_from_this<http_connection> {
   request_t request_;
   response_t response_;
   callback_t const& callback_;
-  net::steady_timer deadline_{socket_.get_executor(), std::chrono::seconds(60)};
+  net::steady_timer deadline_{socket_.get_executor(), kIdleTimeout};
 };
 
 void http_server(tcp::acceptor& acceptor, tcp::socket& socket,
@@ -147,16 +171,85 @@ void serve_forever(std::string const& address, uint16_t port, callback_t&& cb) {
   }
 }
 
+// monotonic counters, served as GET /metrics (prometheus text format)
+// load generators diff two scrapes (see tiles-loadgen)
+struct server_metrics {
+  static constexpr auto const kStatusClasses = 6U;  // index: status / 100
+
+  void count_response(response_t const& res) {
+    ++requests_;
+    ++responses_.at(std::min(res.result_int() / 100U, kStatusClasses - 1));
+    response_bytes_ += res.body().size();
+  }
+
+  void count_tile(perf_counter const& pc, size_t const bytes) {
+    ++tiles_;
+    if (bytes == 0) {
+      ++tiles_empty_;
+    }
+    tile_bytes_ += bytes;
+    for (auto i = 0U; i < perf_task::SIZE; ++i) {
+      get_tile_ns_[i] += std::accumulate(begin(pc.finished_[i]),
+                                         end(pc.finished_[i]), uint64_t{0});
+    }
+  }
+
+  std::string to_string() const {
+    std::string out;
+    auto const add = [&](std::string_view name, uint64_t const value) {
+      out.append(fmt::format("tiles_{} {}\n", name, value));
+    };
+
+    add("requests_total", requests_);
+    for (auto i = 1U; i < kStatusClasses; ++i) {
+      add(fmt::format("responses_total{{code=\"{}xx\"}}", i), responses_[i]);
+    }
+    add("response_bytes_total", response_bytes_);
+
+    add("tiles_total", tiles_);
+    add("tiles_empty_total", tiles_empty_);
+    add("tile_bytes_total", tile_bytes_);
+    add("get_tile_ns_total{stage=\"total\"}",
+        get_tile_ns_[perf_task::GET_TILE_TOTAL]);
+    add("get_tile_ns_total{stage=\"fetch\"}",
+        get_tile_ns_[perf_task::GET_TILE_FETCH]);
+    add("get_tile_ns_total{stage=\"render\"}",
+        get_tile_ns_[perf_task::GET_TILE_RENDER]);
+    add("get_tile_ns_total{stage=\"compress\"}",
+        get_tile_ns_[perf_task::GET_TILE_COMPRESS]);
+    return out;
+  }
+
+  std::atomic_uint64_t requests_{0}, response_bytes_{0};
+  std::array<std::atomic_uint64_t, kStatusClasses> responses_{};
+  std::atomic_uint64_t tiles_{0}, tiles_empty_{0}, tile_bytes_{0};
+  std::array<std::atomic_uint64_t, perf_task::SIZE> get_tile_ns_{};
+};
+
 struct server_settings : public conf::configuration {
   server_settings() : configuration("tiles-server options", "") {
     param(db_fname_, "db_fname", "/path/to/tiles.mdb");
     param(res_dname_, "res_dname", "/path/to/res");
     param(port_, "port", "the http port of the server");
+    param(point_grid_, "point_grid",
+          "point thinning per layer: 'layer:cell_px,...' (e.g. 'poi:16'), "
+          "keeps the point with the highest priority per grid cell");
+    param(max_tile_bytes_, "max_tile_bytes",
+          "tile byte budget (0: unlimited), drops lowest priority first");
+    param(priority_key_, "priority_key",
+          "feature metadata key (integer/numeric) ranking the features for "
+          "point_grid and max_tile_bytes (missing: priority zero)");
+    param(verbose_, "verbose",
+          "log every tile request with its timings (off for benchmarks)");
   }
 
   std::string db_fname_{"tiles.mdb"};
   std::string res_dname_;
   uint16_t port_{8888};
+  std::string point_grid_;
+  size_t max_tile_bytes_{0};
+  std::string priority_key_{"priority"};
+  bool verbose_{true};
 };
 
 int run_tiles_server(int argc, char const** argv) {
@@ -184,8 +277,12 @@ int run_tiles_server(int argc, char const** argv) {
 
   lmdb::env db_env = make_tile_database(opt.db_fname_.c_str());
   tile_db_handle handle{db_env};
-  auto const render_ctx = make_render_ctx(handle);
+  auto render_ctx = make_render_ctx(handle);
+  render_ctx.tb_priority_key_ = opt.priority_key_;
+  render_ctx.tb_max_tile_bytes_ = opt.max_tile_bytes_;
+  set_point_grid(render_ctx, opt.point_grid_);
   pack_handle pack_handle{opt.db_fname_.c_str()};
+  server_metrics metrics;
 
   auto const maybe_serve_tile = [&](auto const& req, auto& res) -> bool {
     static regex_matcher matcher{R"(^\/(\d+)\/(\d+)\/(\d+).mvt$)"};
@@ -201,12 +298,17 @@ int run_tiles_server(int argc, char const** argv) {
       return true;
     }
 
-    t_log("received a request: {}", req.target());
+    if (opt.verbose_) {
+      t_log("received a request: {}", req.target());
+    }
     auto const tile = url_match_to_tile(*match);
 
     perf_counter pc;
     auto rendered_tile = get_tile(handle, pack_handle, render_ctx, tile, pc);
-    perf_report_get_tile(pc);
+    metrics.count_tile(pc, rendered_tile ? rendered_tile->size() : 0);
+    if (opt.verbose_) {
+      perf_report_get_tile(pc);
+    }
 
     if (rendered_tile) {
       res.body() = std::move(*rendered_tile);
@@ -218,6 +320,16 @@ int run_tiles_server(int argc, char const** argv) {
     return true;
   };
 
+  auto const maybe_serve_metrics = [&](auto const& req, auto& res) -> bool {
+    if (req.target() != "/metrics") {
+      return false;
+    }
+    res.body() = metrics.to_string();
+    res.set(http::field::content_type, "text/plain; version=0.0.4");
+    res.result(http::status::ok);
+    return true;
+  };
+
   auto const maybe_serve_glyphs = [&](auto const& req, auto& res) -> bool {
     static regex_matcher matcher{"^\\/glyphs/(.+)$"};
     auto const decoded_url = url_decode(req);
@@ -297,6 +409,7 @@ int run_tiles_server(int argc, char const** argv) {
       case http::verb::get:
       case http::verb::head:
         if (!(maybe_serve_tile(req, res) ||  //
+              maybe_serve_metrics(req, res) ||  //
               maybe_serve_glyphs(req, res) ||  //
               maybe_serve_file(req, res))) {
           res.result(http::status::not_found);
@@ -304,6 +417,7 @@ int run_tiles_server(int argc, char const** argv) {
         break;
       default: res.result(http::status::method_not_allowed);
     }
+    metrics.count_response(res);
   });
 
   return 0;
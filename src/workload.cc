@@ -0,0 +1,210 @@
+#include "tiles/workload.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <tuple>
+
+#include "utl/verify.h"
+
+#include "tiles/constants.h"
+#include "tiles/fixed/convert.h"
+#include "tiles/util.h"
+
+namespace tiles {
+
+namespace {
+
+int64_t parse_int(std::string_view const sv) {
+  int64_t var = 0;
+  auto const result = std::from_chars(sv.data(), sv.data() + sv.size(), var);
+  utl::verify(result.ec == std::errc(), "cannot convert to int64_t: {}", sv);
+  return var;
+}
+
+// first six digits of a decimal fraction as microseconds
+int64_t parse_fraction_us(std::string_view const frac) {
+  int64_t us = 0;
+  for (auto i = 0ULL; i < 6; ++i) {
+    us = us * 10 + (i < frac.size() ? frac[i] - '0' : 0);
+  }
+  return us;
+}
+
+// days since 1970-01-01 of a proleptic gregorian date
+int64_t days_from_civil(int64_t y, int64_t const m, int64_t const d) {
+  y -= m <= 2 ? 1 : 0;
+  auto const era = (y >= 0 ? y : y - 399) / 400;
+  auto const yoe = y - era * 400;
+  auto const doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  auto const doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+struct timestamp_parser {
+  // microseconds, absolute or relative (only differences are used)
+  std::optional<int64_t> parse(std::string_view const line) const {
+    if (auto const match = offset_matcher_.match(line); match) {
+      return parse_int((*match)[1]) * 1'000'000 +
+             parse_fraction_us((*match)[2]);
+    }
+
+    if (auto const match = log_time_matcher_.match(line); match) {
+      auto const& m = *match;
+      auto const month = std::find(begin(kMonths), end(kMonths), m[2]);
+      if (month == end(kMonths)) {
+        return std::nullopt;
+      }
+
+      auto const days = days_from_civil(parse_int(m[3]),
+                                        std::distance(begin(kMonths), month) + 1,
+                                        parse_int(m[1]));
+      auto secs = days * 86'400 + parse_int(m[4]) * 3'600 +
+                  parse_int(m[5]) * 60 + parse_int(m[6]);
+      if (!m[8].empty()) {  // local time -> utc
+        auto const tz = parse_int(m[9]) * 3'600 + parse_int(m[10]) * 60;
+        secs += m[8] == "+" ? -tz : tz;
+      }
+      return secs * 1'000'000 + parse_fraction_us(m[7]);
+    }
+
+    return std::nullopt;
+  }
+
+  static constexpr std::array<std::string_view, 12> kMonths{
+      "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+      "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+  regex_matcher offset_matcher_{R"(^\s*(\d+)(?:\.(\d+))?\s+.*$)"};
+  regex_matcher log_time_matcher_{
+      R"(^.*?\[(\d{1,2})\/([A-Za-z]{3})\/(\d{4}):(\d{2}):(\d{2}):(\d{2}))"
+      R"((?:\.(\d+))?(?:\s+([+-])(\d{2})(\d{2}))?\].*$)"};
+};
+
+}  // namespace
+
+workload read_workload(std::string const& fname) {
+  std::ifstream in{fname};
+  utl::verify(in.good(), "read_workload: cannot open {}", fname);
+
+  regex_matcher matcher{R"(^.*?(\d+)\/(\d+)\/(\d+)(?:\.mvt)?(?:[\s?"].*)?$)"};
+  timestamp_parser timestamps_parser;
+
+  workload result;
+  std::vector<int64_t> timestamps;
+  size_t skipped = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    auto const match = matcher.match(line);
+    if (!match) {
+      ++skipped;
+      continue;
+    }
+
+    auto const z = stou((*match)[1]);
+    auto const x = stou((*match)[2]);
+    auto const y = stou((*match)[3]);
+    if (z > kMaxZoomLevel || x >= (1U << z) || y >= (1U << z)) {
+      ++skipped;
+      continue;
+    }
+    result.tiles_.push_back(geo::tile{x, y, z});
+
+    if (auto const t = timestamps_parser.parse(line); t) {
+      timestamps.push_back(*t);
+    }
+  }
+
+  if (!timestamps.empty() && timestamps.size() == result.tiles_.size()) {
+    // access logs are written on completion: small reorderings are clamped
+    auto arrival = int64_t{0};
+    for (auto const t : timestamps) {
+      arrival = std::max(arrival, t - timestamps.front());
+      result.arrivals_.emplace_back(arrival);
+    }
+  } else if (!timestamps.empty()) {
+    t_log("read_workload: only {} of {} tiles with timestamp (ignored)",
+          printable_num{timestamps.size()},
+          printable_num{result.tiles_.size()});
+  }
+
+  t_log("read_workload: {} tiles ({} lines skipped, {})",
+        printable_num{result.tiles_.size()}, printable_num{skipped},
+        result.arrivals_.empty() ? "untimed" : "timed");
+  return result;
+}
+
+void write_workload(std::string const& fname, workload const& w) {
+  std::ofstream out{fname};
+  utl::verify(out.good(), "write_workload: cannot open {}", fname);
+  for (auto i = 0ULL; i < w.tiles_.size(); ++i) {
+    auto const& tile = w.tiles_[i];
+    if (!w.arrivals_.empty()) {
+      auto const us = w.arrivals_[i].count();
+      out << fmt::format("{}.{:06} ", us / 1'000'000, us % 1'000'000);
+    }
+    out << tile.z_ << '/' << tile.x_ << '/' << tile.y_ << '\n';
+  }
+}
+
+std::vector<geo::tile> make_zipf_workload(
+    zipf_workload_settings const& settings) {
+  utl::verify(!settings.centers_.empty(), "zipf workload: no centers");
+  utl::verify(settings.min_z_ <= settings.max_z_ &&
+                  settings.max_z_ <= kMaxZoomLevel,
+              "zipf workload: invalid zoom levels");
+
+  // offsets ranked by distance to the center tile (closest first)
+  auto const r = static_cast<int64_t>(settings.radius_);
+  std::vector<std::pair<int64_t, int64_t>> offsets;
+  for (auto dx = -r; dx <= r; ++dx) {
+    for (auto dy = -r; dy <= r; ++dy) {
+      offsets.emplace_back(dx, dy);
+    }
+  }
+  std::stable_sort(
+      begin(offsets), end(offsets), [](auto const& a, auto const& b) {
+        return a.first * a.first + a.second * a.second <
+               b.first * b.first + b.second * b.second;
+      });
+
+  std::vector<double> weights;
+  weights.reserve(offsets.size());
+  for (auto k = 1ULL; k <= offsets.size(); ++k) {
+    weights.push_back(1. /
+                      std::pow(static_cast<double>(k), settings.exponent_));
+  }
+
+  std::mt19937 gen{settings.seed_};
+  std::uniform_int_distribution<size_t> center_dist{
+      0, settings.centers_.size() - 1};
+  std::uniform_int_distribution<uint32_t> z_dist{settings.min_z_,
+                                                 settings.max_z_};
+  std::discrete_distribution<size_t> rank_dist{begin(weights), end(weights)};
+
+  std::vector<geo::tile> tiles;
+  tiles.reserve(settings.count_);
+  for (auto i = 0ULL; i < settings.count_; ++i) {
+    auto const center = latlng_to_fixed(settings.centers_[center_dist(gen)]);
+    auto const z = z_dist(gen);
+    auto const [dx, dy] = offsets[rank_dist(gen)];
+
+    // fixed coordinates: pixels (kTileSize per tile) at kMaxZoomLevel
+    auto const max_coord = (int64_t{1} << z) - 1;
+    auto const to_tile = [&](fixed_coord_t const c, int64_t const d) {
+      auto const t = (c >> (kMaxZoomLevel - z)) / kTileSize + d;
+      return static_cast<uint32_t>(std::clamp(t, int64_t{0}, max_coord));
+    };
+    tiles.push_back(
+        geo::tile{to_tile(center.x(), dx), to_tile(center.y(), dy), z});
+  }
+  return tiles;
+}
+
+}  // namespace tiles
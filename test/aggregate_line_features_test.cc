@@ -1,7 +1,11 @@
 #include "catch2/catch.hpp"
 
+#include <random>
+
 #include "tiles/feature/aggregate_line_features.h"
 #include "tiles/feature/feature.h"
+#include "tiles/feature/metadata.h"
+#include "tiles/util.h"
 
 TEST_CASE("aggregate_line_features") {
 
@@ -114,4 +118,116 @@ TEST_CASE("aggregate_line_features") {
     CHECK(geo.front()[2] == tiles::fixed_xy(12, 12));
     CHECK(geo.front()[3] == tiles::fixed_xy(13, 13));
   }
+
+  SECTION("junction") {
+    tiles::feature f1;
+    f1.id_ = 1;
+    f1.geometry_ = tiles::fixed_polyline{{{10, 10}, {11, 11}}};
+
+    tiles::feature f2;
+    f2.id_ = 2;
+    f2.geometry_ = tiles::fixed_polyline{{{11, 11}, {12, 12}}};
+
+    tiles::feature f3;
+    f3.id_ = 3;
+    f3.geometry_ = tiles::fixed_polyline{{{11, 11}, {12, 10}}};
+
+    auto result = tiles::aggregate_line_features({f1, f2, f3}, 99);
+    REQUIRE(result.size() == 1);
+
+    auto geo = mpark::get<tiles::fixed_polyline>(result.at(0).geometry_);
+    CHECK(geo.size() == 3);
+  }
+
+  SECTION("cycle") {
+    tiles::feature f1;
+    f1.id_ = 1;
+    f1.geometry_ = tiles::fixed_polyline{{{10, 10}, {11, 11}}};
+
+    tiles::feature f2;
+    f2.id_ = 2;
+    f2.geometry_ = tiles::fixed_polyline{{{11, 11}, {12, 10}}};
+
+    tiles::feature f3;
+    f3.id_ = 3;
+    f3.geometry_ = tiles::fixed_polyline{{{12, 10}, {10, 10}}};
+
+    auto result = tiles::aggregate_line_features({f1, f2, f3}, 99);
+    REQUIRE(result.size() == 1);
+
+    auto geo = mpark::get<tiles::fixed_polyline>(result.at(0).geometry_);
+    REQUIRE(geo.size() == 1);
+    REQUIRE(geo.front().size() == 4);
+    CHECK(geo.front().front() == geo.front().back());
+  }
+
+  SECTION("oneway") {
+    auto const make_oneway = [](uint64_t const id, tiles::fixed_line line) {
+      tiles::feature f;
+      f.id_ = id;
+      f.meta_ = {{"oneway", tiles::encode_string("yes")}};
+      f.geometry_ = tiles::fixed_polyline{std::move(line)};
+      return f;
+    };
+
+    {  // consistent direction -> joined
+      auto result = tiles::aggregate_line_features(
+          {make_oneway(1, {{10, 10}, {11, 11}}),
+           make_oneway(2, {{11, 11}, {12, 12}})},
+          99);
+      REQUIRE(result.size() == 1);
+      auto geo = mpark::get<tiles::fixed_polyline>(result.at(0).geometry_);
+      REQUIRE(geo.size() == 1);
+      CHECK(geo.front().size() == 3);
+    }
+    {  // conflicting direction -> not joined
+      auto result = tiles::aggregate_line_features(
+          {make_oneway(1, {{10, 10}, {11, 11}}),
+           make_oneway(2, {{12, 12}, {11, 11}})},
+          99);
+      REQUIRE(result.size() == 1);
+      auto geo = mpark::get<tiles::fixed_polyline>(result.at(0).geometry_);
+      REQUIRE(geo.size() == 2);
+      CHECK(geo[0].front() == tiles::fixed_xy(10, 10));
+      CHECK(geo[1].front() == tiles::fixed_xy(12, 12));
+    }
+  }
+}
+
+TEST_CASE("aggregate_line_features_benchmark", "[!hide]") {
+  // dense road grid: every street segment between two crossings is a way,
+  // long straight roads without crossings are split into many ways
+  constexpr auto const kGridSize = 300;
+  constexpr auto const kSplits = 4;
+  constexpr auto const kSpacing = 1000;
+
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<int> meta_dist{0, 3};
+
+  std::vector<tiles::feature> features;
+  auto const add = [&](tiles::fixed_xy const& from, tiles::fixed_xy const& to) {
+    tiles::feature f;
+    f.id_ = features.size();
+    f.meta_ = {{"highway", tiles::encode_string(meta_dist(gen) == 0
+                                                    ? "primary"
+                                                    : "residential")}};
+    f.geometry_ = tiles::fixed_polyline{{from, to}};
+    features.emplace_back(std::move(f));
+  };
+
+  for (auto i = 0; i < kGridSize; ++i) {
+    for (auto j = 0; j < kGridSize * kSplits; ++j) {
+      auto const a = j * kSpacing / kSplits;
+      auto const b = (j + 1) * kSpacing / kSplits;
+      add({i * kSpacing, a}, {i * kSpacing, b});
+      add({a, i * kSpacing}, {b, i * kSpacing});
+    }
+  }
+
+  tiles::t_log("aggregate {} features", tiles::printable_num{features.size()});
+  for (auto i = 0; i < 5; ++i) {
+    tiles::scoped_timer t{"aggregate_line_features"};
+    auto result = tiles::aggregate_line_features(features, 14);
+    CHECK(result.size() == 2);
+  }
 }
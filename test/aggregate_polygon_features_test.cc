@@ -0,0 +1,68 @@
+#include "catch2/catch.hpp"
+
+#include "tiles/feature/aggregate_polygon_features.h"
+#include "tiles/feature/feature.h"
+#include "tiles/fixed/algo/area.h"
+
+namespace {
+
+tiles::feature make_square(uint64_t const id, tiles::fixed_coord_t const x,
+                           tiles::fixed_coord_t const y,
+                           tiles::fixed_coord_t const size,
+                           std::string const& value) {
+  tiles::fixed_simple_polygon polygon{
+      {{x, y}, {x, y + size}, {x + size, y + size}, {x + size, y}, {x, y}}};
+  boost::geometry::correct(polygon);
+
+  tiles::feature f;
+  f.id_ = id;
+  f.layer_ = 0;
+  f.meta_ = {{"landuse", value}};
+  f.geometry_ = tiles::fixed_polygon{std::move(polygon)};
+  return f;
+}
+
+}  // namespace
+
+TEST_CASE("aggregate_polygon_features") {
+  constexpr auto const kZ = 14U;
+  constexpr auto const kGrid = 1 << (tiles::kMaxZoomLevel - kZ);
+
+  SECTION("adjacent same metadata") {
+    auto result = tiles::aggregate_polygon_features(
+        {make_square(1, 0, 0, 100 * kGrid, "forest"),
+         make_square(2, 100 * kGrid, 0, 100 * kGrid, "forest")},
+        kZ);
+    REQUIRE(result.size() == 1);
+    CHECK(result[0].id_ == 1);
+
+    auto const& geo = mpark::get<tiles::fixed_polygon>(result[0].geometry_);
+    REQUIRE(geo.size() == 1);
+    CHECK(geo[0].inners().empty());
+    CHECK(geo[0].outer().size() == 5);  // collinear points are removed
+    CHECK(tiles::area(result[0].geometry_) == 200LL * kGrid * 100 * kGrid);
+  }
+
+  SECTION("gap below grid is closed") {
+    auto result = tiles::aggregate_polygon_features(
+        {make_square(1, 0, 0, 100 * kGrid, "forest"),
+         make_square(2, 100 * kGrid + kGrid / 4, 0, 100 * kGrid, "forest")},
+        kZ);
+    REQUIRE(result.size() == 1);
+    CHECK(mpark::get<tiles::fixed_polygon>(result[0].geometry_).size() == 1);
+  }
+
+  SECTION("different metadata") {
+    auto result = tiles::aggregate_polygon_features(
+        {make_square(1, 0, 0, 100 * kGrid, "forest"),
+         make_square(2, 100 * kGrid, 0, 100 * kGrid, "meadow")},
+        kZ);
+    CHECK(result.size() == 2);
+  }
+
+  SECTION("collapsed") {
+    auto result = tiles::aggregate_polygon_features(
+        {make_square(1, 0, 0, kGrid / 4, "forest")}, kZ);
+    CHECK(result.empty());
+  }
+}
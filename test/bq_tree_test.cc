@@ -1,5 +1,6 @@
 #include "catch2/catch.hpp"
 
+#include <algorithm>
 #include <fstream>
 
 #include "tiles/db/bq_tree.h"
@@ -196,6 +197,55 @@ TEST_CASE("bq_tree_all_leafs") {
   }
 }
 
+TEST_CASE("bq_tree_bitmap") {
+  auto const check_equal = [](std::vector<geo::tile> const& tiles) {
+    auto const tree = tiles::make_bq_tree(tiles);
+    auto bitmap_tree = tiles::make_bq_tree(tiles);
+    bitmap_tree.materialize_bitmap();
+    REQUIRE(bitmap_tree.bitmap_z_.has_value());
+
+    for (auto z = 0U; z <= 5U; ++z) {
+      for (auto x = 0U; x < (1U << z); ++x) {
+        for (auto y = 0U; y < (1U << z); ++y) {
+          geo::tile const t{x, y, z};
+          CHECK(tree.contains(t) == bitmap_tree.contains(t));
+
+          auto expected = tree.all_leafs(t);
+          auto actual = bitmap_tree.all_leafs(t);
+          std::sort(begin(expected), end(expected));
+          std::sort(begin(actual), end(actual));
+          CHECK(expected == actual);
+        }
+      }
+    }
+  };
+
+  SECTION("root tree") {
+    check_equal({});
+    check_equal({{0, 0, 0}});
+  }
+
+  SECTION("l2 tree") { check_equal({{0, 1, 2}, {3, 3, 2}}); }
+
+  SECTION("mixed levels") {
+    check_equal({{1, 1, 1}, {0, 1, 2}, {5, 2, 3}, {4, 3, 3}, {0, 0, 4}});
+  }
+
+  SECTION("too deep") {
+    auto tree = tiles::make_bq_tree({{0, 0, 1}, {5, 7, 4}});
+    tree.materialize_bitmap(3);
+    CHECK_FALSE(tree.bitmap_z_.has_value());
+    CHECK(tree.contains({5, 7, 4}));
+    CHECK_FALSE(tree.contains({5, 6, 4}));
+
+    tree.materialize_bitmap(4);
+    REQUIRE(tree.bitmap_z_.has_value());
+    CHECK(4 == *tree.bitmap_z_);
+    CHECK(tree.contains({10, 14, 5}));
+    CHECK_FALSE(tree.contains({10, 12, 5}));
+  }
+}
+
 TEST_CASE("bq_tree_tsv_file", "[!hide]") {
   std::ifstream in("tiles.tsv");
 
@@ -1,10 +1,16 @@
 #include "catch2/catch.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <random>
+#include <vector>
 
+#include "tiles/fixed/algo/make_simplify_mask.h"
+#include "tiles/fixed/algo/simplify.h"
 #include "tiles/fixed/fixed_geometry.h"
 #include "tiles/fixed/io/deserialize.h"
 #include "tiles/fixed/io/serialize.h"
+#include "tiles/util.h"
 
 using namespace tiles;
 
@@ -62,3 +68,167 @@ TEST_CASE("fixed polyline io") {
     CHECK(test_case == mpark::get<fixed_polyline>(deserialized));
   }
 }
+
+fixed_ring make_circle(fixed_coord_t const cx, fixed_coord_t const cy,
+                       double const radius, size_t const count) {
+  fixed_ring ring;
+  for (auto i = 0ULL; i < count; ++i) {
+    auto const angle = 2. * 3.14159265358979323846 * static_cast<double>(i) /
+                       static_cast<double>(count);
+    ring.emplace_back(
+        cx + static_cast<fixed_coord_t>(radius * std::cos(angle)),
+        cy + static_cast<fixed_coord_t>(radius * std::sin(angle)));
+  }
+  ring.push_back(ring.front());
+  return ring;
+}
+
+TEST_CASE("fixed polygon simplify") {
+  constexpr auto const kCenter = kFixedCoordMagicOffset;
+
+  fixed_polygon polygon;
+  polygon.emplace_back();
+  polygon[0].outer() = make_circle(kCenter, kCenter, 1'000'000., 1000);
+  polygon[0].inners().push_back(make_circle(kCenter, kCenter, 100., 16));
+  polygon.emplace_back();
+  polygon[1].outer() = make_circle(kCenter + 2'000'000, kCenter, 200., 16);
+
+  SECTION("simplify") {
+    auto const result = simplify(polygon, 1ULL << (kMaxZoomLevel - 5));
+    auto const& simplified = mpark::get<fixed_polygon>(result);
+    REQUIRE(1 == simplified.size());
+    CHECK(simplified[0].outer().size() < polygon[0].outer().size());
+    CHECK(simplified[0].outer().front() == simplified[0].outer().back());
+    CHECK(simplified[0].inners().empty());
+
+    CHECK(mpark::holds_alternative<fixed_null>(
+        simplify(fixed_polygon{polygon[1]}, 1ULL << (kMaxZoomLevel - 5))));
+  }
+
+  SECTION("deserialize with masks") {
+    auto const serialized = serialize(polygon);
+    auto const masks_storage = make_simplify_mask(polygon);
+    std::vector<std::string_view> masks{begin(masks_storage),
+                                        end(masks_storage)};
+
+    auto const full = deserialize(serialized, masks, kMaxZoomLevel);
+    REQUIRE(mpark::holds_alternative<fixed_polygon>(full));
+    auto const& full_polygon = mpark::get<fixed_polygon>(full);
+    REQUIRE(2 == full_polygon.size());
+    CHECK(1 == full_polygon[0].inners().size());
+
+    // small rings are dropped, the large one is simplified
+    auto const low = deserialize(serialized, masks, 5);
+    REQUIRE(mpark::holds_alternative<fixed_polygon>(low));
+    auto const& low_polygon = mpark::get<fixed_polygon>(low);
+    REQUIRE(1 == low_polygon.size());
+    CHECK(low_polygon[0].outer().size() < polygon[0].outer().size());
+    CHECK(low_polygon[0].inners().empty());
+  }
+}
+
+namespace {
+
+// reference: plain recursive Douglas-Peucker for one zoom level
+void reference_simplify(fixed_line const& line, size_t const lb,
+                        size_t const ub, double const squared_tolerance,
+                        std::vector<bool>& keep) {
+  if (ub - lb < 2) {
+    return;
+  }
+
+  auto const rel = [&](size_t const i) {
+    return std::make_pair(static_cast<double>(line[i].x() - line[0].x()),
+                          static_cast<double>(line[i].y() - line[0].y()));
+  };
+  auto const [ax, ay] = rel(lb);
+  auto const [bx, by] = rel(ub);
+  auto const dx = bx - ax;
+  auto const dy = by - ay;
+  auto const len2 = dx * dx + dy * dy;
+
+  auto max_dist = -1.;
+  auto split = lb;
+  for (auto i = lb + 1; i < ub; ++i) {
+    auto const [x, y] = rel(i);
+    auto const px = x - ax;
+    auto const py = y - ay;
+    auto const t = len2 > 0.
+                       ? std::min(1., std::max(0., (px * dx + py * dy) *
+                                                       (1. / len2)))
+                       : 0.;
+    auto const ex = px - t * dx;
+    auto const ey = py - t * dy;
+    if (ex * ex + ey * ey > max_dist) {
+      max_dist = ex * ex + ey * ey;
+      split = i;
+    }
+  }
+
+  if (max_dist > squared_tolerance) {
+    keep[split] = true;
+    reference_simplify(line, lb, split, squared_tolerance, keep);
+    reference_simplify(line, split, ub, squared_tolerance, keep);
+  }
+}
+
+fixed_line make_random_walk(size_t const count, std::mt19937& gen) {
+  std::normal_distribution<double> step{0., 2000.};
+  fixed_line line;
+  line.emplace_back(kFixedCoordMagicOffset, kFixedCoordMagicOffset);
+  for (auto i = 1ULL; i < count; ++i) {
+    line.emplace_back(line.back().x() + static_cast<fixed_coord_t>(step(gen)),
+                      line.back().y() + static_cast<fixed_coord_t>(step(gen)));
+  }
+  return line;
+}
+
+}  // namespace
+
+TEST_CASE("make_simplify_mask") {
+  std::mt19937 gen{42};
+  auto const line = make_random_walk(5000, gen);
+  auto const mask = make_simplify_mask_for(line);
+  REQUIRE(mask.size() == line.size());
+
+  for (auto z = 0U; z < kMaxZoomLevel; ++z) {
+    auto const tolerance = static_cast<double>(1ULL << (kMaxZoomLevel - z));
+    std::vector<bool> expected(line.size(), false);
+    expected.front() = true;
+    expected.back() = true;
+    reference_simplify(line, 0, line.size() - 1, tolerance * tolerance,
+                       expected);
+
+    for (auto i = 0ULL; i < line.size(); ++i) {
+      CHECK(expected[i] == (static_cast<uint8_t>(mask[i]) <= z));
+    }
+  }
+
+  CHECK(std::all_of(begin(mask), end(mask), [](auto const level) {
+    return static_cast<uint8_t>(level) <= kMaxZoomLevel;
+  }));
+}
+
+TEST_CASE("make_simplify_mask_benchmark", "[!hide]") {
+  std::mt19937 gen{42};
+
+  auto const coastline = make_circle(kFixedCoordMagicOffset,
+                                     kFixedCoordMagicOffset, 1e8, 5'000'000);
+  std::vector<fixed_line> rivers;
+  for (auto i = 0; i < 1000; ++i) {
+    rivers.push_back(make_random_walk(10'000, gen));
+  }
+
+  {
+    scoped_timer t{"coastline ring (5M points)"};
+    CHECK(make_simplify_mask_for(coastline).size() == coastline.size());
+  }
+  {
+    scoped_timer t{"river lines (1000 x 10k points)"};
+    auto total = 0ULL;
+    for (auto const& river : rivers) {
+      total += make_simplify_mask_for(river).size();
+    }
+    CHECK(total == 10'000'000);
+  }
+}
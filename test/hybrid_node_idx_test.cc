@@ -1,10 +1,15 @@
 #include "catch2/catch.hpp"
 
+#include <algorithm>
+#include <limits>
+#include <random>
+
 #include "osmium/index/detail/tmpfile.hpp"
 #include "osmium/io/pbf_input.hpp"
 #include "osmium/io/reader_iterator.hpp"
 #include "osmium/visitor.hpp"
 
+#include "tiles/osm/dense_node_idx.h"
 #include "tiles/osm/hybrid_node_idx.h"
 #include "tiles/util.h"
 
@@ -226,6 +231,39 @@ TEST_CASE("hybrid_node_idx") {  // NOLINT
     }
   }
 
+  SECTION("checkpoints") {
+    auto const idx_fd = osmium::detail::create_tmp_file();
+    auto const dat_fd = osmium::detail::create_tmp_file();
+
+    constexpr auto kCount = 5000;
+    {
+      tiles::hybrid_node_idx_builder builder{idx_fd, dat_fd};
+      for (auto i = 0; i < kCount; ++i) {
+        builder.push(1000 + i, {i, 2 * i});
+      }
+      builder.finish();
+
+      CHECK(5 == builder.get_stat_spans());  // 4 x 1024 + 904
+    }
+
+    tiles::hybrid_node_idx nodes{idx_fd, dat_fd};
+    CHECK_FALSE(get_coords(nodes, 999));
+    CHECK_FALSE(get_coords(nodes, 1000 + kCount));
+    for (auto i = 0; i < kCount; ++i) {
+      CHECK_EXISTS(nodes, 1000 + i, i, 2 * i);
+    }
+
+    std::vector<osmium::Location> locs(kCount);
+    std::vector<std::pair<osmium::object_id_type, osmium::Location*>> query;
+    for (auto i = kCount - 1; i >= 0; i -= 7) {
+      query.emplace_back(1000 + i, &locs[i]);
+    }
+    tiles::get_coords(nodes, query);
+    for (auto i = kCount - 1; i >= 0; i -= 7) {
+      CHECK_LOCATION(locs[i], i, 2 * i);
+    }
+  }
+
   SECTION("large numbers") {
     auto const idx_fd = osmium::detail::create_tmp_file();
     auto const dat_fd = osmium::detail::create_tmp_file();
@@ -401,6 +439,126 @@ TEST_CASE("hybrid_node_idx") {  // NOLINT
       CHECK_THROWS(builder.push(42, {2, 2}));
     }
   }
+
+  SECTION("chunks") {
+    auto const idx_fd = osmium::detail::create_tmp_file();
+    auto const dat_fd = osmium::detail::create_tmp_file();
+
+    {
+      tiles::hybrid_node_idx_builder builder{idx_fd, dat_fd};
+
+      tiles::hybrid_node_idx_chunk c0;
+      c0.push(42, {2, 3});
+      c0.push(43, {5, 6});
+      c0.finish();
+      builder.append(c0);
+
+      tiles::hybrid_node_idx_chunk c1;  // consecutive
+      c1.push(44, {8, 9});
+      c1.finish();
+      builder.append(c1);
+
+      tiles::hybrid_node_idx_chunk c2;  // empty
+      c2.finish();
+      builder.append(c2);
+
+      tiles::hybrid_node_idx_chunk c3;  // gap
+      c3.push(50, {1, 2});
+      c3.push(52, {4, 5});
+      c3.finish();
+      builder.append(c3);
+
+      tiles::hybrid_node_idx_chunk c4;  // not sorted
+      c4.push(51, {1, 2});
+      c4.finish();
+      CHECK_THROWS(builder.append(c4));
+
+      builder.push(60, {7, 7});
+      builder.finish();
+
+      CHECK(builder.get_stat_spans() == 5);
+    }
+
+    tiles::hybrid_node_idx nodes{idx_fd, dat_fd};
+    CHECK_FALSE(get_coords(nodes, 41));
+    CHECK_EXISTS(nodes, 42, 2, 3);
+    CHECK_EXISTS(nodes, 43, 5, 6);
+    CHECK_EXISTS(nodes, 44, 8, 9);
+    CHECK_FALSE(get_coords(nodes, 45));
+    CHECK_EXISTS(nodes, 50, 1, 2);
+    CHECK_FALSE(get_coords(nodes, 51));
+    CHECK_EXISTS(nodes, 52, 4, 5);
+    CHECK_FALSE(get_coords(nodes, 59));
+    CHECK_EXISTS(nodes, 60, 7, 7);
+    CHECK_FALSE(get_coords(nodes, 61));
+
+    osmium::Location l43;
+    osmium::Location l52;
+    osmium::Location l60;
+    get_coords_helper(nodes, {{60L, &l60}, {43L, &l43}, {52L, &l52}});
+    CHECK_LOCATION(l43, 5, 6);
+    CHECK_LOCATION(l52, 4, 5);
+    CHECK_LOCATION(l60, 7, 7);
+  }
+}
+
+TEST_CASE("hybrid_node_idx chunk boundary duplicate") {  // NOLINT
+  auto const idx_fd = osmium::detail::create_tmp_file();
+  auto const dat_fd = osmium::detail::create_tmp_file();
+
+  {
+    tiles::hybrid_node_idx_builder builder{idx_fd, dat_fd};
+
+    tiles::hybrid_node_idx_chunk c0;
+    c0.push(42, {2, 3});
+    c0.push(43, {5, 6});
+    c0.finish();
+    builder.append(c0);
+
+    tiles::hybrid_node_idx_chunk c1;  // 43 repeated, then two spans + gap
+    c1.push(43, {5, 6});
+    c1.push(44, {8, 9});
+    c1.push(45, {2251065056, 1454559573});  // large delta: new coord span
+    c1.push(50, {1, 2});
+    c1.finish();
+    builder.append(c1);
+
+    tiles::hybrid_node_idx_chunk c2;  // only the repeated node
+    c2.push(-50, {1, 2});
+    c2.finish();
+    builder.append(c2);
+
+    tiles::hybrid_node_idx_chunk c3;  // consecutive after the duplicate
+    c3.push(51, {4, 5});
+    c3.finish();
+    builder.append(c3);
+
+    tiles::hybrid_node_idx_chunk c4;  // repeated, mismatching coordinates
+    c4.push(51, {7, 7});
+    c4.push(52, {7, 8});
+    c4.finish();
+    CHECK_THROWS(builder.append(c4));
+
+    builder.finish();
+  }
+
+  tiles::hybrid_node_idx nodes{idx_fd, dat_fd};
+  CHECK_FALSE(get_coords(nodes, 41));
+  CHECK_EXISTS(nodes, 42, 2, 3);
+  CHECK_EXISTS(nodes, 43, 5, 6);
+  CHECK_EXISTS(nodes, 44, 8, 9);
+  CHECK_EXISTS(nodes, 45, 2251065056, 1454559573);
+  CHECK_FALSE(get_coords(nodes, 46));
+  CHECK_FALSE(get_coords(nodes, 49));
+  CHECK_EXISTS(nodes, 50, 1, 2);
+  CHECK_EXISTS(nodes, 51, 4, 5);
+  CHECK_FALSE(get_coords(nodes, 52));
+
+  osmium::Location l43;
+  osmium::Location l51;
+  get_coords_helper(nodes, {{51L, &l51}, {43L, &l43}});
+  CHECK_LOCATION(l43, 5, 6);
+  CHECK_LOCATION(l51, 4, 5);
 }
 
 TEST_CASE("hybrid_node_idx_benchmark", "[!hide]") {
@@ -417,3 +575,102 @@ TEST_CASE("hybrid_node_idx_benchmark", "[!hide]") {
 
   builder.dump_stats();
 }
+
+TEST_CASE("dense_node_idx") {  // NOLINT
+  SECTION("null") {
+    tiles::dense_node_idx nodes;
+    CHECK_FALSE(get_coords(nodes, 0));
+  }
+
+  SECTION("entries") {
+    tiles::dense_node_idx nodes;
+    {
+      tiles::dense_node_idx_builder builder{nodes};
+      builder.push(0, {0, 0});
+      builder.push(42, {2, 3});
+      builder.push(43, {5, 6});
+      builder.push(-44, {8, 9});
+      builder.push(-44, {8, 9});
+      builder.push(1000000, {std::numeric_limits<uint32_t>::max() - 1, 1});
+      CHECK_THROWS(builder.push(42, {3, 3}));
+      CHECK_THROWS(builder.push(50, {std::numeric_limits<uint32_t>::max(), 1}));
+      builder.finish();
+    }
+
+    CHECK_EXISTS(nodes, 0, 0, 0);
+    CHECK_FALSE(get_coords(nodes, 1));
+    CHECK_EXISTS(nodes, 42, 2, 3);
+    CHECK_EXISTS(nodes, 43, 5, 6);
+    CHECK_EXISTS(nodes, 44, 8, 9);
+    CHECK_FALSE(get_coords(nodes, 45));
+    CHECK_EXISTS(nodes, 1000000, std::numeric_limits<uint32_t>::max() - 1, 1);
+    CHECK_FALSE(get_coords(nodes, 1000001));
+
+    osmium::Location l43;
+    osmium::Location l44;
+    std::vector<std::pair<osmium::object_id_type, osmium::Location*>> query{
+        {-44L, &l44}, {43L, &l43}};
+    tiles::get_coords(nodes, query);
+    CHECK_LOCATION(l43, 5, 6);
+    CHECK_LOCATION(l44, 8, 9);
+  }
+}
+
+TEST_CASE("node_idx_lookup_benchmark", "[!hide]") {
+  constexpr auto kNodes = 50'000'000ULL;
+  constexpr auto kQueries = 10'000'000ULL;
+
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<int64_t> coord_dist{0, 1000};
+  std::uniform_int_distribution<int> gap_dist{0, 9};
+
+  tiles::hybrid_node_idx hybrid;
+  tiles::dense_node_idx dense;
+  std::vector<osmium::object_id_type> ids;
+  {
+    tiles::scoped_timer t{"build both"};
+    tiles::hybrid_node_idx_builder hybrid_builder{hybrid};
+    tiles::dense_node_idx_builder dense_builder{dense};
+
+    osmium::object_id_type id = 1;
+    tiles::fixed_xy pos{1'000'000'000, 1'000'000'000};
+    for (auto i = 0ULL; i < kNodes; ++i) {
+      id += (gap_dist(gen) == 0) ? 100 : 1;
+      pos = {pos.x() + coord_dist(gen) - 500, pos.y() + coord_dist(gen) - 500};
+      hybrid_builder.push(id, pos);
+      dense_builder.push(id, pos);
+      if (i % (kNodes / kQueries) == 0) {
+        ids.push_back(id);
+      }
+    }
+    hybrid_builder.finish();
+    dense_builder.finish();
+    hybrid_builder.dump_stats();
+    dense_builder.dump_stats();
+  }
+  std::shuffle(begin(ids), end(ids), gen);
+
+  auto const run = [&](auto const& name, auto const& nodes) {
+    std::vector<osmium::Location> locs(ids.size());
+    std::vector<std::pair<osmium::object_id_type, osmium::Location*>> queries;
+    queries.reserve(ids.size());
+    for (auto i = 0ULL; i < ids.size(); ++i) {
+      queries.emplace_back(ids[i], &locs[i]);
+    }
+
+    {
+      tiles::scoped_timer t{fmt::format("{} random single", name)};
+      auto found = 0ULL;
+      for (auto const id : ids) {
+        found += get_coords(nodes, id).has_value() ? 1 : 0;
+      }
+      CHECK(found == ids.size());
+    }
+    {
+      tiles::scoped_timer t{fmt::format("{} batch", name)};
+      tiles::get_coords(nodes, queries);
+    }
+  };
+  run("hybrid", hybrid);
+  run("dense", dense);
+}
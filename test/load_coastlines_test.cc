@@ -0,0 +1,204 @@
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "miniz.h"
+
+#include "tiles/db/clear_database.h"
+#include "tiles/db/feature_inserter_mt.h"
+#include "tiles/db/pack_file.h"
+#include "tiles/db/tile_database.h"
+#include "tiles/fixed/convert.h"
+#include "tiles/osm/load_coastlines.h"
+#include "tiles/osm/load_shapefile.h"
+#include "tiles/osm/write_shapefile.h"
+#include "tiles/util.h"
+
+namespace {
+
+constexpr auto const kPi = 3.14159265358979323846;
+
+std::vector<geo::latlng> make_ring(double const lng, double const lat,
+                                   double const radius,
+                                   size_t const num_points, std::mt19937& gen) {
+  std::uniform_real_distribution<double> jitter{0.8, 1.0};
+
+  std::vector<geo::latlng> ring;
+  ring.reserve(num_points + 1);
+  for (auto i = 0ULL; i < num_points; ++i) {
+    auto const angle = -2. * kPi * static_cast<double>(i) /
+                       static_cast<double>(num_points);  // clockwise
+    auto const r = radius * jitter(gen);
+    ring.push_back(
+        geo::latlng{lat + r * std::sin(angle), lng + r * std::cos(angle)});
+  }
+  ring.push_back(ring.front());
+  return ring;
+}
+
+std::vector<tiles::fixed_simple_polygon> write_and_load(
+    std::string const& fname,
+    std::vector<tiles::shapefile_polygon> const& polygons,
+    bool const with_shx) {
+  tiles::write_shapefile(fname, polygons, with_shx);
+
+  std::vector<tiles::fixed_simple_polygon> result;
+  tiles::load_shapefile(
+      fname, [&](auto&& polygon) { result.emplace_back(std::move(polygon)); });
+  std::remove(fname.c_str());
+  return result;
+}
+
+// appends garbage to the .shp file in the zip
+void append_to_shp(std::string const& fname, std::string const& bytes) {
+  auto const extract = [&](char const* name) {
+    size_t size = 0;
+    auto* data =
+        mz_zip_extract_archive_file_to_heap(fname.c_str(), name, &size, 0);
+    REQUIRE(data != nullptr);
+    std::string buf{static_cast<char const*>(data), size};
+    mz_free(data);
+    return buf;
+  };
+
+  auto const shp = extract("land_polygons.shp") + bytes;
+  auto const shx = extract("land_polygons.shx");
+
+  std::remove(fname.c_str());
+  for (auto const& [name, data] : {std::make_pair("land_polygons.shp", &shp),
+                                   std::make_pair("land_polygons.shx", &shx)}) {
+    REQUIRE(mz_zip_add_mem_to_archive_file_in_place(
+                fname.c_str(), name, data->data(), data->size(), nullptr, 0,
+                MZ_DEFAULT_COMPRESSION) != 0);
+  }
+}
+
+}  // namespace
+
+TEST_CASE("load_shapefile") {
+  std::string const fname = "load_shapefile_test.zip";
+
+  std::mt19937 gen{42};
+  std::vector<tiles::shapefile_polygon> polygons;
+  polygons.push_back({make_ring(8.6, 49.8, 0.5, 100, gen)});
+  polygons.push_back(
+      {make_ring(-20., 10., 4., 1000, gen), make_ring(-20., 10., 1., 50, gen)});
+  polygons.push_back({make_ring(120., -30., 10., 20000, gen)});
+
+  for (auto const with_shx : {true, false}) {
+    INFO("with .shx: " << with_shx);
+    auto const result = write_and_load(fname, polygons, with_shx);
+
+    REQUIRE(result.size() == polygons.size());
+    CHECK(result[0].outer().size() == 101);
+    CHECK(result[0].inners().empty());
+    CHECK(result[1].outer().size() == 1001);
+    REQUIRE(result[1].inners().size() == 1);
+    CHECK(result[1].inners()[0].size() == 51);
+    CHECK(result[2].outer().size() == 20001);
+
+    CHECK(result[0].outer()[0] == tiles::latlng_to_fixed(polygons[0][0][0]));
+  }
+}
+
+TEST_CASE("load_shapefile trailing bytes") {
+  std::string const fname = "load_shapefile_trailing_test.zip";
+
+  std::mt19937 gen{42};
+  std::vector<tiles::shapefile_polygon> polygons;
+  polygons.push_back({make_ring(8.6, 49.8, 0.5, 100, gen)});
+  polygons.push_back({make_ring(-20., 10., 4., 1000, gen)});
+
+  tiles::write_shapefile(fname, polygons, true);
+  append_to_shp(fname, std::string(100, 'x'));
+
+  auto const load = [&] {
+    std::vector<tiles::fixed_simple_polygon> result;
+    tiles::load_shapefile(fname, [&](auto&& polygon) {
+      result.emplace_back(std::move(polygon));
+    });
+    return result;
+  };
+
+  // .shx: bytes after the last indexed record are ignored
+  auto const result = load();
+  REQUIRE(result.size() == polygons.size());
+  CHECK(result[0].outer().size() == 101);
+  CHECK(result[1].outer().size() == 1001);
+
+  // header scan: a truncated or garbage record is an error
+  tiles::write_shapefile(fname, polygons, false);
+  append_to_shp(fname, std::string(100, 'x'));
+  CHECK_THROWS(load());
+
+  std::remove(fname.c_str());
+}
+
+TEST_CASE("load_shapefile record order") {
+  std::string const fname = "load_shapefile_order_test.zip";
+
+  // > 1 MB: several record batches, parsed in parallel
+  std::mt19937 gen{42};
+  std::vector<tiles::shapefile_polygon> polygons;
+  for (auto i = 0; i < 2000; ++i) {
+    polygons.push_back({make_ring(-170. + i * 0.17, 0., 0.05,
+                                  16 + static_cast<size_t>(i % 128), gen)});
+  }
+
+  for (auto const with_shx : {true, false}) {
+    INFO("with .shx: " << with_shx);
+    auto const result = write_and_load(fname, polygons, with_shx);
+
+    REQUIRE(result.size() == polygons.size());
+    for (auto i = 0ULL; i < polygons.size(); ++i) {
+      REQUIRE(result[i].outer().size() == polygons[i][0].size());
+      CHECK(result[i].outer()[0] ==
+            tiles::latlng_to_fixed(polygons[i][0][0]));
+    }
+  }
+}
+
+TEST_CASE("load_coastlines_benchmark", "[!hide]") {
+  std::string const zip_fname = "coastlines_benchmark.zip";
+  std::string const db_fname = "coastlines_benchmark.mdb";
+
+  // one "continent" with a detailed coast and many small islands
+  std::mt19937 gen{42};
+  std::uniform_real_distribution<double> lng_dist{-170., 170.};
+  std::uniform_real_distribution<double> lat_dist{-70., 70.};
+
+  std::vector<tiles::shapefile_polygon> polygons;
+  polygons.push_back({make_ring(10., 30., 25., 2'000'000, gen)});
+  for (auto i = 0; i < 50'000; ++i) {
+    polygons.push_back(
+        {make_ring(lng_dist(gen), lat_dist(gen), 0.05, 64, gen)});
+  }
+
+  {
+    tiles::scoped_timer t{"write shapefile"};
+    tiles::write_shapefile(zip_fname, polygons);
+  }
+
+  tiles::clear_database(db_fname);
+  tiles::clear_pack_file(db_fname.c_str());
+
+  {
+    lmdb::env db_env = tiles::make_tile_database(db_fname.c_str());
+    tiles::tile_db_handle db_handle{db_env};
+    tiles::pack_handle pack_handle{db_fname.c_str()};
+
+    tiles::feature_inserter_mt inserter{
+        tiles::dbi_handle{db_handle, db_handle.features_dbi_opener()},
+        pack_handle};
+
+    tiles::scoped_timer t{"load coastlines"};
+    tiles::load_coastlines(db_handle, inserter, zip_fname);
+  }
+
+  std::remove(zip_fname.c_str());
+}
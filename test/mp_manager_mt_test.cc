@@ -0,0 +1,80 @@
+#include "catch2/catch.hpp"
+
+#include <cstring>
+#include <vector>
+
+#include "osmium/builder/attr.hpp"
+#include "osmium/memory/buffer.hpp"
+#include "osmium/osm/area.hpp"
+#include "osmium/osm/relation.hpp"
+#include "osmium/osm/way.hpp"
+
+#include "tiles/osm/mp_manager_mt.h"
+
+namespace o = osmium;
+namespace om = osmium::memory;
+
+TEST_CASE("mp_manager_mt") {
+  using namespace osmium::builder::attr;  // NOLINT
+
+  om::Buffer input{4096, om::Buffer::auto_grow::yes};
+
+  // boundary with node members (admin_centre, label) between the ways:
+  // the assembler must only see the way members
+  auto const rel_offset = o::builder::add_relation(
+      input, _id(1), _member(o::item_type::node, 100, "admin_centre"),
+      _member(o::item_type::way, 10, "outer"),
+      _member(o::item_type::node, 101, "label"),
+      _member(o::item_type::way, 11, "outer"), _tag("type", "boundary"),
+      _tag("boundary", "administrative"), _tag("admin_level", "8"));
+
+  auto const way_10_offset = o::builder::add_way(
+      input, _id(10),
+      _nodes({o::NodeRef{1, {8.0, 49.0}}, o::NodeRef{2, {8.1, 49.0}},
+              o::NodeRef{3, {8.1, 49.1}}}));
+  auto const way_11_offset = o::builder::add_way(
+      input, _id(11),
+      _nodes({o::NodeRef{3, {8.1, 49.1}}, o::NodeRef{4, {8.0, 49.1}},
+              o::NodeRef{1, {8.0, 49.0}}}));
+
+  // closed, but no relation member: assembled directly
+  auto const way_20_offset = o::builder::add_way(
+      input, _id(20), _tag("building", "yes"),
+      _nodes({o::NodeRef{5, {9.0, 50.0}}, o::NodeRef{6, {9.1, 50.0}},
+              o::NodeRef{7, {9.1, 50.1}}, o::NodeRef{5, {9.0, 50.0}}}));
+
+  tiles::mp_manager_mt mgr;
+  mgr.relation(input.get<o::Relation>(rel_offset));
+  mgr.prepare_for_lookup();
+
+  om::Buffer out{4096, om::Buffer::auto_grow::yes};
+  auto const areas = [&] {
+    std::vector<o::Area const*> result;
+    for (auto const& area : out.select<o::Area>()) {
+      result.push_back(&area);
+    }
+    return result;
+  };
+
+  mgr.way(input.get<o::Way>(way_10_offset), out);
+  CHECK(areas().empty());  // way 11 still missing
+
+  mgr.way(input.get<o::Way>(way_11_offset), out);
+  mgr.way(input.get<o::Way>(way_20_offset), out);
+
+  auto const result = areas();
+  REQUIRE(result.size() == 2);
+
+  auto const& boundary = *result.at(0);
+  CHECK_FALSE(boundary.from_way());
+  CHECK(boundary.orig_id() == 1);
+  CHECK(boundary.num_rings().first == 1);
+  CHECK(boundary.num_rings().second == 0);
+  REQUIRE(boundary.tags().get_value_by_key("boundary") != nullptr);
+  CHECK(std::strcmp(boundary.tags().get_value_by_key("boundary"),
+                    "administrative") == 0);
+
+  auto const& building = *result.at(1);
+  CHECK(building.from_way());
+  CHECK(building.orig_id() == 20);
+}
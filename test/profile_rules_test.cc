@@ -0,0 +1,534 @@
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "osmium/builder/osm_object_builder.hpp"
+#include "osmium/memory/buffer.hpp"
+#include "osmium/osm.hpp"
+
+#include "sol/sol.hpp"
+
+#include "tiles/osm/pending_feature.h"
+#include "tiles/osm/profile_rules.h"
+
+namespace ob = osmium::builder;
+namespace om = osmium::memory;
+
+using tag_list = std::vector<std::pair<std::string, std::string>>;
+
+namespace {
+
+// process_* functions of profile/profile.lua before they were replaced by
+// the declarative rules: the rules must produce the same features
+constexpr auto const kReferenceProfile = R"lua(
+function process_node(node)
+  if node:has_any_tag("place") then
+    if node:has_tag("place", "city") then
+      node:set_approved_min(5)
+    elseif node:has_tag("place", "town") or
+           node:has_tag("place", "borough") then
+      node:set_approved_min(9)
+    elseif node:has_tag("place", "suburb") or
+           node:has_tag("place", "village") then
+      node:set_approved_min(11)
+    end
+
+    node:set_target_layer("cities")
+    node:add_tag_as_string("place")
+    node:add_tag_as_string("name")
+    node:add_tag_as_integer("population")
+
+  end
+end
+
+function process_way(way)
+  if way:has_any_tag("highway") then
+    way:set_target_layer("road")
+    way:add_tag_as_string("highway")
+    way:add_tag_as_string("name")
+
+    if way:has_tag("highway", "motorway") or
+       way:has_tag("highway", "trunk") then
+      way:set_approved_min(5)
+      way:add_tag_as_string("ref")
+
+    elseif way:has_tag("highway", "motorway_link") or
+           way:has_tag("highway", "trunk_link") or
+           way:has_tag("highway", "primary") or
+           way:has_tag("highway", "secondary") or
+           way:has_tag("highway", "tertiary") or
+           way:has_tag("highway", "aeroway") then
+      way:set_approved_min(9)
+      way:add_tag_as_string("ref")
+
+    elseif way:has_tag("highway", "residential") or
+           way:has_tag("highway", "living_street") or
+           way:has_tag("highway", "primary_link") or
+           way:has_tag("highway", "secondary_link") or
+           way:has_tag("highway", "tertiary_link") or
+           way:has_tag("highway", "unclassified") or
+           way:has_tag("highway", "service") or
+           way:has_tag("highway", "footway") or
+           way:has_tag("highway", "track") or
+           way:has_tag("highway", "steps") or
+           way:has_tag("highway", "cycleway") or
+           way:has_tag("highway", "path") then
+      way:set_approved_min(12)
+    end
+
+  elseif way:has_any_tag("railway", "rail", "subway", "tram") then
+    if way:has_tag("railway", "disused") or
+       way:has_tag("railway", "abandoned") then
+      way:set_target_layer("rail")
+      way:set_approved_min(14)
+      way:add_string("rail", "old")
+
+    elseif way:has_tag("usage", "industrial") or
+            way:has_tag("usage", "military") or
+            way:has_tag("usage", "test") or
+            way:has_tag("usage", "tourism") or
+            way:has_tag("service", "yard") or
+            way:has_tag("service", "spur") or
+            way:has_tag("railway", "miniature") or
+            way:has_tag("railway:preserved", "yes") then
+      way:set_target_layer("rail")
+      way:set_approved_min(14)
+      way:add_string("rail", "detail")
+
+    elseif way:has_tag("railway", "subway") or
+           way:has_tag("railway", "tram") then
+      way:set_target_layer("rail")
+      way:set_approved_min(10)
+      way:add_string("rail", "secondary")
+
+    else
+      way:set_target_layer("rail")
+      way:set_approved_min(5)
+      way:add_string("rail", "primary")
+    end
+
+  elseif way:has_any_tag("waterway") then
+    way:set_target_layer("waterway")
+
+    if way:has_tag("waterway", "river") or
+       way:has_tag("waterway", "canal") then
+       way:set_approved_min(8)
+    elseif way:has_tag("waterway", "stream") then
+      way:set_approved_min(13)
+    elseif way:has_tag("waterway", "ditch") or
+           way:has_tag("waterway", "drain") then
+      way:set_approved_min(15)
+    end
+  end
+end
+
+function process_area(area)
+  if area:has_any_tag("building") then
+    area:set_target_layer("building")
+    area:set_approved_min_by_area(14, 1e8,
+                                  12, 1e10,
+                                  10, -1)
+
+  elseif area:has_any_tag("landuse", "residential", "retail", "industrial", "commercial") then
+    area:set_target_layer("landuse")
+    area:add_tag_as_string("landuse")
+    area:set_approved_min_by_area(14, 1e8,
+                                  10, 1e10,
+                                   8, -1)
+
+  elseif area:has_any_tag("landuse", "quarry", "farmyard", "railway") then
+    area:set_target_layer("landuse")
+    area:add_string("landuse", "industrial")
+    area:set_approved_min_by_area(14, 1e8,
+                                  10, 1e10,
+                                   8, -1)
+
+  elseif area:has_tag("leisure", "sports_centre") or
+         area:has_tag("amenity", "hospital") or
+         area:has_tag("amenity", "police") or
+         area:has_tag("amenity", "fire_station") or
+         area:has_tag("amenity", "kindergarten") or
+         area:has_tag("amenity", "school") or
+         area:has_tag("amenity", "place_of_worship") or
+         area:has_tag("amenity", "university") then
+    area:set_target_layer("landuse")
+    area:add_string("landuse", "complex")
+    area:set_approved_min_by_area(14, 1e8,
+                                  10, 1e10,
+                                   8, -1)
+
+  elseif area:has_tag("landuse", "forest") or
+         area:has_tag("natural", "wood") or
+         area:has_tag("natural", "oarchard") or
+         area:has_tag("natural", "scrub") then
+    area:set_target_layer("landuse")
+    area:add_string("landuse", "nature_heavy")
+    area:set_approved_min_by_area(14, 1e8,
+                                  10, 1e10,
+                                   8, -1)
+
+  elseif area:has_tag("landuse", "farmland") or
+         area:has_tag("landuse", "vineyard") or
+         area:has_tag("landuse", "plant_nursery") or
+         area:has_tag("landuse", "meadow") or
+         area:has_tag("natural", "grassland") or
+         area:has_tag("landuse", "grass") then
+    area:set_target_layer("landuse")
+    area:add_string("landuse", "nature_light")
+    area:set_approved_min_by_area(14, 1e8,
+                                  10, 1e10,
+                                   8, -1)
+
+  elseif area:has_tag("leisure", "park") or
+         area:has_tag("leisure", "garden") or
+         area:has_tag("leisure", "playground") or
+         area:has_tag("leisure", "stadium") or
+         area:has_tag("landuse", "recreation_ground") or
+         area:has_tag("landuse", "greenhouse_horticulture") or
+         area:has_tag("landuse", "allotments") then
+    area:set_target_layer("landuse")
+    area:add_string("landuse", "park")
+    area:set_approved_min_by_area(14, 1e8,
+                                  10, 1e10,
+                                   8, -1)
+
+  elseif area:has_tag("landuse", "cemetery") then
+    area:set_target_layer("landuse")
+    area:add_string("landuse", "cemetery")
+    area:set_approved_min_by_area(14, 1e8,
+                                  10, 1e10,
+                                   8, -1)
+
+
+  elseif area:has_tag("landuse", "brownfield") or
+         area:has_tag("landuse", "greenfield") or
+         area:has_tag("landuse", "construction") then
+    area:set_target_layer("construction")
+    area:set_approved_min_by_area(14, 1e8,
+                                  10, 1e10,
+                                   8, -1)
+
+  elseif area:has_tag("natural", "water") or
+         area:has_tag("waterway", "riverbank") or
+         area:has_tag("waterway", "basin") or
+         area:has_tag("waterway", "pond") or
+         area:has_tag("leisure", "swimming_pool") then
+    area:set_target_layer("water")
+    area:set_approved_min_by_area(12, 1e6,
+                                  10, 1e4,
+                                   0, -1)
+
+  elseif area:has_tag("natural", "beach") then
+    area:set_target_layer("landuse")
+    area:add_string("landuse", "beach")
+    area:set_approved_min_by_area(14, 1e8,
+                                  10, 1e10,
+                                   8, -1)
+
+  elseif area:has_tag("highway", "pedestrian") or
+         area:has_tag("highway", "service") or
+         area:has_tag("amenity", "parking") then
+    area:set_target_layer("pedestrian")
+    area:set_approved_min_by_area(12, 1e8,
+                                  10, 1e10,
+                                  8, -1)
+
+  elseif area:has_tag("leisure", "pitch") then
+    area:set_target_layer("sport")
+    area:set_approved_min_by_area(14, 1e8,
+                                  12, 1e10,
+                                  8, -1)
+  end
+end
+)lua";
+
+template <typename Builder>
+size_t add_object(om::Buffer& buf, tag_list const& tags) {
+  {
+    Builder builder{buf};
+    builder.object().set_id(1);
+    ob::TagListBuilder tag_builder{builder};
+    for (auto const& [key, value] : tags) {
+      tag_builder.add_tag(key, value);
+    }
+  }
+  return buf.commit();
+}
+
+tiles::fixed_geometry make_square(tiles::fixed_coord_t const size) {
+  tiles::fixed_simple_polygon polygon;
+  polygon.outer() = {{0, 0}, {0, size}, {size, size}, {size, 0}, {0, 0}};
+  return tiles::fixed_polygon{std::move(polygon)};
+}
+
+std::string to_string(tag_list const& tags) {
+  std::string str;
+  for (auto const& [key, value] : tags) {
+    str.append(key).append("=").append(value).append(" ");
+  }
+  return str;
+}
+
+// all single tags and all pairs of tags with different keys
+std::vector<tag_list> make_tag_lists(tag_list const& tags) {
+  std::vector<tag_list> result;
+  for (auto i = 0ULL; i < tags.size(); ++i) {
+    result.push_back({tags[i]});
+    for (auto j = i + 1; j < tags.size(); ++j) {
+      if (tags[i].first != tags[j].first) {
+        result.push_back({tags[i], tags[j]});
+        result.push_back({tags[j], tags[i]});
+      }
+    }
+  }
+  return result;
+}
+
+struct profile_fixture {
+  profile_fixture() {
+    reference_.open_libraries(sol::lib::base);
+    tiles::register_pending_feature(reference_);
+    reference_.script(kReferenceProfile);
+
+    current_.script_file(TILES_TEST_PROFILE);
+    current_.open_libraries(sol::lib::base, sol::lib::package);
+    tiles::register_pending_feature(current_);
+
+    sol::table const decl = current_["rules"];
+    for (auto const* type : {"node", "way", "area"}) {
+      auto rules = tiles::read_profile_rules(decl, type);
+      REQUIRE(rules.has_value());
+      rules_.emplace(type, std::move(*rules));
+    }
+  }
+
+  // same decision as handle_feature in feature_handler.cc
+  template <typename Builder>
+  void check(char const* type, tag_list const& tags,
+             tiles::fixed_geometry const& geometry) {
+    INFO(type << ": " << to_string(tags));
+
+    om::Buffer buf{1024, om::Buffer::auto_grow::yes};
+    auto const& obj =
+        buf.get<osmium::OSMObject>(add_object<Builder>(buf, tags));
+    auto const read_geometry = [&] { return geometry; };
+    auto const process = std::string{"process_"} + type;
+
+    tiles::pending_feature expected{obj, read_geometry};
+    sol::function reference_process = reference_[process];
+    reference_process(expected);
+
+    tiles::pending_feature actual{obj, read_geometry};
+    if (auto const* rule = rules_.at(type).match(obj); rule != nullptr) {
+      if (rule->use_lua_) {
+        sol::function current_process = current_[process];
+        current_process(actual);
+      } else {
+        tiles::apply_profile_rule(*rule, actual);
+      }
+    }
+
+    REQUIRE(actual.is_approved_ == expected.is_approved_);
+    if (!expected.is_approved_) {
+      return;
+    }
+
+    CHECK(actual.target_layer_ == expected.target_layer_);
+    CHECK(actual.zoom_levels_ == expected.zoom_levels_);
+
+    actual.finish_metadata();
+    expected.finish_metadata();
+    CHECK(actual.metadata_ == expected.metadata_);
+  }
+
+  sol::state reference_, current_;
+  std::map<std::string, tiles::profile_rules> rules_;
+};
+
+}  // namespace
+
+TEST_CASE("profile_rules") {
+  sol::state lua;
+  lua.script(R"lua(
+    rules = {
+      way = {
+        { match = { highway = "primary" }, layer = "road", min = 9,
+          tags = { "name" } },
+        { match = { highway = true }, layer = "other", full = true },
+        { match = { railway = { "rail", "tram" } }, lua = true },
+        { match = { waterway = "river" } },
+      }
+    }
+  )lua");
+  sol::table const decl = lua["rules"];
+
+  CHECK_FALSE(tiles::read_profile_rules(decl, "node").has_value());
+
+  auto const rules = tiles::read_profile_rules(decl, "way");
+  REQUIRE(rules.has_value());
+  REQUIRE(rules->rules_.size() == 4);
+
+  auto const match = [&](tag_list const& tags) {
+    om::Buffer buf{1024, om::Buffer::auto_grow::yes};
+    auto const& way =
+        buf.get<osmium::OSMObject>(add_object<ob::WayBuilder>(buf, tags));
+    auto const* rule = rules->match(way);
+    return rule == nullptr ? -1 : rule - rules->rules_.data();
+  };
+
+  CHECK(match({{"highway", "primary"}}) == 0);
+  CHECK(match({{"highway", "track"}}) == 1);
+  CHECK(match({{"railway", "rail"}}) == 2);
+  CHECK(match({{"railway", "disused"}}) == -1);
+  CHECK(match({{"waterway", "river"}}) == 3);
+  CHECK(match({{"name", "x"}}) == -1);
+
+  // lowest rule index wins, independent of the tag order
+  CHECK(match({{"railway", "tram"}, {"highway", "primary"}}) == 0);
+  CHECK(match({{"waterway", "river"}, {"highway", "track"}}) == 1);
+  CHECK(match({{"waterway", "river"}, {"railway", "rail"}}) == 2);
+
+  CHECK(rules->rules_[0].target_layer_ == "road");
+  CHECK(rules->rules_[0].approved_min_ == 9U);
+  CHECK(rules->rules_[0].string_tags_ == std::vector<std::string>{"name"});
+  CHECK(rules->rules_[1].approved_min_ == 0U);
+  CHECK(rules->rules_[2].use_lua_);
+  CHECK(rules->rules_[3].target_layer_.empty());  // explicit drop
+}
+
+TEST_CASE("profile_rules poi") {
+  profile_fixture fixture;
+  auto const& rules = fixture.rules_.at("node");
+
+  om::Buffer buf{1024, om::Buffer::auto_grow::yes};
+  auto const make_poi = [&](char const* amenity) -> osmium::OSMObject const& {
+    return buf.get<osmium::OSMObject>(add_object<ob::NodeBuilder>(
+        buf, {{"amenity", amenity}, {"name", "n"}, {"priority", "42"}}));
+  };
+
+  // amenities of the tiles-generate poi clusters
+  for (auto const* amenity :
+       {"restaurant", "cafe", "pharmacy", "bank", "school", "fuel"}) {
+    INFO(amenity);
+    auto const& node = make_poi(amenity);
+    auto const* rule = rules.match(node);
+    REQUIRE(rule != nullptr);
+
+    tiles::pending_feature pf{node, [] { return tiles::fixed_geometry{}; }};
+    tiles::apply_profile_rule(*rule, pf);
+    CHECK(pf.is_approved_);
+    CHECK(pf.target_layer_ == "poi");
+    CHECK(pf.zoom_levels_.first == 14);
+
+    // integer tags are encoded as numeric (see add_tag_as_integer)
+    CHECK(std::find(begin(pf.metadata_), end(pf.metadata_),
+                    tiles::metadata{"priority", tiles::encode_numeric(42.)}) !=
+          end(pf.metadata_));
+  }
+
+  CHECK(rules.match(make_poi("bench")) == nullptr);
+}
+
+TEST_CASE("profile_rules equivalent to reference profile") {
+  profile_fixture fixture;
+  tiles::fixed_geometry const none{tiles::fixed_null{}};
+
+  SECTION("node") {
+    for (auto const& value :
+         {"city", "town", "borough", "suburb", "village", "hamlet"}) {
+      fixture.check<ob::NodeBuilder>(
+          "node", {{"place", value}, {"name", "n"}, {"population", "1000"}},
+          none);
+    }
+    fixture.check<ob::NodeBuilder>("node", {{"name", "n"}}, none);
+  }
+
+  SECTION("way") {
+    tag_list const tags{
+        {"highway", "motorway"},      {"highway", "trunk"},
+        {"highway", "motorway_link"}, {"highway", "primary"},
+        {"highway", "tertiary"},      {"highway", "aeroway"},
+        {"highway", "residential"},   {"highway", "primary_link"},
+        {"highway", "service"},       {"highway", "path"},
+        {"highway", "construction"},  {"railway", "rail"},
+        {"railway", "subway"},        {"railway", "tram"},
+        {"railway", "disused"},       {"railway", "miniature"},
+        {"waterway", "river"},        {"waterway", "canal"},
+        {"waterway", "stream"},       {"waterway", "ditch"},
+        {"waterway", "drain"},        {"waterway", "dam"},
+        {"usage", "industrial"},      {"service", "yard"},
+        {"railway:preserved", "yes"}, {"name", "n"},
+        {"ref", "r"}};
+    for (auto const& list : make_tag_lists(tags)) {
+      fixture.check<ob::WayBuilder>("way", list, none);
+    }
+
+    // the catch-all highway rule shadows railway and waterway rules:
+    // as did the elseif chain of the reference profile
+    fixture.check<ob::WayBuilder>(
+        "way", {{"highway", "construction"}, {"railway", "rail"}}, none);
+    fixture.check<ob::WayBuilder>(
+        "way", {{"waterway", "river"}, {"highway", "construction"}}, none);
+  }
+
+  SECTION("area") {
+    tag_list const tags{
+        {"building", "yes"},
+        {"landuse", "residential"},
+        {"landuse", "industrial"},
+        {"landuse", "quarry"},
+        {"landuse", "railway"},
+        {"landuse", "forest"},
+        {"landuse", "farmland"},
+        {"landuse", "grass"},
+        {"landuse", "recreation_ground"},
+        {"landuse", "allotments"},
+        {"landuse", "cemetery"},
+        {"landuse", "brownfield"},
+        {"landuse", "construction"},
+        {"landuse", "military"},
+        {"leisure", "sports_centre"},
+        {"leisure", "park"},
+        {"leisure", "stadium"},
+        {"leisure", "swimming_pool"},
+        {"leisure", "pitch"},
+        {"leisure", "marina"},
+        {"amenity", "hospital"},
+        {"amenity", "university"},
+        {"amenity", "parking"},
+        {"amenity", "cafe"},
+        {"natural", "wood"},
+        {"natural", "scrub"},
+        {"natural", "grassland"},
+        {"natural", "water"},
+        {"natural", "beach"},
+        {"natural", "bare_rock"},
+        {"waterway", "riverbank"},
+        {"waterway", "pond"},
+        {"waterway", "river"},
+        {"highway", "pedestrian"},
+        {"highway", "service"},
+        {"highway", "footway"},
+        {"name", "n"}};
+
+    // below / between / above all area limits of the reference profile
+    std::vector<tiles::fixed_geometry> const geometries{
+        make_square(50), make_square(500), make_square(5'000),
+        make_square(50'000), make_square(500'000)};
+
+    auto i = 0ULL;
+    for (auto const& list : make_tag_lists(tags)) {
+      fixture.check<ob::AreaBuilder>("area", list,
+                                     geometries[i++ % geometries.size()]);
+    }
+    for (auto const& geometry : geometries) {
+      fixture.check<ob::AreaBuilder>("area", {{"building", "yes"}}, geometry);
+      fixture.check<ob::AreaBuilder>("area", {{"natural", "water"}},
+                                     geometry);
+    }
+  }
+}
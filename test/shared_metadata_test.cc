@@ -0,0 +1,75 @@
+#include "catch2/catch.hpp"
+
+#include <string>
+
+#include "tiles/db/shared_metadata.h"
+
+using tiles::metadata;
+using tiles::metadata_count_map;
+using tiles::shared_metadata_builder;
+
+TEST_CASE("shared_metadata_builder") {
+  SECTION("exact below capacity") {
+    shared_metadata_builder builder{10};
+    {
+      tiles::local_metadata_counter counter{builder};
+      for (auto i = 0; i < 3; ++i) {
+        counter.update({{"highway", "primary"}, {"name", "main street"}});
+      }
+      counter.update({{"highway", "primary"}});
+    }  // flushed on destruction
+    builder.finish();
+
+    REQUIRE(builder.counts_.size() == 2);
+    auto const& primary = builder.counts_.at({"highway", "primary"});
+    CHECK(primary.count_ == 4);
+    CHECK(primary.error_ == 0);
+    auto const& name = builder.counts_.at({"name", "main street"});
+    CHECK(name.count_ == 3);
+    CHECK(name.error_ == 0);
+    CHECK(builder.stat_total_ == 7);
+    CHECK(builder.stat_evicted_ == 0);
+  }
+
+  SECTION("skewed stream above capacity") {
+    constexpr auto kBatches = 100;
+    constexpr auto kHeavyHitters = 5;
+    constexpr auto kTailPerBatch = 300;
+
+    shared_metadata_builder builder{10};  // capacity 40, prunes above 80
+
+    metadata_count_map expected;
+    auto tail_id = 0;
+    for (auto b = 0; b < kBatches; ++b) {
+      metadata_count_map batch;
+      for (auto h = 0; h < kHeavyHitters; ++h) {
+        batch[{"heavy", std::to_string(h)}] = 10 * (h + 1);
+      }
+      for (auto t = 0; t < kTailPerBatch; ++t) {
+        batch[{"tail", std::to_string(tail_id++)}] = 1;
+      }
+      for (auto const& [meta, count] : batch) {
+        expected[meta] += count;
+      }
+      builder.enqueue(std::move(batch));
+    }
+    builder.finish();
+
+    CHECK(builder.stat_evicted_ > 0);
+    CHECK(builder.counts_.size() <= 2 * builder.capacity_);
+
+    for (auto h = 0; h < kHeavyHitters; ++h) {
+      auto const it = builder.counts_.find({"heavy", std::to_string(h)});
+      REQUIRE(it != end(builder.counts_));
+      CHECK(it->second.count_ - it->second.error_ ==
+            static_cast<uint64_t>(kBatches * 10 * (h + 1)));
+    }
+
+    // space-saving bounds: guaranteed count <= true count <= estimate
+    for (auto const& [meta, entry] : builder.counts_) {
+      auto const true_count = expected.at(meta);
+      CHECK(entry.count_ - entry.error_ <= true_count);
+      CHECK(true_count <= entry.count_);
+    }
+  }
+}
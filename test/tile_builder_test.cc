@@ -0,0 +1,226 @@
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "osmium/builder/attr.hpp"
+#include "osmium/memory/buffer.hpp"
+#include "osmium/osm/node.hpp"
+
+#include "protozero/pbf_message.hpp"
+
+#include "sol/sol.hpp"
+
+#include "tiles/bin_utils.h"
+#include "tiles/get_tile.h"
+#include "tiles/mvt/tags.h"
+#include "tiles/mvt/tile_builder.h"
+#include "tiles/mvt/tile_spec.h"
+#include "tiles/osm/pending_feature.h"
+#include "tiles/osm/profile_rules.h"
+
+namespace ttm = tiles::tags::mvt;
+
+namespace {
+
+constexpr auto const kPoiLayer = 1ULL;
+
+tiles::feature make_poi(uint64_t const id, tiles::fixed_xy const& pos,
+                        int64_t const priority,
+                        std::string const& key = "priority") {
+  std::string value;
+  tiles::append(value, tiles::metadata_value_t::integer);
+  tiles::append(value, priority);
+
+  tiles::feature f;
+  f.id_ = id;
+  f.layer_ = kPoiLayer;
+  f.meta_ = {{key, value}};
+  f.geometry_ = tiles::fixed_point{{pos}};
+  return f;
+}
+
+tiles::feature make_line(uint64_t const id,
+                         std::vector<tiles::fixed_xy> const& line) {
+  tiles::feature f;
+  f.id_ = id;
+  f.layer_ = kPoiLayer;
+  f.geometry_ =
+      tiles::fixed_polyline{tiles::fixed_line{begin(line), end(line)}};
+  return f;
+}
+
+std::vector<uint64_t> feature_ids(std::string const& tile) {
+  std::vector<uint64_t> ids;
+  protozero::pbf_message<ttm::Tile> tile_msg{tile};
+  while (tile_msg.next(ttm::Tile::repeated_Layer_layers)) {
+    protozero::pbf_message<ttm::Layer> layer_msg{tile_msg.get_view()};
+    while (layer_msg.next(ttm::Layer::repeated_Feature_features)) {
+      protozero::pbf_message<ttm::Feature> feature_msg{layer_msg.get_view()};
+      while (feature_msg.next(ttm::Feature::optional_uint64_id)) {
+        ids.push_back(feature_msg.get_uint64());
+      }
+    }
+  }
+  std::sort(begin(ids), end(ids));
+  return ids;
+}
+
+}  // namespace
+
+TEST_CASE("tile_builder point thinning") {
+  geo::tile const tile{536, 347, 10};
+  tiles::tile_spec const spec{tile};
+  auto const& min = spec.draw_bounds_.min_corner();
+
+  tiles::render_ctx ctx;
+  ctx.layer_names_ = {"coastline", "poi"};
+
+  // 16 screen pixels at z10 in z20 pixels
+  constexpr auto const kCell = tiles::fixed_coord_t{16 * 16} << 10U;
+  auto const at = [&](tiles::fixed_coord_t const x,
+                      tiles::fixed_coord_t const y) {
+    return tiles::fixed_xy{min.x() + x, min.y() + y};
+  };
+
+  auto const build = [&] {
+    tiles::tile_builder tb{ctx, tile};
+    tb.add_feature(make_poi(1, at(kCell + 10, kCell + 10), 1));
+    tb.add_feature(make_poi(2, at(kCell + 20, kCell + 20), 5));
+    tb.add_feature(make_poi(3, at(kCell + 30, kCell + 30), 3));
+    tb.add_feature(make_poi(4, at(3 * kCell, kCell + 10), 0));
+    return tb.finish();
+  };
+
+  SECTION("no thinning") {
+    CHECK(feature_ids(build()) == std::vector<uint64_t>{1, 2, 3, 4});
+  }
+
+  SECTION("grid") {
+    tiles::set_point_grid(ctx, "poi:16");
+    CHECK(feature_ids(build()) == std::vector<uint64_t>{2, 4});
+  }
+
+  SECTION("grid other layer") {
+    tiles::set_point_grid(ctx, "label:16,");
+    CHECK(feature_ids(build()) == std::vector<uint64_t>{1, 2, 3, 4});
+  }
+
+  SECTION("byte budget") {
+    auto const full_size = build().size();
+    ctx.tb_max_tile_bytes_ = full_size / 2;
+
+    auto const ids = feature_ids(build());
+    REQUIRE(!ids.empty());
+    CHECK(ids.size() < 4);
+    CHECK(std::find(begin(ids), end(ids), 2) != end(ids));  // highest prio
+    CHECK(std::find(begin(ids), end(ids), 4) == end(ids));  // lowest prio
+  }
+
+  SECTION("priority key") {
+    tiles::set_point_grid(ctx, "poi:16");
+    ctx.tb_priority_key_ = "rank";
+
+    tiles::tile_builder tb{ctx, tile};
+    tb.add_feature(make_poi(1, at(kCell + 10, kCell + 10), 1, "rank"));
+    tb.add_feature(make_poi(2, at(kCell + 20, kCell + 20), 5));  // ignored
+    tb.add_feature(make_poi(3, at(kCell + 30, kCell + 30), 3, "rank"));
+    CHECK(feature_ids(tb.finish()) == std::vector<uint64_t>{3});
+  }
+
+  CHECK_THROWS(tiles::set_point_grid(ctx, "poi"));
+  CHECK_THROWS(tiles::set_point_grid(ctx, "poi:0"));
+}
+
+TEST_CASE("tile_builder point thinning with profile priority") {
+  using namespace osmium::builder::attr;  // NOLINT
+
+  sol::state lua;
+  lua.script(R"lua(
+    rules = {
+      node = {
+        { match = { amenity = true }, layer = "poi", min = 0,
+          tags = { "amenity" }, integer_tags = { "priority" } },
+      }
+    }
+  )lua");
+  sol::table const decl = lua["rules"];
+  auto const rules = tiles::read_profile_rules(decl, "node");
+  REQUIRE(rules.has_value());
+
+  geo::tile const tile{536, 347, 10};
+  tiles::tile_spec const spec{tile};
+  auto const& min = spec.draw_bounds_.min_corner();
+
+  tiles::render_ctx ctx;
+  ctx.layer_names_ = {"coastline", "poi"};
+  tiles::set_point_grid(ctx, "poi:16");
+
+  // feature as produced by the feature handler for an osm node
+  osmium::memory::Buffer buf{1024, osmium::memory::Buffer::auto_grow::yes};
+  auto const make_feature = [&](uint64_t const id, char const* priority) {
+    auto const& node = buf.get<osmium::Node>(osmium::builder::add_node(
+        buf, _id(static_cast<osmium::object_id_type>(id)),
+        _tag("amenity", "cafe"), _tag("priority", priority)));
+
+    auto const* rule = rules->match(node);
+    REQUIRE(rule != nullptr);
+
+    tiles::pending_feature pf{node, [] { return tiles::fixed_geometry{}; }};
+    tiles::apply_profile_rule(*rule, pf);
+    REQUIRE(pf.is_approved_);
+    CHECK(pf.target_layer_ == "poi");
+    pf.finish_metadata();
+
+    constexpr auto const kCell = tiles::fixed_coord_t{16 * 16} << 10U;
+    tiles::feature f;
+    f.id_ = id;
+    f.layer_ = kPoiLayer;
+    f.meta_ = pf.metadata_;
+    f.geometry_ = tiles::fixed_point{
+        {tiles::fixed_xy{min.x() + kCell + static_cast<int64_t>(id),
+                         min.y() + kCell}}};
+    return f;
+  };
+
+  tiles::tile_builder tb{ctx, tile};
+  tb.add_feature(make_feature(1, "10"));
+  tb.add_feature(make_feature(2, "80"));
+  tb.add_feature(make_feature(3, "20"));
+  CHECK(feature_ids(tb.finish()) == std::vector<uint64_t>{2});
+}
+
+TEST_CASE("tile_builder subpixel lines") {
+  geo::tile const tile{536, 347, 10};
+  tiles::tile_spec const spec{tile};
+  auto const& min = spec.draw_bounds_.min_corner();
+
+  tiles::render_ctx ctx;
+  ctx.layer_names_ = {"coastline", "road"};
+
+  // one tile unit at z10 in z20 pixels
+  constexpr auto const kUnit = tiles::fixed_coord_t{1} << 10U;
+  auto const at = [&](tiles::fixed_coord_t const x,
+                      tiles::fixed_coord_t const y) {
+    return tiles::fixed_xy{min.x() + x * kUnit, min.y() + y * kUnit};
+  };
+
+  auto const build = [&] {
+    tiles::tile_builder tb{ctx, tile};
+    tb.add_feature(make_line(1, {at(100, 100), at(110, 100)}));  // < 1px
+    tb.add_feature(make_line(2, {at(100, 200), at(200, 200)}));
+    tb.add_feature(make_line(
+        3, {at(100, 300), at(100, 300), at(150, 300), at(150, 300)}));
+    return tb.finish();
+  };
+
+  SECTION("drop") {
+    CHECK(feature_ids(build()) == std::vector<uint64_t>{2, 3});
+  }
+
+  SECTION("keep") {
+    ctx.tb_drop_subpixel_lines_ = false;
+    CHECK(feature_ids(build()) == std::vector<uint64_t>{1, 2, 3});
+  }
+}
@@ -0,0 +1,147 @@
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "tiles/workload.h"
+
+TEST_CASE("workload file") {
+  std::string const fname = "workload_test.txt";
+  {
+    std::ofstream out{fname};
+    out << "14/8580/5551\n"
+        << "\n"
+        << "# comment\n"
+        << R"(1.2.3.4 - - [17/Oct/2026:10:00:00] )"
+        << R"("GET /10/536/347.mvt HTTP/1.1")"
+        << "\n"
+        << "3/8/1\n"  // does not exist
+        << "/0/0/0.mvt\n";
+  }
+
+  auto const w = tiles::read_workload(fname);
+  REQUIRE(w.tiles_.size() == 3);
+  CHECK(w.tiles_[0] == geo::tile{8580, 5551, 14});
+  CHECK(w.tiles_[1] == geo::tile{536, 347, 10});
+  CHECK(w.tiles_[2] == geo::tile{0, 0, 0});
+  CHECK(w.arrivals_.empty());  // only one line with timestamp
+
+  tiles::write_workload(fname, w);
+  CHECK(tiles::read_workload(fname).tiles_ == w.tiles_);
+  std::remove(fname.c_str());
+}
+
+TEST_CASE("timed workload file") {
+  using us = std::chrono::microseconds;
+  std::string const fname = "timed_workload_test.txt";
+
+  SECTION("access log") {
+    {
+      std::ofstream out{fname};
+      out << R"(1.2.3.4 - - [17/Oct/2026:10:00:00 +0200] )"
+          << R"("GET /10/536/347.mvt HTTP/1.1" 200 1234)"
+          << "\n"
+          << R"(1.2.3.4 - - [17/Oct/2026:08:00:01.250 +0000] )"
+          << R"("GET /10/536/348.mvt HTTP/1.1" 200 1234)"
+          << "\n"
+          << "not a request\n"
+          << R"(1.2.3.4 - - [17/Oct/2026:10:00:01 +0200] )"  // reordered
+          << R"("GET /10/536/349.mvt HTTP/1.1" 200 1234)"
+          << "\n"
+          << R"(1.2.3.4 - - [18/Oct/2026:10:00:00 +0200] )"
+          << R"("GET /10/536/350.mvt HTTP/1.1" 200 1234)"
+          << "\n";
+    }
+
+    auto const w = tiles::read_workload(fname);
+    REQUIRE(w.tiles_.size() == 4);
+    REQUIRE(w.arrivals_.size() == 4);
+    CHECK(w.arrivals_[0] == us{0});
+    CHECK(w.arrivals_[1] == us{1'250'000});
+    CHECK(w.arrivals_[2] == us{1'250'000});  // clamped: non-decreasing
+    CHECK(w.arrivals_[3] == us{86'400'000'000});
+  }
+
+  SECTION("offset column") {
+    {
+      std::ofstream out{fname};
+      out << "1697536800.5 14/8580/5551\n"
+          << "1697536800.75 14/8580/5552\n"
+          << "1697536802 14/8580/5553\n";
+    }
+
+    auto const w = tiles::read_workload(fname);
+    REQUIRE(w.tiles_.size() == 3);
+    CHECK(w.tiles_[0] == geo::tile{8580, 5551, 14});
+    REQUIRE(w.arrivals_.size() == 3);
+    CHECK(w.arrivals_[0] == us{0});
+    CHECK(w.arrivals_[1] == us{250'000});
+    CHECK(w.arrivals_[2] == us{1'500'000});
+
+    tiles::write_workload(fname, w);
+    auto const reread = tiles::read_workload(fname);
+    CHECK(reread.tiles_ == w.tiles_);
+    CHECK(reread.arrivals_ == w.arrivals_);
+  }
+
+  SECTION("partially timed") {
+    {
+      std::ofstream out{fname};
+      out << "0.5 14/8580/5551\n"
+          << "14/8580/5552\n";
+    }
+
+    auto const w = tiles::read_workload(fname);
+    CHECK(w.tiles_.size() == 2);
+    CHECK(w.arrivals_.empty());
+  }
+
+  std::remove(fname.c_str());
+}
+
+TEST_CASE("zipf workload") {
+  tiles::zipf_workload_settings settings;
+  settings.centers_ = {{49.87, 8.65}, {52.52, 13.40}};
+  settings.min_z_ = 12;
+  settings.max_z_ = 14;
+  settings.count_ = 10'000;
+
+  auto const tiles = tiles::make_zipf_workload(settings);
+  REQUIRE(tiles.size() == settings.count_);
+  CHECK(tiles == tiles::make_zipf_workload(settings));  // deterministic
+  CHECK(std::all_of(begin(tiles), end(tiles), [](auto const& t) {
+    return t.z_ >= 12 && t.z_ <= 14;
+  }));
+
+  // skewed: the most popular tile is requested much more often than average
+  auto sorted = tiles;
+  std::sort(begin(sorted), end(sorted));
+  auto max_count = 0L;
+  for (auto it = begin(sorted); it != end(sorted);) {
+    auto const next = std::upper_bound(it, end(sorted), *it);
+    max_count = std::max(max_count, std::distance(it, next));
+    it = next;
+  }
+  auto const distinct = std::distance(
+      begin(sorted), std::unique(begin(sorted), end(sorted)));
+  CHECK(max_count > 10 * static_cast<long>(settings.count_) / distinct);
+}
+
+TEST_CASE("workload latency percentile") {
+  using std::chrono::microseconds;
+  std::vector<microseconds> latencies;
+  for (auto i = 1; i <= 10; ++i) {
+    latencies.emplace_back(i * 100);
+  }
+
+  CHECK(tiles::percentile(latencies, 0) == microseconds{100});
+  CHECK(tiles::percentile(latencies, 50) == microseconds{500});
+  CHECK(tiles::percentile(latencies, 95) == microseconds{1000});
+  CHECK(tiles::percentile(latencies, 100) == microseconds{1000});
+
+  std::vector<microseconds> const single{microseconds{42}};
+  CHECK(tiles::percentile(single, 99.9) == microseconds{42});
+}